@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# Measures CGI requests per second against a running server: CONCURRENCY
+# clients each send their share of REQUESTS GETs to URL and read the
+# script's full response. Every request uses a fresh connection, so only
+# the server's CGI path is timed, not keep-alive ACK timing. Run it once
+# per build to compare (see "CGI benchmark" in the README).
+
+URL=${1:-http://127.0.0.1:8080/cgi-bin/test.py}
+REQUESTS=${2:-400}
+CONCURRENCY=${3:-8}
+
+if ! command -v python3 >/dev/null 2>&1; then
+    echo "Error: python3 is required for the benchmark"
+    exit 1
+fi
+if ! curl -s -o /dev/null "$URL"; then
+    echo "Error: nothing answers at $URL"
+    echo "Please start the server first with: ./webserv config/default.conf"
+    exit 1
+fi
+
+echo "=== CGI throughput benchmark ==="
+echo "URL: $URL, $REQUESTS requests, $CONCURRENCY clients"
+
+python3 - "$URL" "$REQUESTS" "$CONCURRENCY" <<'PY'
+import http.client, sys, threading, time
+from urllib.parse import urlsplit
+
+url, total, clients = urlsplit(sys.argv[1]), int(sys.argv[2]), int(sys.argv[3])
+path = url.path + ("?" + url.query if url.query else "")
+latencies, failures, lock = [], [0], threading.Lock()
+
+def client(count):
+    for _ in range(count):
+        start = time.perf_counter()
+        conn = http.client.HTTPConnection(url.hostname, url.port or 80, timeout=60)
+        try:
+            conn.request("GET", path, headers={"Connection": "close"})
+            response = conn.getresponse()
+            response.read()
+            ok = response.status == 200
+        except Exception:
+            ok = False
+        conn.close()
+        with lock:
+            if ok:
+                latencies.append(time.perf_counter() - start)
+            else:
+                failures[0] += 1
+
+threads = [threading.Thread(target=client, args=(total // clients + (i < total % clients),))
+           for i in range(clients)]
+start = time.perf_counter()
+for t in threads:
+    t.start()
+for t in threads:
+    t.join()
+elapsed = time.perf_counter() - start
+
+latencies.sort()
+def pct(p):
+    return latencies[min(len(latencies) - 1, int(len(latencies) * p))] * 1000 if latencies else 0
+print("\n%-12s %10s %10s %10s %8s" % ("Requests/s", "p50 ms", "p99 ms", "max ms", "Failed"))
+print("%-12.1f %10.1f %10.1f %10.1f %8d" % (len(latencies) / elapsed, pct(0.50), pct(0.99), pct(1.0), failures[0]))
+PY
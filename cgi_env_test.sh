@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# Checks the environment a forked CGI script gets from request headers:
+# headers become HTTP_* variables, while Proxy (httpoxy) and the headers
+# already passed as CONTENT_* are left out whatever case the client used.
+# www/cgi-bin/test.py lists its environment as "<strong>NAME:</strong>".
+
+SERVER=${SERVER:-./webserv}
+PORT=${PORT:-8088}
+CONF=/tmp/webserv_cgi_env_test.conf
+
+cat > "$CONF" <<EOF2
+server {
+    port $PORT;
+    host 127.0.0.1;
+    server_name localhost;
+    root www;
+    index index.html;
+
+    location / {
+        root www;
+        allowed_methods GET;
+    }
+
+    location ^~ /cgi-bin {
+        root www/cgi-bin;
+        allowed_methods GET POST;
+        cgi_pass /usr/bin/python3;
+    }
+
+    cgi {
+        .py /usr/bin/python3;
+    }
+}
+EOF2
+
+"$SERVER" "$CONF" >/dev/null 2>&1 &
+WEBSERV=$!
+sleep 1
+
+fail=0
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "PASS: $1"
+    else
+        echo "FAIL: $1 (expected '$3', got '$2')"
+        fail=1
+    fi
+}
+
+URL=http://127.0.0.1:$PORT/cgi-bin/test.py
+has() { # Prints 1 if the script saw variable $1, 0 if not
+    grep -c "<strong>$1:</strong>"
+}
+check "X-Test -> HTTP_X_TEST" "$(curl -s -H 'X-Test: 1' "$URL" | has HTTP_X_TEST)" "1"
+check "Proxy dropped" "$(curl -s -H 'Proxy: http://evil' "$URL" | has HTTP_PROXY)" "0"
+check "lowercase proxy dropped" "$(curl -s -H 'proxy: http://evil' "$URL" | has HTTP_PROXY)" "0"
+check "lowercase content-type not HTTP_*" \
+    "$(curl -s -H 'content-type: text/plain' -d 'a=b' "$URL" | has HTTP_CONTENT_TYPE)" "0"
+check "lowercase content-length not HTTP_*" \
+    "$(curl -s -H 'content-length: 3' -d 'a=b' "$URL" | has HTTP_CONTENT_LENGTH)" "0"
+
+kill $WEBSERV 2>/dev/null
+rm -f "$CONF"
+exit $fail
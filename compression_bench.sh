@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Benchmarks zlib gzip levels on the text assets under www/ (what gzip_types
+# would typically cover) to pick gzip_comp_level. Uses Python's zlib binding,
+# i.e. the same library and deflate settings the server links against.
+
+ROOT=${1:-www}
+ROUNDS=${2:-5}
+
+if ! command -v python3 >/dev/null 2>&1; then
+    echo "Error: python3 is required for the benchmark"
+    exit 1
+fi
+
+echo "=== gzip compression level benchmark ==="
+echo "Assets: $ROOT (html, css, js, svg, txt, json), $ROUNDS rounds per level"
+
+python3 - "$ROOT" "$ROUNDS" <<'PY'
+import os, sys, time, zlib
+
+root, rounds = sys.argv[1], int(sys.argv[2])
+exts = ('.html', '.htm', '.css', '.js', '.svg', '.txt', '.json')
+blobs = []
+for dirpath, _, files in os.walk(root):
+    for name in files:
+        if name.endswith(exts):
+            with open(os.path.join(dirpath, name), 'rb') as f:
+                blobs.append(f.read())
+
+total = sum(len(b) for b in blobs)
+print("Files: %d, total %.1f KB\n" % (len(blobs), total / 1024.0))
+print("%-6s %12s %8s %12s" % ("Level", "Compressed", "Ratio", "Throughput"))
+for level in range(1, 10):
+    out = 0
+    start = time.perf_counter()
+    for _ in range(rounds):
+        out = 0
+        for b in blobs:
+            c = zlib.compressobj(level, zlib.DEFLATED, 31)  # 31 = gzip wrapper, 32K window
+            out += len(c.compress(b) + c.flush())
+    elapsed = (time.perf_counter() - start) / rounds
+    print("%-6d %10.1fKB %7.1f%% %9.1fMB/s" % (level, out / 1024.0, 100.0 * out / total,
+                                              total / elapsed / (1024 * 1024)))
+PY
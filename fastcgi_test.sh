@@ -0,0 +1,132 @@
+#!/bin/bash
+
+# Exercises fastcgi_pass against a small FastCGI echo responder (Python,
+# stdlib only) listening on a unix socket. The responder echoes the method,
+# SCRIPT_FILENAME and request body and keeps connections alive, so repeated
+# requests also go through the server's connection pool.
+
+SERVER=${SERVER:-./webserv}
+PORT=${PORT:-8089}
+SOCK=/tmp/webserv_fcgi_test.sock
+CONF=/tmp/webserv_fcgi_test.conf
+
+if ! command -v python3 >/dev/null 2>&1; then
+    echo "Error: python3 is required for the FastCGI echo backend"
+    exit 1
+fi
+
+cat > "$CONF" <<EOF
+server {
+    port $PORT;
+    host 127.0.0.1;
+    server_name localhost;
+    root www;
+    index index.html;
+
+    location / {
+        root www;
+        allowed_methods GET;
+    }
+
+    location /fcgi {
+        root www;
+        allowed_methods GET POST;
+        client_max_body_size 10M;
+        fastcgi_pass unix:$SOCK;
+    }
+}
+EOF
+
+rm -f "$SOCK"
+python3 - "$SOCK" <<'PY' &
+import os, socket, struct, sys, threading
+
+def records(conn):
+    buf = b''
+    while True:
+        while len(buf) < 8:
+            chunk = conn.recv(65536)
+            if not chunk:
+                return
+            buf += chunk
+        _, rtype, rid, clen, plen = struct.unpack('>BBHHBx', buf[:8])
+        while len(buf) < 8 + clen + plen:
+            chunk = conn.recv(65536)
+            if not chunk:
+                return
+            buf += chunk
+        yield rtype, rid, buf[8:8 + clen]
+        buf = buf[8 + clen + plen:]
+
+def params(data):
+    out, i = {}, 0
+    while i < len(data):
+        lens = []
+        for _ in range(2):
+            if data[i] < 128:
+                lens.append(data[i]); i += 1
+            else:
+                lens.append(struct.unpack('>I', data[i:i + 4])[0] & 0x7fffffff); i += 4
+        out[data[i:i + lens[0]].decode()] = data[i + lens[0]:i + lens[0] + lens[1]].decode()
+        i += lens[0] + lens[1]
+    return out
+
+def record(rtype, rid, content):
+    pad = (8 - len(content) % 8) % 8
+    return struct.pack('>BBHHBx', 1, rtype, rid, len(content), pad) + content + b'\0' * pad
+
+def serve(conn):
+    env, body, served = b'', b'', 0
+    for rtype, rid, content in records(conn):
+        if rtype == 4:
+            env += content
+        elif rtype == 5 and content:
+            body += content
+        elif rtype == 5:
+            p = params(env)
+            out = ("Content-Type: text/plain\r\n\r\n%s %s %d\n" % (
+                p.get('REQUEST_METHOD'), p.get('SCRIPT_FILENAME'), len(body))).encode() + body
+            for i in range(0, len(out), 60000):
+                conn.sendall(record(6, rid, out[i:i + 60000]))
+            conn.sendall(record(6, rid, b'') + record(3, rid, b'\0' * 8))
+            served += 1
+            env, body = b'', b''
+    conn.close()
+
+srv = socket.socket(socket.AF_UNIX)
+srv.bind(sys.argv[1])
+srv.listen(64)
+while True:
+    c, _ = srv.accept()
+    threading.Thread(target=serve, args=(c,), daemon=True).start()
+PY
+BACKEND=$!
+
+"$SERVER" "$CONF" >/dev/null 2>&1 &
+WEBSERV=$!
+sleep 1
+
+fail=0
+check() {
+    if [ "$2" = "$3" ]; then
+        echo "PASS: $1"
+    else
+        echo "FAIL: $1 (expected '$3', got '$2')"
+        fail=1
+    fi
+}
+
+URL=http://127.0.0.1:$PORT/fcgi/index.php
+check "GET" "$(curl -s "$URL" | head -1 | cut -d' ' -f1,3)" "GET 0"
+check "POST body" "$(curl -s -d 'hello=world' "$URL" | tail -c 11)" "hello=world"
+head -c 200000 /dev/urandom | base64 > /tmp/webserv_fcgi_body
+check "large POST" "$(curl -s --data-binary @/tmp/webserv_fcgi_body "$URL" | tail -n +2 | cmp - /tmp/webserv_fcgi_body && echo same)" "same"
+for i in $(seq 1 20); do curl -s "$URL" > /tmp/webserv_fcgi_out.$i & done
+wait $(jobs -p | grep -v -e "^$BACKEND$" -e "^$WEBSERV$")
+check "20 concurrent requests" "$(cat /tmp/webserv_fcgi_out.* | grep -c '^GET')" "20"
+rm -f /tmp/webserv_fcgi_out.*
+check "backend down -> 502" "$(kill $BACKEND; sleep 0.2; rm -f $SOCK; curl -s -o /dev/null -w '%{http_code}' "$URL")" "502"
+
+kill $WEBSERV 2>/dev/null
+rm -f "$CONF" "$SOCK" /tmp/webserv_fcgi_body
+exit $fail
@@ -66,12 +66,47 @@
 #define CGI_BUFSIZE 8192			// 8KB
 #define CGI_TIMEOUT 30				// 30s
 #define CGI_PIPE_BUFSIZE 1048576	// 1MB
+#define CGI_PIPE_POOL 4				// Ready pipes kept per direction
+#define CGI_SPOOL_POOL 16			// Truncated spool files kept for reuse
+#define CGI_HEADER_MAX 65536		// 64KB of CGI headers at most
+#define CGI_MAX_PROCESSES 64		// Forked CGI children running at once, process-wide
+#define CGI_QUEUE_SIZE 128			// Launches waiting for a slot, per location
+#define CGI_QUEUE_TIMEOUT 10		// 10s in the queue before a 503
+#define CGI_CACHE_VALID 10			// 10s TTL for cached CGI responses without max-age
+#define CGI_CACHE_MEMORY 16777216	// 16MB of cached CGI bodies kept in memory
+#define CGI_CACHE_DISK 268435456	// 256MB more on disk before entries are dropped
+#define CGI_CACHE_PATH "/tmp/webserv_cache"
+#define BODY_PUMP_BUFSIZE 65536		// 64KB of request body in flight to a CGI stdin
+#define CGI_WORKERS_MIN 1			// Preforked interpreters per cgi_worker location
+#define CGI_WORKERS_MAX 8			// Busy workers beyond this make requests queue
+#define CGI_WORKER_REQUESTS 1000	// Requests before a worker is replaced
+#define CGI_WORKER_IDLE 60			// 60s idle before a surplus worker is reaped
+#define FASTCGI_MAX_IDLE 8			// Pooled keep-alive connections per backend
+#define FASTCGI_STDIN_CHUNK 32768	// 32KB of request body per STDIN record
 #define RECV_SIZE 4096				// 4KB
 #define RESPONSE_SIZE 8192			// 8KB
 #define CHUNK_BUFFER_SIZE 655360	// 640KB
 #define CLIENT_MAX_BODY 1024 * 1024 // 1MB
 #define CLIENT_TIMEOUT 60			// 60s
 #define KEEP_ALIVE_TIMEOUT 60		// 60s
+#define GZIP_COMP_LEVEL 1			// zlib level for on-the-fly gzip
+#define GZIP_MIN_LENGTH 256			// Smaller bodies are sent as-is
+#define MMAP_MIN_SIZE 1048576		// 1MB, smaller files are read()
+#define MMAP_MAX_SIZE 67108864		// 64MB, larger files are read()
+#define MMAP_READAHEAD 2097152		// 2MB advised ahead of the send position
+#define ZERO_COPY_SLICE 262144		// 256KB per sendfile/writev call
+#define SPLICE_PIPE_BUFSIZE 1048576	// 1MB pipe splicing a request body into its file
+#define RESUMABLE_EXPIRE 86400		// 24h before an untouched resumable upload is dropped
+#define AIO_THREADS 4				// Threads running the file work of "aio" locations
+#define AIO_QUEUE_MAX 1024			// Queued file tasks before they run on the event loop
+#define AUTOINDEX_CACHE_SIZE 64		// Directory listings kept rendered
+#define AUTOINDEX_CACHE_MEMORY 33554432 // 32MB of them at most
+#define AUTOINDEX_PAGE_SIZE 100		// Entries per page when ?page= comes without ?page_size=
+#define AUTOINDEX_PAGE_MAX 10000	// Largest ?page_size=
+#define SESSION_STORE_MAX 65536		// Sessions kept before the least recently used is evicted
+#define SESSION_SHARED_PATH "/dev/shm/webserv_sessions" // "session_store shared" without a path
+#define REGEX_DFA_STATES 4096		// Regex location automaton states built at startup
+#define REGEX_MAX_REPEAT 255		// Largest {n,m} count in a location regex
 #define SERVER_LOG "logs/server.log"
 
 // Utils
@@ -11,6 +11,7 @@
 /* ************************************************************************** */
 
 #include "ConfigParser.hpp"
+#include "RegexSet.hpp"
 #include "../utils/Utils.hpp"
 #include <algorithm>
 #include <cstdlib>
@@ -152,7 +153,17 @@ void ConfigParser::parseLocation(LocationConfig &location) {
 	std::istringstream iss(line);
 	std::string		   token;
 	iss >> token; // Skip "location"
-	iss >> token; // Get path
+	iss >> token; // Get the modifier, if any, then the path
+	if (token == "=")
+		location.match = MATCH_EXACT;
+	else if (token == "^~")
+		location.match = MATCH_PREFIX_FINAL;
+	else if (token == "~")
+		location.match = MATCH_REGEX;
+	else if (token == "~*")
+		location.match = MATCH_REGEX_CASELESS;
+	if (location.match != MATCH_PREFIX)
+		iss >> token;
 	location.path = token;
 
 	while (hasMoreLines()) {
@@ -187,11 +198,99 @@ void ConfigParser::parseLocation(LocationConfig &location) {
 			location.autoindex = (value == "on");
 		else if (directive.first == "client_max_body_size")
 			location.client_max_body_size = parseSize(value);
+		else if (directive.first == "upload_max_file_size")
+			location.upload_max_file_size = parseSize(value);
+		else if (directive.first == "upload_resumable")
+			location.upload_resumable = (value == "on");
+		else if (directive.first == "upload_resumable_expire")
+			location.upload_resumable_expire = std::max(1L, atol(value.c_str()));
 		else if (directive.first == "allowed_methods") {
 			location.methods.clear();
 			parseAllowedMethods(value, location);
 		} else if (directive.first == "cgi_pass") {
 			location.cgi_path = value;
+		} else if (directive.first == "fastcgi_pass") {
+			size_t colon = value.rfind(':');
+			bool   isUnix = value.compare(0, 5, "unix:") == 0 && value.length() > 5;
+			bool   isInet = colon != std::string::npos && colon > 0 && atoi(value.c_str() + colon + 1) > 0;
+			if (isUnix || isInet)
+				location.fastcgi_pass = value;
+			else
+				addError("Invalid fastcgi_pass (expected unix:/path or host:port): " + value);
+		} else if (directive.first == "cgi_worker") {
+			location.cgi_worker = value;
+		} else if (directive.first == "cgi_workers") {
+			std::istringstream iss(value);
+			long			   minWorkers = -1, maxWorkers = -1;
+			iss >> minWorkers >> maxWorkers;
+			if (minWorkers < 0 || maxWorkers < 1 || minWorkers > maxWorkers) {
+				addError("Invalid cgi_workers (expected <min> <max>): " + value);
+			} else {
+				location.cgi_workers_min = minWorkers;
+				location.cgi_workers_max = maxWorkers;
+			}
+		} else if (directive.first == "cgi_worker_requests") {
+			location.cgi_worker_requests = std::max(1L, atol(value.c_str()));
+		} else if (directive.first == "cgi_worker_idle") {
+			location.cgi_worker_idle = atol(value.c_str());
+		} else if (directive.first == "cgi_max_processes") {
+			location.cgi_max_processes = atol(value.c_str());
+		} else if (directive.first == "cgi_queue") {
+			location.cgi_queue = atol(value.c_str());
+		} else if (directive.first == "cgi_queue_timeout") {
+			location.cgi_queue_timeout = std::max(1L, atol(value.c_str()));
+		} else if (directive.first == "cgi_status") {
+			location.cgi_status = (value == "on");
+		} else if (directive.first == "cgi_cache") {
+			location.cgi_cache = (value == "on");
+		} else if (directive.first == "cgi_cache_valid") {
+			location.cgi_cache_valid = atol(value.c_str());
+		} else if (directive.first == "cgi_cache_stale") {
+			location.cgi_cache_stale = atol(value.c_str());
+		} else if (directive.first == "cgi_cache_key_headers") {
+			std::istringstream iss(value);
+			std::string		   header;
+			location.cgi_cache_key_headers.clear();
+			while (iss >> header) location.cgi_cache_key_headers.push_back(header);
+		} else if (directive.first == "gzip") {
+			location.gzip = (value == "on");
+		} else if (directive.first == "gzip_static") {
+			location.gzip_static = (value == "on");
+		} else if (directive.first == "gzip_types") {
+			parseGzipTypes(value, location);
+		} else if (directive.first == "gzip_min_length") {
+			location.gzip_min_length = parseSize(value);
+		} else if (directive.first == "gzip_comp_level") {
+			location.gzip_comp_level = atoi(value.c_str());
+			if (location.gzip_comp_level < 1 || location.gzip_comp_level > 9) {
+				addError("Invalid gzip_comp_level (expected 1-9): " + value);
+				location.gzip_comp_level = GZIP_COMP_LEVEL;
+			}
+		} else if (directive.first == "file_io") {
+			if (value == "read")
+				location.file_io = FILE_IO_READ;
+			else if (value == "sendfile")
+				location.file_io = FILE_IO_SENDFILE;
+			else if (value == "mmap")
+				location.file_io = FILE_IO_MMAP;
+			else
+				addError("Invalid file_io (expected read, sendfile or mmap): " + value);
+		} else if (directive.first == "aio") {
+			if (value == "on" || value == "threads")
+				location.aio = true;
+			else if (value == "off")
+				location.aio = false;
+			else
+				addError("Invalid aio (expected on, threads or off): " + value);
+		} else if (directive.first == "autoindex_format") {
+			if (value == "html")
+				location.autoindex_format = AUTOINDEX_HTML;
+			else if (value == "json")
+				location.autoindex_format = AUTOINDEX_JSON;
+			else
+				addError("Invalid autoindex_format (expected html or json): " + value);
+		} else if (directive.first == "session") {
+			location.session = (value == "on");
 		} else if (directive.first == "return") {
 			std::istringstream iss(value);
 			std::string		   code, target;
@@ -254,6 +353,27 @@ void ConfigParser::parseDirective(const std::string &line, ServerConfig &server)
 		server.client_max_body_size = parseSize(directive.second);
 	else if (directive.first == "error_page")
 		parseErrorPage(directive.second, server);
+	else if (directive.first == "cgi_max_processes")
+		server.cgi_max_processes = atol(directive.second.c_str());
+	else if (directive.first == "cgi_cache_memory")
+		server.cgi_cache_memory = parseSize(directive.second);
+	else if (directive.first == "cgi_cache_path") {
+		std::istringstream iss(directive.second);
+		std::string		   size;
+		iss >> server.cgi_cache_path >> size;
+		if (!size.empty())
+			server.cgi_cache_disk = parseSize(size);
+	} else if (directive.first == "session_store") {
+		std::istringstream iss(directive.second);
+		std::string		   backend, path;
+		iss >> backend >> path;
+		if (backend == "memory" && path.empty())
+			server.session_store_path.clear();
+		else if (backend == "shared")
+			server.session_store_path = path.empty() ? SESSION_SHARED_PATH : path;
+		else
+			addError("Invalid session_store (expected memory, or shared and an optional path): " + directive.second);
+	}
 }
 
 std::pair<std::string, std::string> ConfigParser::splitDirective(const std::string &line) const {
@@ -365,6 +485,18 @@ bool ConfigParser::validateCGI(const ServerConfig &config) const {
 				return false;
 		}
 	}
+
+	// Worker pools run "cgi_pass cgi_worker", both must exist
+	for (std::vector<LocationConfig>::const_iterator it = config.locations.begin(); it != config.locations.end();
+		 ++it) {
+		if (it->cgi_worker.empty())
+			continue;
+		struct stat st;
+		if (stat(it->cgi_path.c_str(), &st) != 0 || !(st.st_mode & S_IXUSR))
+			return false;
+		if (stat(it->cgi_worker.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+			return false;
+	}
 	return true;
 }
 
@@ -373,9 +505,20 @@ bool ConfigParser::validateLocations(const ServerConfig &config) const {
 
 	for (std::vector<LocationConfig>::const_iterator it = config.locations.begin(); it != config.locations.end();
 		 ++it) {
-		if (std::find(paths.begin(), paths.end(), it->path) != paths.end())
+		// "/x" and "^~ /x" are the same prefix; "= /x" and "~ /x" are not
+		std::string key = it->match == MATCH_PREFIX_FINAL ? it->path : it->describe();
+		if (std::find(paths.begin(), paths.end(), key) != paths.end())
 			return false;
-		paths.push_back(it->path);
+		paths.push_back(key);
+
+		if (it->isRegex()) {
+			RegexSet	regex;
+			std::string error;
+			if (!regex.add(it->path, it->match == MATCH_REGEX_CASELESS, error)) {
+				std::cerr << "Invalid regex in location " << it->describe() << ": " << error << std::endl;
+				return false;
+			}
+		}
 
 		// Don't fail if methods are empty - they might be inherited from server config
 		// Just warn about it
@@ -427,7 +570,8 @@ void ConfigParser::parseAllowedMethods(const std::string &value, LocationConfig
 	while (iss >> method) {
 		if (method[method.length() - 1] == ';')
 			method = method.substr(0, method.length() - 1);
-		if (method == "GET" || method == "POST" || method == "DELETE" || method == "PUT" || method == "HEAD") {
+		if (method == "GET" || method == "POST" || method == "DELETE" || method == "PUT" || method == "HEAD" ||
+			method == "PATCH" || method == "OPTIONS") {
 			location.methods.push_back(method);
 		}
 	}
@@ -436,6 +580,19 @@ void ConfigParser::parseAllowedMethods(const std::string &value, LocationConfig
 		location.methods.push_back("GET");
 }
 
+void ConfigParser::parseGzipTypes(const std::string &value, LocationConfig &location) {
+	std::istringstream iss(value);
+	std::string		   type;
+
+	// text/html is always compressed, like nginx
+	location.gzip_types.clear();
+	location.gzip_types.push_back("text/html");
+	while (iss >> type) {
+		if (type != "text/html")
+			location.gzip_types.push_back(type);
+	}
+}
+
 unsigned long ConfigParser::parseSize(const std::string &value) {
 	std::string number;
 	std::string unit;
@@ -483,6 +640,15 @@ bool ConfigParser::validate() {
 			usedPorts[it->port] = serverName;
 		}
 
+		// One session store serves the whole process, so every block must name the same one
+		for (std::vector<ServerConfig>::const_iterator it = configs.begin(); it != configs.end(); ++it) {
+			if (it->session_store_path != configs.front().session_store_path) {
+				addError("session_store must be the same in every server block (sessions are process-wide)");
+				isValid = false;
+				break;
+			}
+		}
+
 		// Validate each config
 		for (std::vector<ServerConfig>::const_iterator it = configs.begin(); it != configs.end(); ++it) {
 			if (!validatePaths(*it)) {
@@ -54,6 +54,7 @@ class ConfigParser {
 		void parseServerNames(const std::string &value, ServerConfig &server);
 		void parseErrorPage(const std::string &value, ServerConfig &server);
 		void parseAllowedMethods(const std::string &value, LocationConfig &location);
+		void parseGzipTypes(const std::string &value, LocationConfig &location);
 		unsigned long parseSize(const std::string &value);
 
 		// Validation methods
@@ -0,0 +1,159 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   LocationRouter.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 18:02:37 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 18:02:37 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "LocationRouter.hpp"
+#include "ServerConfig.hpp"
+
+static const size_t NO_NODE = static_cast<size_t>(-1);
+
+LocationRouter::LocationRouter() {
+}
+
+void LocationRouter::build(const std::vector<LocationConfig> &locations) {
+	_regexes = RegexSet();
+	_regexLocations.clear();
+	_exact.clear();
+	_nodes.assign(1, Node());
+	_nodes[0].location = -1;
+	_nodes[0].isFinal = false;
+
+	size_t exactCount = 0;
+	for (size_t i = 0; i < locations.size(); ++i)
+		if (locations[i].match == MATCH_EXACT)
+			++exactCount;
+	size_t buckets = 1;
+	while (buckets < exactCount * 2)
+		buckets <<= 1;
+	_exact.resize(exactCount ? buckets : 0);
+
+	for (size_t i = 0; i < locations.size(); ++i) {
+		const LocationConfig &location = locations[i];
+		std::string			  error;
+		if (location.match == MATCH_EXACT)
+			insertExact(location.path, i);
+		else if (!location.isRegex())
+			insertPrefix(location.path, i, location.match == MATCH_PREFIX_FINAL);
+		else if (_regexes.add(location.path, location.match == MATCH_REGEX_CASELESS, error))
+			_regexLocations.push_back(i);
+		// An invalid pattern was reported by ConfigParser::validateLocations
+	}
+	_regexes.compile();
+}
+
+int LocationRouter::match(const std::string &path) const {
+	int exact = findExact(path);
+	if (exact >= 0)
+		return exact;
+	bool isFinal;
+	int	 prefix = findPrefix(path, isFinal);
+	if (prefix >= 0 && isFinal)
+		return prefix;
+	int regex = _regexes.match(path);
+	return regex >= 0 ? _regexLocations[regex] : prefix;
+}
+
+int LocationRouter::findPrefix(const std::string &path, bool &isFinal) const {
+	isFinal = false;
+	if (_nodes.empty())
+		return -1;
+	size_t best = 0;
+	size_t node = 0;
+	size_t pos = 0;
+	while (pos < path.length()) {
+		size_t child = findChild(node, path[pos]);
+		if (child == NO_NODE)
+			break;
+		const std::string &label = _nodes[child].label;
+		if (path.compare(pos, label.length(), label) != 0)
+			break;
+		pos += label.length();
+		node = child;
+		if (_nodes[node].location >= 0)
+			best = node;
+	}
+	isFinal = _nodes[best].isFinal;
+	return _nodes[best].location;
+}
+
+// FNV-1a
+size_t LocationRouter::hash(const std::string &key) {
+	size_t value = 2166136261u;
+	for (size_t i = 0; i < key.length(); ++i) {
+		value ^= static_cast<unsigned char>(key[i]);
+		value *= 16777619u;
+	}
+	return value;
+}
+
+int LocationRouter::findExact(const std::string &path) const {
+	if (_exact.empty())
+		return -1;
+	const std::vector<std::pair<std::string, int> > &bucket = _exact[hash(path) & (_exact.size() - 1)];
+	for (std::vector<std::pair<std::string, int> >::const_iterator it = bucket.begin(); it != bucket.end(); ++it) {
+		if (it->first == path)
+			return it->second;
+	}
+	return -1;
+}
+
+void LocationRouter::insertExact(const std::string &path, int location) {
+	if (findExact(path) >= 0)
+		return; // The first of duplicate locations wins
+	_exact[hash(path) & (_exact.size() - 1)].push_back(std::make_pair(path, location));
+}
+
+void LocationRouter::insertPrefix(const std::string &path, int location, bool isFinal) {
+	size_t node = 0;
+	size_t pos = 0;
+	while (pos < path.length()) {
+		size_t child = findChild(node, path[pos]);
+		if (child == NO_NODE) {
+			Node leaf;
+			leaf.label = path.substr(pos);
+			leaf.location = location;
+			leaf.isFinal = isFinal;
+			_nodes.push_back(leaf);
+			_nodes[node].children.push_back(_nodes.size() - 1);
+			return;
+		}
+		const std::string &label = _nodes[child].label;
+		size_t			   common = 1;
+		while (common < label.length() && pos + common < path.length() && label[common] == path[pos + common])
+			++common;
+		if (common < label.length()) { // Split the edge where the paths part
+			Node tail;
+			tail.label = label.substr(common);
+			tail.location = _nodes[child].location;
+			tail.isFinal = _nodes[child].isFinal;
+			tail.children.swap(_nodes[child].children);
+			_nodes[child].label.erase(common);
+			_nodes[child].location = -1;
+			_nodes.push_back(tail);
+			_nodes[child].children.push_back(_nodes.size() - 1);
+		}
+		node = child;
+		pos += common;
+	}
+	if (_nodes[node].location < 0) {
+		_nodes[node].location = location;
+		_nodes[node].isFinal = isFinal;
+	}
+}
+
+size_t LocationRouter::findChild(size_t node, unsigned char byte) const {
+	const std::vector<size_t> &children = _nodes[node].children;
+	for (std::vector<size_t>::const_iterator it = children.begin(); it != children.end(); ++it) {
+		if (static_cast<unsigned char>(_nodes[*it].label[0]) == byte)
+			return *it;
+	}
+	return NO_NODE;
+}
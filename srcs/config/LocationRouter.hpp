@@ -0,0 +1,57 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   LocationRouter.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 18:02:37 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 18:02:37 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LOCATION_ROUTER_HPP
+#define LOCATION_ROUTER_HPP
+
+#include "../WebServ.hpp"
+#include "RegexSet.hpp"
+
+struct LocationConfig;
+
+// Location lookup compiled once per server at config load. Matches are
+// indexes into the server's locations, so copies of the config stay valid.
+// The order is nginx's: an "=" location, else the longest prefix if it is
+// "^~", else the first matching regex in config order, else the longest
+// prefix. "=" paths sit in a hash table, prefixes in a byte-wise radix trie
+// and every regex in one RegexSet automaton, so a lookup costs O(path
+// length) however many locations the server has.
+class LocationRouter {
+	public:
+		LocationRouter();
+
+		void build(const std::vector<LocationConfig> &locations);
+		// Location serving path, -1 if none
+		int match(const std::string &path) const;
+
+	private:
+		struct Node {
+			std::string label;			// Edge bytes from the parent
+			int location;				// Location ending here, -1 if none
+			bool isFinal;				// It is "^~"
+			std::vector<size_t> children;
+		};
+
+		RegexSet _regexes;
+		std::vector<int> _regexLocations;	// Location of each regex
+		std::vector<std::vector<std::pair<std::string, int> > > _exact;	// Buckets, power of two
+		std::vector<Node> _nodes;		// _nodes[0] is the root
+
+		static size_t hash(const std::string &key);
+		int findExact(const std::string &path) const;
+		void insertExact(const std::string &path, int location);
+		void insertPrefix(const std::string &path, int location, bool isFinal);
+		int findPrefix(const std::string &path, bool &isFinal) const;
+		size_t findChild(size_t node, unsigned char byte) const;
+};
+
+#endif
@@ -0,0 +1,661 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RegexSet.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 19:24:08 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 19:24:08 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "RegexSet.hpp"
+
+static const int	NO_MATCH = INT_MAX;
+static const size_t MAX_PATTERN_STATES = 65536; // Bounds nested {n,m} expansion
+
+// Parse tree of one pattern
+struct RegexNode {
+	enum Kind { NODE_SET, NODE_CONCAT, NODE_ALTERNATE, NODE_REPEAT, NODE_BOL, NODE_EOL };
+
+	Kind kind;
+	std::bitset<256> set;
+	std::vector<int> children;
+	int min;
+	int max; // -1: unbounded
+};
+
+// Parses one pattern and appends its Thompson NFA to a RegexSet
+class RegexCompiler {
+	public:
+		RegexCompiler(RegexSet &set, const std::string &pattern, bool isCaseless) :
+				_set(set), _pattern(pattern), _isCaseless(isCaseless), _pos(0) {}
+
+		bool compile(std::string &error);
+
+	private:
+		// Entry state and the dangling exits (state, 0 for out / 1 for out1)
+		struct Fragment {
+			int start;
+			std::vector<std::pair<int, int> > outs;
+		};
+
+		RegexSet		  &_set;
+		const std::string &_pattern;
+		bool			   _isCaseless;
+		size_t			   _pos;
+		std::string		   _error;
+		std::vector<RegexNode> _nodes;
+
+		int parseAlternation();
+		int parseConcatenation();
+		int parseRepetition();
+		int parseAtom();
+		bool parseCount(int &min, int &max);
+		bool parseClass(std::bitset<256> &set);
+		bool parseEscape(std::bitset<256> &set);
+		bool parseClassByte(unsigned char &byte);
+		int addNode(RegexNode::Kind kind);
+		int addSet(const std::bitset<256> &set);
+		static void foldCase(std::bitset<256> &set);
+		int fail(const std::string &error);
+
+		Fragment build(int node);
+		Fragment buildNode(int node);
+		void patch(const std::vector<std::pair<int, int> > &outs, int target);
+		void append(Fragment &sequence, const Fragment &next);
+};
+
+bool RegexCompiler::compile(std::string &error) {
+	int root = parseAlternation();
+	if (root >= 0 && _pos < _pattern.length())
+		root = fail("unmatched )");
+	if (root < 0) {
+		error = _error;
+		return false;
+	}
+	size_t	 mark = _set._states.size();
+	Fragment fragment = build(root);
+	if (!_error.empty()) {
+		_set._states.resize(mark);
+		error = _error;
+		return false;
+	}
+	patch(fragment.outs, _set.addState(RegexSet::STATE_MATCH, _set._starts.size()));
+	_set._starts.push_back(fragment.start);
+	return true;
+}
+
+int RegexCompiler::parseAlternation() {
+	int first = parseConcatenation();
+	if (first < 0 || _pos >= _pattern.length() || _pattern[_pos] != '|')
+		return first;
+	int node = addNode(RegexNode::NODE_ALTERNATE);
+	_nodes[node].children.push_back(first);
+	while (_pos < _pattern.length() && _pattern[_pos] == '|') {
+		++_pos;
+		int next = parseConcatenation();
+		if (next < 0)
+			return -1;
+		_nodes[node].children.push_back(next);
+	}
+	return node;
+}
+
+int RegexCompiler::parseConcatenation() {
+	int node = addNode(RegexNode::NODE_CONCAT);
+	while (_pos < _pattern.length() && _pattern[_pos] != '|' && _pattern[_pos] != ')') {
+		int item = parseRepetition();
+		if (item < 0)
+			return -1;
+		_nodes[node].children.push_back(item);
+	}
+	return node;
+}
+
+int RegexCompiler::parseRepetition() {
+	int atom = parseAtom();
+	while (atom >= 0 && _pos < _pattern.length()) {
+		int	 min, max;
+		char c = _pattern[_pos];
+		if (c == '*' || c == '+' || c == '?') {
+			min = (c == '+');
+			max = (c == '?') ? 1 : -1;
+			++_pos;
+		} else if (c == '{' && _pos + 1 < _pattern.length() && isdigit(_pattern[_pos + 1])) {
+			if (!parseCount(min, max))
+				return -1;
+		} else
+			break;
+		if (_pos < _pattern.length() && _pattern[_pos] == '?')
+			++_pos; // Lazy: matches the same URIs
+
+		int node = addNode(RegexNode::NODE_REPEAT);
+		_nodes[node].children.push_back(atom);
+		_nodes[node].min = min;
+		_nodes[node].max = max;
+		atom = node;
+	}
+	return atom;
+}
+
+int RegexCompiler::parseAtom() {
+	char			 c = _pattern[_pos++];
+	std::bitset<256> set;
+
+	switch (c) {
+		case '(': {
+			if (_pos < _pattern.length() && _pattern[_pos] == '?') {
+				if (_pattern.compare(_pos, 2, "?:") != 0)
+					return fail("only (?: ) groups are supported");
+				_pos += 2;
+			}
+			int inner = parseAlternation();
+			if (inner < 0)
+				return -1;
+			if (_pos >= _pattern.length() || _pattern[_pos] != ')')
+				return fail("missing )");
+			++_pos;
+			return inner;
+		}
+		case '[':
+			if (!parseClass(set))
+				return -1;
+			return addSet(set);
+		case '.':
+			set.set();
+			set.reset('\n');
+			return addSet(set);
+		case '^':
+			return addNode(RegexNode::NODE_BOL);
+		case '$':
+			return addNode(RegexNode::NODE_EOL);
+		case '\\':
+			if (!parseEscape(set))
+				return -1;
+			return addSet(set);
+		case '*':
+		case '+':
+		case '?':
+			return fail(std::string("nothing to repeat before ") + c);
+		default:
+			set.set(static_cast<unsigned char>(c));
+			return addSet(set);
+	}
+}
+
+bool RegexCompiler::parseCount(int &min, int &max) {
+	++_pos; // '{'
+	min = 0;
+	while (_pos < _pattern.length() && isdigit(_pattern[_pos]))
+		min = std::min(min * 10 + (_pattern[_pos++] - '0'), REGEX_MAX_REPEAT + 1);
+	max = min;
+	if (_pos < _pattern.length() && _pattern[_pos] == ',') {
+		++_pos;
+		max = -1;
+		if (_pos < _pattern.length() && isdigit(_pattern[_pos])) {
+			max = 0;
+			while (_pos < _pattern.length() && isdigit(_pattern[_pos]))
+				max = std::min(max * 10 + (_pattern[_pos++] - '0'), REGEX_MAX_REPEAT + 1);
+		}
+	}
+	if (_pos >= _pattern.length() || _pattern[_pos] != '}') {
+		fail("malformed {n,m}");
+		return false;
+	}
+	++_pos;
+	if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT) {
+		fail("repeat count above " + Utils::numToString(REGEX_MAX_REPEAT));
+		return false;
+	}
+	if (max >= 0 && max < min) {
+		fail("{n,m} with m < n");
+		return false;
+	}
+	return true;
+}
+
+bool RegexCompiler::parseClass(std::bitset<256> &set) {
+	bool isNegated = _pos < _pattern.length() && _pattern[_pos] == '^';
+	if (isNegated)
+		++_pos;
+
+	for (bool isFirst = true;; isFirst = false) {
+		if (_pos >= _pattern.length()) {
+			fail("missing ]");
+			return false;
+		}
+		if (_pattern[_pos] == ']' && !isFirst) {
+			++_pos;
+			break;
+		}
+		if (_pattern[_pos] == '\\' && _pos + 1 < _pattern.length() && _pattern[_pos + 1] &&
+			strchr("dDwWsS", _pattern[_pos + 1])) {
+			++_pos;
+			std::bitset<256> shorthand;
+			if (!parseEscape(shorthand))
+				return false;
+			set |= shorthand;
+			continue;
+		}
+		unsigned char low, high;
+		if (!parseClassByte(low))
+			return false;
+		high = low;
+		if (_pos + 1 < _pattern.length() && _pattern[_pos] == '-' && _pattern[_pos + 1] != ']') {
+			++_pos;
+			if (!parseClassByte(high))
+				return false;
+			if (high < low) {
+				fail("range out of order in []");
+				return false;
+			}
+		}
+		for (unsigned int byte = low; byte <= high; ++byte)
+			set.set(byte);
+	}
+	if (_isCaseless)
+		foldCase(set); // Before negating, so [^a] excludes "A" too
+	if (isNegated)
+		set.flip();
+	return true;
+}
+
+bool RegexCompiler::parseClassByte(unsigned char &byte) {
+	if (_pattern[_pos] != '\\') {
+		byte = _pattern[_pos++];
+		return true;
+	}
+	++_pos;
+	std::bitset<256> escaped;
+	if (!parseEscape(escaped))
+		return false;
+	for (unsigned int i = 0; i < 256; ++i) {
+		if (escaped.test(i)) {
+			byte = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool RegexCompiler::parseEscape(std::bitset<256> &set) {
+	if (_pos >= _pattern.length()) {
+		fail("trailing \\");
+		return false;
+	}
+	char c = _pattern[_pos++];
+
+	switch (c) {
+		case 'd':
+		case 'D':
+			for (int i = '0'; i <= '9'; ++i)
+				set.set(i);
+			break;
+		case 'w':
+		case 'W':
+			for (int i = 0; i < 256; ++i)
+				if (isalnum(i) || i == '_')
+					set.set(i);
+			break;
+		case 's':
+		case 'S':
+			for (const char *space = " \t\n\r\f\v"; *space; ++space)
+				set.set(static_cast<unsigned char>(*space));
+			break;
+		case 't':
+			set.set('\t');
+			return true;
+		case 'n':
+			set.set('\n');
+			return true;
+		case 'r':
+			set.set('\r');
+			return true;
+		case 'f':
+			set.set('\f');
+			return true;
+		case 'v':
+			set.set('\v');
+			return true;
+		case 'x':
+			if (_pos + 2 > _pattern.length() || !isxdigit(_pattern[_pos]) || !isxdigit(_pattern[_pos + 1])) {
+				fail("\\x needs two hex digits");
+				return false;
+			}
+			set.set(strtol(_pattern.substr(_pos, 2).c_str(), NULL, 16));
+			_pos += 2;
+			return true;
+		default:
+			if (isdigit(c)) {
+				fail("backreferences are not supported");
+				return false;
+			}
+			if (isalpha(c)) {
+				fail(std::string("unsupported escape \\") + c);
+				return false;
+			}
+			set.set(static_cast<unsigned char>(c)); // Escaped punctuation
+			return true;
+	}
+	if (isupper(c))
+		set.flip();
+	return true;
+}
+
+int RegexCompiler::addNode(RegexNode::Kind kind) {
+	RegexNode node;
+	node.kind = kind;
+	node.min = 0;
+	node.max = 0;
+	_nodes.push_back(node);
+	return _nodes.size() - 1;
+}
+
+int RegexCompiler::addSet(const std::bitset<256> &set) {
+	int node = addNode(RegexNode::NODE_SET);
+	_nodes[node].set = set;
+	if (_isCaseless)
+		foldCase(_nodes[node].set);
+	return node;
+}
+
+void RegexCompiler::foldCase(std::bitset<256> &set) {
+	for (int c = 'a'; c <= 'z'; ++c) {
+		if (set.test(c) || set.test(c - 'a' + 'A')) {
+			set.set(c);
+			set.set(c - 'a' + 'A');
+		}
+	}
+}
+
+// Records the first error; -1 for the node parsers, false for the others
+int RegexCompiler::fail(const std::string &error) {
+	if (_error.empty())
+		_error = error + " at offset " + Utils::numToString(static_cast<long>(_pos));
+	return -1;
+}
+
+RegexCompiler::Fragment RegexCompiler::build(int node) {
+	Fragment fragment = buildNode(node);
+	if (fragment.start < 0) { // Matches the empty string: one epsilon state to hang on
+		fragment.start = _set.addState(RegexSet::STATE_SPLIT);
+		fragment.outs.assign(1, std::make_pair(fragment.start, 0));
+	}
+	return fragment;
+}
+
+RegexCompiler::Fragment RegexCompiler::buildNode(int index) {
+	const RegexNode &node = _nodes[index];
+	Fragment		 result;
+	result.start = -1;
+
+	if (_set._states.size() > MAX_PATTERN_STATES) {
+		fail("pattern too large");
+		return result;
+	}
+	switch (node.kind) {
+		case RegexNode::NODE_SET:
+			result.start = _set.addState(RegexSet::STATE_CHAR);
+			_set._states[result.start].set = node.set;
+			result.outs.push_back(std::make_pair(result.start, 0));
+			break;
+		case RegexNode::NODE_BOL:
+		case RegexNode::NODE_EOL:
+			result.start =
+				_set.addState(node.kind == RegexNode::NODE_BOL ? RegexSet::STATE_BOL : RegexSet::STATE_EOL);
+			result.outs.push_back(std::make_pair(result.start, 0));
+			break;
+		case RegexNode::NODE_CONCAT:
+			for (size_t i = 0; i < node.children.size(); ++i)
+				append(result, buildNode(node.children[i]));
+			break;
+		case RegexNode::NODE_ALTERNATE: {
+			int split = -1;
+			for (size_t i = 0; i < node.children.size(); ++i) {
+				Fragment branch = build(node.children[i]);
+				int		 entry = branch.start;
+				if (i + 1 < node.children.size())
+					entry = _set.addState(RegexSet::STATE_SPLIT, branch.start);
+				if (split < 0)
+					result.start = entry;
+				else
+					_set._states[split].out1 = entry;
+				split = entry;
+				result.outs.insert(result.outs.end(), branch.outs.begin(), branch.outs.end());
+			}
+			break;
+		}
+		case RegexNode::NODE_REPEAT: {
+			for (int i = 0; i < node.min; ++i)
+				append(result, build(node.children[0]));
+			if (node.max < 0) {
+				Fragment body = build(node.children[0]);
+				Fragment loop;
+				loop.start = _set.addState(RegexSet::STATE_SPLIT, body.start);
+				patch(body.outs, loop.start);
+				loop.outs.push_back(std::make_pair(loop.start, 1));
+				append(result, loop);
+			}
+			for (int i = node.min; i < node.max; ++i) {
+				Fragment body = build(node.children[0]);
+				Fragment optional;
+				optional.start = _set.addState(RegexSet::STATE_SPLIT, body.start);
+				optional.outs = body.outs;
+				optional.outs.push_back(std::make_pair(optional.start, 1));
+				append(result, optional);
+			}
+			break;
+		}
+	}
+	return result;
+}
+
+void RegexCompiler::patch(const std::vector<std::pair<int, int> > &outs, int target) {
+	for (std::vector<std::pair<int, int> >::const_iterator it = outs.begin(); it != outs.end(); ++it) {
+		if (it->second == 0)
+			_set._states[it->first].out = target;
+		else
+			_set._states[it->first].out1 = target;
+	}
+}
+
+void RegexCompiler::append(Fragment &sequence, const Fragment &next) {
+	if (next.start < 0)
+		return;
+	if (sequence.start < 0) {
+		sequence = next;
+		return;
+	}
+	patch(sequence.outs, next.start);
+	sequence.outs = next.outs;
+}
+
+RegexSet::RegexSet() : _generation(0) {
+	memset(_byteClass, 0, sizeof(_byteClass));
+}
+
+bool RegexSet::add(const std::string &pattern, bool isCaseless, std::string &error) {
+	RegexCompiler compiler(*this, pattern, isCaseless);
+	return compiler.compile(error);
+}
+
+void RegexSet::compile() {
+	_dfa.clear();
+	if (_starts.empty())
+		return;
+	_seen.assign(_states.size(), 0);
+	_generation = 0;
+	computeByteClasses();
+	closure(_starts, false, false, _restart);
+
+	DfaState start;
+	closure(_starts, true, false, start.nfa);
+	start.matchNow = firstMatch(start.nfa);
+	start.matchAtEnd = matchAtEnd(start.nfa, true);
+	start.next.assign(_classByte.size(), -1);
+	_dfa.push_back(start);
+
+	// Breadth first, so the states left to the NFA are the ones deepest into a URI
+	std::map<std::vector<int>, int> known;
+	for (size_t i = 0; i < _dfa.size(); ++i) {
+		for (size_t c = 0; c < _classByte.size(); ++c) {
+			std::vector<int> next;
+			step(_dfa[i].nfa, _classByte[c], next);
+			std::map<std::vector<int>, int>::iterator found = known.find(next);
+			if (found != known.end()) {
+				_dfa[i].next[c] = found->second;
+				continue;
+			}
+			if (_dfa.size() >= REGEX_DFA_STATES)
+				continue;
+			DfaState state;
+			state.matchNow = firstMatch(next);
+			state.matchAtEnd = matchAtEnd(next, false);
+			state.next.assign(_classByte.size(), -1);
+			state.nfa.swap(next);
+			known[state.nfa] = _dfa.size();
+			_dfa[i].next[c] = _dfa.size();
+			_dfa.push_back(state);
+		}
+	}
+}
+
+int RegexSet::match(const std::string &subject) const {
+	if (_dfa.empty())
+		return -1;
+	const DfaState *state = &_dfa[0];
+	int				best = state->matchNow;
+
+	for (size_t i = 0; i < subject.length() && best != 0; ++i) {
+		int next = state->next[_byteClass[static_cast<unsigned char>(subject[i])]];
+		if (next < 0) {
+			best = matchSlowly(state->nfa, subject, i, best);
+			return best == NO_MATCH ? -1 : best;
+		}
+		state = &_dfa[next];
+		best = std::min(best, state->matchNow);
+	}
+	best = std::min(best, state->matchAtEnd);
+	return best == NO_MATCH ? -1 : best;
+}
+
+int RegexSet::addState(StateType type, int out, int out1) {
+	State state;
+	state.type = type;
+	state.out = out;
+	state.out1 = out1;
+	_states.push_back(state);
+	return _states.size() - 1;
+}
+
+// Bytes no pattern tells apart share a class, so DFA rows stay short
+void RegexSet::computeByteClasses() {
+	std::vector<int> classOf(256, 0);
+	int				 count = 1;
+	for (std::vector<State>::const_iterator it = _states.begin(); it != _states.end(); ++it) {
+		if (it->type != STATE_CHAR)
+			continue;
+		std::vector<int> renumber(count * 2, -1);
+		int				 refined = 0;
+		for (int byte = 0; byte < 256; ++byte) {
+			int &target = renumber[classOf[byte] * 2 + it->set.test(byte)];
+			if (target < 0)
+				target = refined++;
+			classOf[byte] = target;
+		}
+		count = refined;
+	}
+	_classByte.assign(count, 0);
+	for (int byte = 255; byte >= 0; --byte) {
+		_byteClass[byte] = classOf[byte];
+		_classByte[classOf[byte]] = byte;
+	}
+}
+
+void RegexSet::closure(const std::vector<int> &seeds, bool atStart, bool atEnd, std::vector<int> &result) const {
+	result.clear();
+	if (++_generation == 0) { // Wrapped: old marks could pass for current ones
+		std::fill(_seen.begin(), _seen.end(), 0);
+		_generation = 1;
+	}
+	std::vector<int> pending(seeds);
+	while (!pending.empty()) {
+		int state = pending.back();
+		pending.pop_back();
+		if (state < 0 || _seen[state] == _generation)
+			continue;
+		_seen[state] = _generation;
+
+		const State &current = _states[state];
+		switch (current.type) {
+			case STATE_CHAR:
+			case STATE_MATCH:
+				result.push_back(state);
+				break;
+			case STATE_SPLIT:
+				pending.push_back(current.out);
+				pending.push_back(current.out1);
+				break;
+			case STATE_BOL:
+				if (atStart)
+					pending.push_back(current.out);
+				break;
+			case STATE_EOL:
+				if (atEnd)
+					pending.push_back(current.out);
+				else
+					result.push_back(state);
+				break;
+		}
+	}
+	std::sort(result.begin(), result.end());
+}
+
+void RegexSet::step(const std::vector<int> &current, unsigned char byte, std::vector<int> &next) const {
+	std::vector<int> moved;
+	for (std::vector<int>::const_iterator it = current.begin(); it != current.end(); ++it) {
+		if (_states[*it].type == STATE_CHAR && _states[*it].set.test(byte))
+			moved.push_back(_states[*it].out);
+	}
+	std::vector<int> reached;
+	closure(moved, false, false, reached);
+	// Every pattern may also begin at the next byte
+	next.clear();
+	std::set_union(reached.begin(), reached.end(), _restart.begin(), _restart.end(), std::back_inserter(next));
+}
+
+int RegexSet::firstMatch(const std::vector<int> &set) const {
+	int first = NO_MATCH;
+	for (std::vector<int>::const_iterator it = set.begin(); it != set.end(); ++it) {
+		if (_states[*it].type == STATE_MATCH)
+			first = std::min(first, _states[*it].out);
+	}
+	return first;
+}
+
+int RegexSet::matchAtEnd(const std::vector<int> &set, bool atStart) const {
+	std::vector<int> seeds;
+	for (std::vector<int>::const_iterator it = set.begin(); it != set.end(); ++it) {
+		if (_states[*it].type == STATE_EOL)
+			seeds.push_back(_states[*it].out);
+	}
+	int first = firstMatch(set);
+	if (seeds.empty())
+		return first;
+	std::vector<int> reached;
+	closure(seeds, atStart, true, reached);
+	return std::min(first, firstMatch(reached));
+}
+
+// The rest of a URI that left the prebuilt states, one NFA step per byte
+int RegexSet::matchSlowly(std::vector<int> current, const std::string &subject, size_t pos, int best) const {
+	std::vector<int> next;
+	for (; pos < subject.length() && best != 0; ++pos) {
+		step(current, subject[pos], next);
+		current.swap(next);
+		best = std::min(best, firstMatch(current));
+	}
+	return std::min(best, matchAtEnd(current, false));
+}
@@ -0,0 +1,81 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   RegexSet.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 19:24:08 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 19:24:08 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef REGEX_SET_HPP
+#define REGEX_SET_HPP
+
+#include "../WebServ.hpp"
+#include <bitset>
+
+// The regex locations of a server compiled into one automaton, so a single
+// pass over the URI tells which pattern matches first (in the order added).
+// Patterns are a PCRE subset: literals, ".", classes, \d \w \s, groups,
+// "|", "* + ? {n,m}", "^" and "$". Backreferences and lookaround are
+// rejected. Each pattern becomes a Thompson NFA; compile() joins them and
+// builds the DFA over byte classes ahead of time. Should a URI lead past the
+// REGEX_DFA_STATES states built, the rest of it is run on the NFA.
+class RegexSet {
+	public:
+		RegexSet();
+
+		// False on a syntax error, described in error
+		bool add(const std::string &pattern, bool isCaseless, std::string &error);
+		// Builds the automaton once every pattern is added
+		void compile();
+		// Index of the first pattern matching subject, -1 if none
+		int match(const std::string &subject) const;
+		size_t size() const { return _starts.size(); }
+
+	private:
+		enum StateType {
+			STATE_CHAR,		// Consumes a byte in set
+			STATE_SPLIT,	// Epsilon to out and, when set, out1
+			STATE_BOL,		// "^": passable at the start only
+			STATE_EOL,		// "$": passable at the end only
+			STATE_MATCH		// out is the pattern index
+		};
+
+		struct State {
+			StateType type;
+			std::bitset<256> set;
+			int out;
+			int out1;
+		};
+
+		struct DfaState {
+			std::vector<int> nfa;	// Sorted CHAR, EOL and MATCH states
+			std::vector<int> next;	// Per byte class, -1 where not built
+			int matchNow;			// First pattern matched by now
+			int matchAtEnd;			// Same, should the subject end here
+		};
+
+		std::vector<State> _states;
+		std::vector<int> _starts;		// Per pattern
+		std::vector<int> _restart;		// Closure of every start past the first byte (unanchored search)
+		std::vector<DfaState> _dfa;		// _dfa[0] is the start, never shared
+		unsigned char _byteClass[256];
+		std::vector<unsigned char> _classByte;	// A member of each class
+		mutable std::vector<unsigned int> _seen;	// Closure marks, valid when == _generation
+		mutable unsigned int _generation;
+
+		friend class RegexCompiler;
+
+		int addState(StateType type, int out = -1, int out1 = -1);
+		void computeByteClasses();
+		void closure(const std::vector<int> &seeds, bool atStart, bool atEnd, std::vector<int> &result) const;
+		void step(const std::vector<int> &current, unsigned char byte, std::vector<int> &next) const;
+		int firstMatch(const std::vector<int> &set) const;
+		int matchAtEnd(const std::vector<int> &set, bool atStart) const;
+		int matchSlowly(std::vector<int> current, const std::string &subject, size_t pos, int best) const;
+};
+
+#endif
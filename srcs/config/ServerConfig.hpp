@@ -14,20 +14,88 @@
 #define SERVERCONFIG_HPP
 
 #include "../WebServ.hpp"
+#include "LocationRouter.hpp"
+
+// How static file bodies are moved to the socket
+enum FileIO {
+	FILE_IO_READ,		// read() into a buffer, then send()
+	FILE_IO_SENDFILE,	// sendfile() straight from the page cache (Linux)
+	FILE_IO_MMAP		// Shared mapping sent with writev, for mid-size files
+};
+
+// What an autoindex listing is rendered as
+enum AutoindexFormat {
+	AUTOINDEX_HTML,
+	AUTOINDEX_JSON		// {"path", "entries": [{"name", "type", "size", "mtime"}], "total"}
+};
+
+// How a location's path is compared with the request path, as in nginx
+enum LocationMatch {
+	MATCH_PREFIX,			// location /path
+	MATCH_EXACT,			// location = /path
+	MATCH_PREFIX_FINAL,		// location ^~ /path: as the longest prefix, regexes are not tried
+	MATCH_REGEX,			// location ~ pattern
+	MATCH_REGEX_CASELESS	// location ~* pattern
+};
 
 struct LocationConfig {
-	std::string path;					// URL path this location handles
+	std::string path;					// URL path this location handles, or its pattern
+	LocationMatch match;				// How path is compared
 	std::vector<std::string> methods;	// Allowed HTTP methods (GET, POST, etc.)
 	std::string root;					// Root directory for this location
 	std::string index;					// Default index file
 	bool autoindex;						// Directory listing enabled/disabled
 	std::vector<std::string> cgi_ext;	// CGI file extensions (.php, .py, etc)
 	std::string cgi_path;				// Path to CGI executable
+	std::string fastcgi_pass;			// FastCGI backend: unix:/path or host:port
+	std::string cgi_worker;				// Persistent wrapper run by cgi_pass, enables the worker pool
+	unsigned long cgi_workers_min;		// Workers kept alive even when idle
+	unsigned long cgi_workers_max;		// Upper bound; further requests queue
+	unsigned long cgi_worker_requests;	// Requests served before a worker is replaced
+	unsigned long cgi_worker_idle;		// Seconds before a surplus idle worker is reaped
+	unsigned long cgi_max_processes;	// Forked children running at once here, 0 for no own cap
+	unsigned long cgi_queue;			// Launches that may wait for a slot, more get a 503
+	unsigned long cgi_queue_timeout;	// Seconds a launch may wait before a 503
+	bool cgi_status;					// Serve the CGI scheduler counters here
+	size_t cgi_lane;					// CGIScheduler queue of this location, set at startup
+	bool cgi_cache;						// Cache GET responses of forked scripts
+	unsigned long cgi_cache_valid;		// Seconds a cached response stays fresh without max-age
+	unsigned long cgi_cache_stale;		// Seconds a stale response may be served while refreshed
+	std::vector<std::string> cgi_cache_key_headers; // Request headers the cache key includes
 	unsigned long client_max_body_size;	// Maximum request body size
+	unsigned long upload_max_file_size;	// Largest file in a multipart upload, 0 for no own cap
+	bool upload_resumable;				// tus-style resumable uploads here (ResumableUploads)
+	unsigned long upload_resumable_expire; // Seconds an untouched resumable upload is kept
 	std::string redirect;				// Store redirect target
+	bool gzip;							// On-the-fly gzip of matching responses
+	std::vector<std::string> gzip_types;// MIME types eligible for gzip
+	unsigned long gzip_min_length;		// Minimum body size worth compressing
+	int gzip_comp_level;				// zlib compression level (1-9)
+	bool gzip_static;					// Serve precompressed "file.gz" sidecars
+	FileIO file_io;						// Static file transfer strategy
+	bool aio;							// Blocking file work runs on the AIOPool threads
+	AutoindexFormat autoindex_format;
+	bool session;						// Requests without a session are given one
+	std::string cgi_env;				// Static CGI variables ("NAME=value\0..."), built at startup
 
 	LocationConfig()
-		: autoindex(false), client_max_body_size(CLIENT_MAX_BODY), redirect("") {}
+		: match(MATCH_PREFIX), autoindex(false), cgi_workers_min(CGI_WORKERS_MIN), cgi_workers_max(CGI_WORKERS_MAX),
+		  cgi_worker_requests(CGI_WORKER_REQUESTS), cgi_worker_idle(CGI_WORKER_IDLE), cgi_max_processes(0),
+		  cgi_queue(CGI_QUEUE_SIZE), cgi_queue_timeout(CGI_QUEUE_TIMEOUT), cgi_status(false), cgi_lane(0),
+		  cgi_cache(false), cgi_cache_valid(CGI_CACHE_VALID), cgi_cache_stale(0),
+		  client_max_body_size(CLIENT_MAX_BODY), upload_max_file_size(0), upload_resumable(false),
+		  upload_resumable_expire(RESUMABLE_EXPIRE), redirect(""), gzip(false),
+		  gzip_min_length(GZIP_MIN_LENGTH), gzip_comp_level(GZIP_COMP_LEVEL), gzip_static(false), file_io(FILE_IO_READ),
+		  aio(false), autoindex_format(AUTOINDEX_HTML), session(false) {
+		gzip_types.push_back("text/html");
+	}
+
+	bool isRegex() const { return match == MATCH_REGEX || match == MATCH_REGEX_CASELESS; }
+	// The location's arguments as written in the config ("~ \.php$")
+	std::string describe() const {
+		static const char *modifiers[] = {"", "= ", "^~ ", "~ ", "~* "};
+		return modifiers[match] + path;
+	}
 };
 
 // Main server configuration structure
@@ -42,12 +110,18 @@ struct ServerConfig {
 	std::string index;					// Default index file
 	unsigned int client_timeout;		// Client timeout in seconds
 	unsigned long client_max_body_size;	// Maximum request body size
+	unsigned long cgi_max_processes;	// Process-wide CGI children cap, 0 if unset
+	unsigned long cgi_cache_memory;		// Process-wide CGI cache budgets, 0 if unset
+	unsigned long cgi_cache_disk;
+	std::string cgi_cache_path;			// Directory of the disk tier
+	std::string session_store_path;		// File of the shared session store, "" for in-process sessions
 
 	// Error pages
 	std::map<int, std::string> error_pages; // Custom error pages mapping
 
 	// Locations configuration
 	std::vector<LocationConfig> locations;  // Location blocks
+	LocationRouter router;					// Compiled lookup over locations, built by precomputePaths
 
 	// CGI configuration
 	std::map<std::string, std::string> cgi_handlers; // Extension to handler mapping
@@ -57,7 +131,10 @@ struct ServerConfig {
 			host(DEFAULT_HOST),
 			port(DEFAULT_PORT),
 			client_timeout(CLIENT_TIMEOUT),
-			client_max_body_size(CLIENT_MAX_BODY) { // 1MB default
+			client_max_body_size(CLIENT_MAX_BODY), // 1MB default
+			cgi_max_processes(0),
+			cgi_cache_memory(0),
+			cgi_cache_disk(0) {
 		index = DEFAULT_INDEX;
 		error_pages[404] = "/404.html";
 		error_pages[500] = "/500.html";
@@ -72,8 +149,14 @@ struct ServerConfig {
 			index(other.index),
 			client_timeout(other.client_timeout),
 			client_max_body_size(other.client_max_body_size),
+			cgi_max_processes(other.cgi_max_processes),
+			cgi_cache_memory(other.cgi_cache_memory),
+			cgi_cache_disk(other.cgi_cache_disk),
+			cgi_cache_path(other.cgi_cache_path),
+			session_store_path(other.session_store_path),
 			error_pages(other.error_pages),
 			locations(other.locations),
+			router(other.router),
 			cgi_handlers(other.cgi_handlers) {
 		cgiExtCache.clear();
 	}
@@ -88,8 +171,14 @@ struct ServerConfig {
 			index = other.index;
 			client_timeout = other.client_timeout;
 			client_max_body_size = other.client_max_body_size;
+			cgi_max_processes = other.cgi_max_processes;
+			cgi_cache_memory = other.cgi_cache_memory;
+			cgi_cache_disk = other.cgi_cache_disk;
+			cgi_cache_path = other.cgi_cache_path;
+			session_store_path = other.session_store_path;
 			error_pages = other.error_pages;
 			locations = other.locations;
+			router = other.router;
 			cgi_handlers = other.cgi_handlers;
 			cgiExtCache.clear();
 		}
@@ -99,13 +188,30 @@ struct ServerConfig {
 	// Add cache for commonly accessed values
 	mutable std::map<std::string, bool> cgiExtCache;
 
-	// Pre-compute just CGI extensions
+	// Pre-compute CGI extensions, the location router and each location's static CGI environment
 	void precomputePaths() {
+		router.build(locations);
+
 		// Pre-compute CGI extensions
 		for (std::map<std::string, std::string>::const_iterator it = cgi_handlers.begin();
 			 it != cgi_handlers.end(); ++it) {
 			cgiExtCache[it->first] = true;
 		}
+
+		// Variables identical for every request, so a CGI launch only appends its own
+		std::string serverEnv = "GATEWAY_INTERFACE=CGI/1.1";
+		serverEnv += '\0';
+		serverEnv += "REDIRECT_STATUS=200";
+		serverEnv += '\0';
+		serverEnv += "SERVER_PORT=" + Utils::numToString(port);
+		serverEnv += '\0';
+		serverEnv += "SERVER_SOFTWARE=webserv/1.0";
+		serverEnv += '\0';
+		for (std::vector<LocationConfig>::iterator it = locations.begin(); it != locations.end(); ++it) {
+			it->cgi_env = serverEnv;
+			it->cgi_env += "DOCUMENT_ROOT=" + it->root;
+			it->cgi_env += '\0';
+		}
 	}
 };
 
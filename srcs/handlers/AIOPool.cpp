@@ -0,0 +1,138 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   AIOPool.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 16:40:18 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 16:40:18 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "AIOPool.hpp"
+#include "FileTask.hpp"
+
+AIOPool *AIOPool::_instance = NULL;
+
+AIOPool::AIOPool() : _isStopping(false), _running(0), _peakDepth(0), _completed(0), _overflows(0) {
+	pthread_mutex_init(&_lock, NULL);
+	pthread_cond_init(&_wake, NULL);
+}
+
+AIOPool &AIOPool::getInstance() {
+	if (!_instance)
+		_instance = new AIOPool();
+	return *_instance;
+}
+
+void AIOPool::configure(const ServerConfig &config) {
+	if (isRunning())
+		return;
+	bool isWanted = false;
+	for (size_t i = 0; i < config.locations.size(); ++i) isWanted = isWanted || config.locations[i].aio;
+	if (!isWanted)
+		return;
+
+	_isStopping = false;
+	// Workers take no signals: SIGCHLD and SIGPIPE stay with the event loop
+	sigset_t all, previous;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &previous);
+	for (int i = 0; i < AIO_THREADS; ++i) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, work, this) == 0)
+			_threads.push_back(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+bool AIOPool::submit(FileTask *task) {
+	if (!isRunning())
+		return false;
+	pthread_mutex_lock(&_lock);
+	bool isFull = _queue.size() >= AIO_QUEUE_MAX;
+	if (isFull) {
+		++_overflows;
+	} else {
+		task->retain(); // Released by collect(), whatever happens to the connection
+		task->_isAccepted = true;
+		_queue.push_back(task);
+		_peakDepth = std::max(_peakDepth, _queue.size());
+		pthread_cond_signal(&_wake);
+	}
+	pthread_mutex_unlock(&_lock);
+	return !isFull;
+}
+
+bool AIOPool::isFinished(const FileTask *task) const {
+	pthread_mutex_lock(&_lock);
+	bool isFinished = task->_isFinished;
+	pthread_mutex_unlock(&_lock);
+	return isFinished;
+}
+
+void AIOPool::collect() {
+	if (!isRunning())
+		return;
+	std::vector<FileTask *> finished;
+	pthread_mutex_lock(&_lock);
+	finished.swap(_finished);
+	pthread_mutex_unlock(&_lock);
+	for (size_t i = 0; i < finished.size(); ++i) finished[i]->release();
+}
+
+void AIOPool::stop() {
+	if (!isRunning())
+		return;
+	pthread_mutex_lock(&_lock);
+	_isStopping = true;
+	pthread_cond_broadcast(&_wake);
+	pthread_mutex_unlock(&_lock);
+	for (size_t i = 0; i < _threads.size(); ++i) pthread_join(_threads[i], NULL);
+	_threads.clear();
+	collect();
+	_isStopping = false;
+}
+
+std::string AIOPool::report() const {
+	std::ostringstream out;
+	pthread_mutex_lock(&_lock);
+	out << "aio_threads " << _threads.size() << "\n"
+		<< "aio_running " << _running << "\n"
+		<< "aio_queued " << _queue.size() << "/" << AIO_QUEUE_MAX << "\n"
+		<< "aio_queued_peak " << _peakDepth << "\n"
+		<< "aio_completed " << _completed << "\n"
+		<< "aio_inline " << _overflows << "\n";
+	pthread_mutex_unlock(&_lock);
+	return out.str();
+}
+
+void *AIOPool::work(void *pool) {
+	static_cast<AIOPool *>(pool)->runTasks();
+	return NULL;
+}
+
+void AIOPool::runTasks() {
+	pthread_mutex_lock(&_lock);
+	for (;;) {
+		while (_queue.empty() && !_isStopping) pthread_cond_wait(&_wake, &_lock);
+		if (_queue.empty())
+			break; // Stopping, and nothing left to run
+		FileTask *task = _queue.front();
+		_queue.pop_front();
+		++_running;
+		pthread_mutex_unlock(&_lock);
+
+		task->run();
+
+		pthread_mutex_lock(&_lock);
+		--_running;
+		++_completed;
+		// Signalled under the lock: collect() cannot free the task before
+		task->_isFinished = true;
+		task->signal();
+		_finished.push_back(task);
+	}
+	pthread_mutex_unlock(&_lock);
+}
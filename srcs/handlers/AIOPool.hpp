@@ -0,0 +1,68 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   AIOPool.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 16:40:18 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 16:40:18 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef AIO_POOL_HPP
+#define AIO_POOL_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include <deque>
+#include <pthread.h>
+
+class FileTask;
+
+// Fixed pool of AIO_THREADS threads running the FileTasks of "aio"
+// locations. The threads are started once the first such location is
+// configured. Everything else (submitting, collecting, counters) happens
+// on the event loop; the threads only take tasks off the queue, run() them
+// and hand them back, waking the loop through each task's eventfd.
+class AIOPool {
+	public:
+		static AIOPool &getInstance();
+
+		// Starts the threads if one of config's locations has aio on
+		void configure(const ServerConfig &config);
+		bool isRunning() const { return !_threads.empty(); }
+		// Queues task, holding a reference until it is collected; false when
+		// the queue is full, the caller then runs it inline
+		bool submit(FileTask *task);
+		bool isFinished(const FileTask *task) const;
+		// Lets go of the tasks the threads are done with
+		void collect();
+		// Runs what is queued, then joins the threads (reload, shutdown)
+		void stop();
+		// Queue depth and task counters, for monitoring
+		std::string report() const;
+
+	private:
+		static AIOPool *_instance;
+
+		std::vector<pthread_t> _threads;
+		mutable pthread_mutex_t _lock;
+		pthread_cond_t _wake;
+		std::deque<FileTask *> _queue;
+		std::vector<FileTask *> _finished;	// Run, not collected yet
+		bool _isStopping;
+		size_t _running;
+		size_t _peakDepth;
+		unsigned long _completed;
+		unsigned long _overflows;			// Ran inline: queue full
+
+		AIOPool();
+		static void *work(void *pool);
+		void runTasks();
+
+		AIOPool(const AIOPool &);
+		AIOPool &operator=(const AIOPool &);
+};
+
+#endif
@@ -0,0 +1,417 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGICache.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 16:40:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 16:40:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGICache.hpp"
+#include "../utils/TimerQueue.hpp"
+#include "CGIJob.hpp"
+#include "CGIProcess.hpp"
+
+CGICache *CGICache::_instance = NULL;
+Logger	 &CGICache::_logger = Logger::getInstance();
+
+CGICache::Fill::Fill(const std::string &key, CGIProcess *process, const LocationConfig &location, int wakeFds[2]) :
+		_key(key),
+		_process(process),
+		_ttl(location.cgi_cache_valid),
+		_stale(location.cgi_cache_stale),
+		_createdAt(TimerQueue::now()),
+		_startedAt(0),
+		_isFinished(false),
+		_hasResponse(false),
+		_refCount(1) {
+	_wakeFds[0] = wakeFds[0];
+	_wakeFds[1] = wakeFds[1];
+}
+
+CGICache::Fill::~Fill() {
+	_process->release(); // Kills a child still running
+	if (_hasResponse)
+		CGIJob::releaseOutputFile(_response.getFileDescriptor()); // Nobody came for it
+	for (int i = 0; i < 2; ++i)
+		if (_wakeFds[i] >= 0)
+			close(_wakeFds[i]);
+}
+
+void CGICache::Fill::release() {
+	if (--_refCount == 0)
+		delete this;
+}
+
+bool CGICache::Fill::isQueued() const {
+	return _process->isQueued();
+}
+
+unsigned long CGICache::Fill::getQueueTimeout() const {
+	return _process->getQueueTimeout();
+}
+
+bool CGICache::Fill::takeResponse(Response &response) {
+	if (!_hasResponse)
+		return false;
+	response = _response; // Owns the spooled body; handed out once
+	_response = Response();
+	_hasResponse = false;
+	return true;
+}
+
+void CGICache::Fill::finish() {
+	_isFinished = true;
+	close(_wakeFds[1]); // EOF wakes every waiter at once
+	_wakeFds[1] = -1;
+}
+
+CGICache::CGICache() :
+		_memoryMax(CGI_CACHE_MEMORY),
+		_memoryUsed(0),
+		_diskMax(CGI_CACHE_DISK),
+		_diskUsed(0),
+		_directory(CGI_CACHE_PATH),
+		_nextFile(0),
+		_lastSweep(0) {
+}
+
+CGICache &CGICache::getInstance() {
+	if (!_instance)
+		_instance = new CGICache();
+	return *_instance;
+}
+
+std::string CGICache::makeKey(const Request &request, const LocationConfig &location) {
+	std::string key = request.getMethod();
+	key += '\0';
+	key += request.getHeader("Host");
+	key += '\0';
+	key += request.getPath();
+	key += '\0';
+	key += request.getQueryString();
+	for (std::vector<std::string>::const_iterator it = location.cgi_cache_key_headers.begin();
+		 it != location.cgi_cache_key_headers.end(); ++it) {
+		key += '\0';
+		key += request.getHeader(*it);
+	}
+	return key;
+}
+
+void CGICache::resetLimits() {
+	_memoryMax = CGI_CACHE_MEMORY;
+	_diskMax = CGI_CACHE_DISK;
+	_directory = CGI_CACHE_PATH;
+}
+
+void CGICache::configure(const ServerConfig &config) {
+	if (config.cgi_cache_memory)
+		_memoryMax = config.cgi_cache_memory;
+	if (config.cgi_cache_disk)
+		_diskMax = config.cgi_cache_disk;
+	if (!config.cgi_cache_path.empty())
+		_directory = config.cgi_cache_path;
+	mkdir(_directory.c_str(), 0700);
+	trimMemory();
+	trimDisk();
+}
+
+CGICache::Lookup CGICache::lookup(const std::string &key, Response &response, FileIO fileIO) {
+	time_t now = time(NULL);
+
+	std::map<std::string, time_t>::iterator pass = _passUntil.find(key);
+	if (pass != _passUntil.end()) {
+		if (now < pass->second)
+			return CACHE_PASS;
+		_passUntil.erase(pass);
+	}
+	std::map<std::string, Entry *>::iterator it = _entries.find(key);
+	if (it == _entries.end())
+		return CACHE_MISS;
+	Entry *entry = it->second;
+	if (now < entry->expires) {
+		serve(entry, response, fileIO, "HIT");
+		return CACHE_HIT;
+	}
+	if (now < entry->staleUntil) {
+		serve(entry, response, fileIO, "STALE");
+		return CACHE_STALE;
+	}
+	remove(entry);
+	return CACHE_MISS;
+}
+
+CGICache::Fill *CGICache::findFill(const std::string &key) const {
+	std::map<std::string, Fill *>::const_iterator it = _fills.find(key);
+	return it != _fills.end() ? it->second : NULL;
+}
+
+CGICache::Fill *CGICache::startFill(const std::string &key, CGIProcess *process, const LocationConfig &location) {
+	int wakeFds[2];
+	if (pipe(wakeFds) < 0) {
+		process->release();
+		return NULL;
+	}
+	fcntl(wakeFds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wakeFds[1], F_SETFD, FD_CLOEXEC);
+	fcntl(wakeFds[0], F_SETFL, fcntl(wakeFds[0], F_GETFL, 0) | O_NONBLOCK);
+
+	Fill *fill = new Fill(key, process, location, wakeFds);
+	if (!process->isQueued())
+		fill->_startedAt = TimerQueue::now();
+	_fills[key] = fill;
+	return fill;
+}
+
+void CGICache::maintain() {
+	long long now = TimerQueue::now();
+
+	std::vector<Fill *> done;
+	for (std::map<std::string, Fill *>::iterator it = _fills.begin(); it != _fills.end(); ++it) {
+		Fill	   *fill = it->second;
+		CGIProcess *process = fill->_process;
+		if (!fill->_startedAt && !process->isQueued())
+			fill->_startedAt = now;
+		// Nobody's connection times these runs out, so the cache does
+		if (!process->isDone() &&
+			(fill->_startedAt ? now - fill->_startedAt > CGI_TIMEOUT * 1000L
+							  : now - fill->_createdAt > (long long)process->getQueueTimeout() * 1000L))
+			process->timeout();
+		if (process->isDone())
+			done.push_back(fill);
+	}
+	for (size_t i = 0; i < done.size(); ++i) finishFill(done[i]);
+
+	time_t seconds = time(NULL);
+	if (seconds == _lastSweep)
+		return;
+	_lastSweep = seconds;
+	std::vector<Entry *> expired;
+	for (std::map<std::string, Entry *>::iterator it = _entries.begin(); it != _entries.end(); ++it)
+		if (seconds >= it->second->staleUntil && !findFill(it->first))
+			expired.push_back(it->second);
+	for (size_t i = 0; i < expired.size(); ++i) remove(expired[i]);
+	for (std::map<std::string, time_t>::iterator it = _passUntil.begin(); it != _passUntil.end();) {
+		if (seconds >= it->second)
+			_passUntil.erase(it++);
+		else
+			++it;
+	}
+}
+
+void CGICache::finishFill(Fill *fill) {
+	_fills.erase(fill->_key);
+
+	Response response(200);
+	fill->_process->complete(response);
+	if (store(fill, response)) {
+		CGIJob::releaseOutputFile(response.getFileDescriptor()); // Copied into the entry
+	} else {
+		// Let the first waiter have this run's answer; the others run the script
+		// themselves, and so does everyone for a while instead of queueing on
+		// fills that keep producing uncacheable responses. A failed run (5xx)
+		// keeps any stale entry and lets the next miss try again.
+		if (response.getStatusCode() < 500) {
+			std::map<std::string, Entry *>::iterator stale = _entries.find(fill->_key);
+			if (stale != _entries.end())
+				remove(stale->second);
+			_passUntil[fill->_key] = time(NULL) + std::max(1UL, fill->_ttl);
+		}
+		fill->_response = response;
+		fill->_hasResponse = true;
+	}
+	fill->finish();
+	fill->release();
+}
+
+bool CGICache::store(Fill *fill, Response &response) {
+	unsigned long ttl = fill->_ttl;
+	unsigned long stale = fill->_stale;
+	int			  sourceFd = response.getFileDescriptor();
+	if (!isCacheable(response, ttl, stale) || sourceFd < 0)
+		return false;
+	off_t length = std::strtol(response.getHeader("Content-Length").c_str(), NULL, 10);
+
+	// Small bodies go to the memory tier, big ones straight to disk
+	bool		inMemory = length > 0 && (size_t)length <= _memoryMax / 4;
+	std::string path;
+	int			bodyFd;
+	if (inMemory) {
+		bodyFd = CGIJob::createOutputFile();
+	} else {
+		path = _directory + "/" + Utils::numToString(getpid()) + "." + Utils::numToString(++_nextFile);
+		bodyFd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	}
+	if (bodyFd < 0)
+		return false;
+	fcntl(bodyFd, F_SETFD, FD_CLOEXEC);
+	struct stat st;
+	if (!writeBody(sourceFd, bodyFd, length) || fstat(bodyFd, &st) < 0) {
+		close(bodyFd);
+		if (!path.empty())
+			unlink(path.c_str());
+		return false;
+	}
+
+	Entry *entry = new Entry();
+	entry->key = fill->_key;
+	entry->statusCode = response.getStatusCode();
+	entry->headers = response.getHeaders();
+	entry->headers.erase("Content-Length");
+	entry->mapping = NULL;
+	entry->length = length;
+	entry->storedAt = time(NULL);
+	entry->expires = entry->storedAt + ttl;
+	entry->staleUntil = entry->expires + stale;
+	if (inMemory && (entry->mapping = MappedFile::acquire(bodyFd, st)) != NULL) {
+		_memoryLru.push_front(entry);
+		entry->lru = _memoryLru.begin();
+		_memoryUsed += length;
+	} else {
+		close(bodyFd);
+		if (inMemory) { // Could not map it
+			delete entry;
+			return false;
+		}
+		entry->path = path;
+		_diskLru.push_front(entry);
+		entry->lru = _diskLru.begin();
+		_diskUsed += entry->length;
+	}
+
+	std::map<std::string, Entry *>::iterator old = _entries.find(entry->key);
+	if (old != _entries.end())
+		remove(old->second); // Stale copy being revalidated
+	_entries[entry->key] = entry;
+	trimMemory();
+	trimDisk();
+	return true;
+}
+
+bool CGICache::isCacheable(const Response &response, unsigned long &ttl, unsigned long &stale) {
+	int status = response.getStatusCode();
+	if (status != 200 && status != 301)
+		return false;
+	// Header names are in the script's own case
+	const std::map<std::string, std::string> &headers = response.getHeaders();
+	std::string								  control;
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+		std::string name = Utils::toLower(it->first);
+		// Personal responses are never shared; Vary names request headers the key ignores
+		if (name.compare(0, 10, "set-cookie") == 0 || name == "vary")
+			return false;
+		if (name == "cache-control")
+			control = Utils::toLower(it->second);
+	}
+
+	// The script's Cache-Control overrides cgi_cache_valid and cgi_cache_stale
+	if (control.find("no-store") != std::string::npos || control.find("no-cache") != std::string::npos ||
+		control.find("private") != std::string::npos)
+		return false;
+	size_t pos = control.find("s-maxage=");
+	if (pos != std::string::npos)
+		ttl = std::strtoul(control.c_str() + pos + 9, NULL, 10);
+	else if ((pos = control.find("max-age=")) != std::string::npos)
+		ttl = std::strtoul(control.c_str() + pos + 8, NULL, 10);
+	if ((pos = control.find("stale-while-revalidate=")) != std::string::npos)
+		stale = std::strtoul(control.c_str() + pos + 23, NULL, 10);
+	return ttl > 0;
+}
+
+bool CGICache::writeBody(int sourceFd, int targetFd, off_t length) const {
+	char buffer[CGI_BUFSIZE];
+	while (length > 0) {
+		ssize_t bytes = read(sourceFd, buffer, std::min((off_t)sizeof(buffer), length));
+		if (bytes <= 0 || write(targetFd, buffer, bytes) != bytes)
+			return false;
+		length -= bytes;
+	}
+	return lseek(targetFd, 0, SEEK_SET) == 0;
+}
+
+void CGICache::serve(Entry *entry, Response &response, FileIO fileIO, const char *status) {
+	touch(entry);
+	response.setStatusCode(entry->statusCode);
+	for (std::map<std::string, std::string>::const_iterator it = entry->headers.begin(); it != entry->headers.end();
+		 ++it)
+		response.addHeader(it->first, it->second);
+	response.addHeader("Age", Utils::numToString(time(NULL) - entry->storedAt));
+	response.addHeader("X-Cache-Status", status);
+
+	// Same zero-copy paths as static files: writev from the mapping or sendfile from disk
+	int			fd = -1;
+	struct stat st;
+	if (entry->mapping) {
+		entry->mapping->retain();
+		response.setMappedFile(entry->mapping);
+	} else if (entry->length > 0 && (fd = open(entry->path.c_str(), O_RDONLY)) >= 0 && fstat(fd, &st) == 0) {
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		response.setFileIO(fileIO == FILE_IO_READ ? FILE_IO_SENDFILE : fileIO);
+		response.setFileDescriptor(fd);
+	} else {
+		if (fd >= 0)
+			close(fd);
+		response.setBody("");
+		return;
+	}
+	response.addHeader("Content-Length", Utils::numToString(entry->length));
+	response.addFileSegment(0, entry->length);
+}
+
+void CGICache::touch(Entry *entry) {
+	std::list<Entry *> &lru = entry->mapping ? _memoryLru : _diskLru;
+	lru.splice(lru.begin(), lru, entry->lru);
+}
+
+void CGICache::trimMemory() {
+	// Least recently used bodies overflow to disk instead of being dropped
+	while (_memoryUsed > _memoryMax && !_memoryLru.empty()) {
+		Entry *entry = _memoryLru.back();
+		if (!demote(entry))
+			remove(entry);
+	}
+}
+
+void CGICache::trimDisk() {
+	while (_diskUsed > _diskMax && !_diskLru.empty()) remove(_diskLru.back());
+}
+
+bool CGICache::demote(Entry *entry) {
+	std::string path = _directory + "/" + Utils::numToString(getpid()) + "." + Utils::numToString(++_nextFile);
+	int			fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return false;
+	ssize_t written = write(fd, entry->mapping->data(), entry->length);
+	close(fd);
+	if (written != entry->length) {
+		unlink(path.c_str());
+		return false;
+	}
+	_memoryLru.erase(entry->lru);
+	_memoryUsed -= entry->length;
+	entry->mapping->release(); // Responses still sending keep their own reference
+	entry->mapping = NULL;
+	entry->path = path;
+	_diskLru.push_front(entry);
+	entry->lru = _diskLru.begin();
+	_diskUsed += entry->length;
+	return true;
+}
+
+void CGICache::remove(Entry *entry) {
+	if (entry->mapping) {
+		_memoryLru.erase(entry->lru);
+		_memoryUsed -= entry->length;
+		entry->mapping->release();
+	} else {
+		_diskLru.erase(entry->lru);
+		_diskUsed -= entry->length;
+		if (!entry->path.empty())
+			unlink(entry->path.c_str()); // Open descriptors still finish their response
+	}
+	_entries.erase(entry->key);
+	delete entry;
+}
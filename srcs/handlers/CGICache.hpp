@@ -0,0 +1,145 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGICache.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 16:40:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 16:40:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_CACHE_HPP
+#define CGI_CACHE_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include "../http/MappedFile.hpp"
+#include "../http/Request.hpp"
+#include "../http/Response.hpp"
+#include "../utils/Logger.hpp"
+#include <list>
+
+class CGIProcess;
+
+// Microcache for GET responses of "cgi_cache" locations. Entries are keyed
+// by method, host, path, query and the location's cgi_cache_key_headers and
+// live for cgi_cache_valid seconds, or what the script's Cache-Control says.
+// Responses carrying Set-Cookie, Vary or a no-store/no-cache/private
+// Cache-Control are never stored.
+// Bodies sit in a memory tier (mapped unlinked files, sent with writev like
+// mmap'ed static files) that overflows LRU-first into a disk tier under
+// cgi_cache_path (sent with sendfile).
+//
+// A miss runs the script once as a Fill, its output spooled to a file, and
+// every identical request arriving meanwhile waits on that same Fill
+// (CGICacheWait). An entry past its TTL but inside its stale-while-
+// revalidate window is still served while a Fill refreshes it.
+class CGICache {
+	public:
+		// One script run feeding the cache; shared by the requests waiting on it
+		class Fill {
+			public:
+				void retain() { ++_refCount; }
+				void release();
+
+				bool isFinished() const { return _isFinished; }
+				bool isQueued() const;
+				unsigned long getQueueTimeout() const;
+				// Readable (EOF) once finished, for the event loop to wait on
+				int getWakeFd() const { return _wakeFds[0]; }
+				// The run's own response when it could not be cached (first waiter only)
+				bool takeResponse(Response &response);
+
+			private:
+				friend class CGICache;
+
+				std::string _key;
+				CGIProcess *_process;
+				unsigned long _ttl;
+				unsigned long _stale;
+				long long _createdAt;
+				long long _startedAt;	// 0 while queued for a process slot
+				int _wakeFds[2];
+				bool _isFinished;
+				bool _hasResponse;
+				Response _response;
+				size_t _refCount;
+
+				Fill(const std::string &key, CGIProcess *process, const LocationConfig &location, int wakeFds[2]);
+				~Fill();
+				void finish();
+				Fill(const Fill &);
+				Fill &operator=(const Fill &);
+		};
+
+		enum Lookup {
+			CACHE_HIT,		// response filled in from a fresh entry
+			CACHE_STALE,	// response filled in from a stale entry; refresh it
+			CACHE_MISS,
+			CACHE_PASS		// Recently uncacheable: run the script directly
+		};
+
+		static CGICache &getInstance();
+		static std::string makeKey(const Request &request, const LocationConfig &location);
+
+		// Called on (re)load: back to the defaults, then every server applies its own settings
+		void resetLimits();
+		void configure(const ServerConfig &config);
+
+		Lookup lookup(const std::string &key, Response &response, FileIO fileIO);
+		// Pending run for key, NULL if none
+		Fill *findFill(const std::string &key) const;
+		// Track a script run that fills key (spooled CGIProcess, already admitted)
+		Fill *startFill(const std::string &key, CGIProcess *process, const LocationConfig &location);
+		// Finish completed fills and give up on stuck ones; drop expired entries
+		void maintain();
+
+	private:
+		struct Entry {
+			std::string key;
+			int statusCode;
+			std::map<std::string, std::string> headers;
+			MappedFile *mapping;	// Memory tier, NULL on disk or for an empty body
+			std::string path;		// Disk tier file
+			off_t length;
+			time_t storedAt;
+			time_t expires;
+			time_t staleUntil;
+			std::list<Entry *>::iterator lru;
+		};
+
+		static CGICache *_instance;
+		static Logger &_logger;
+
+		std::map<std::string, Entry *> _entries;
+		std::list<Entry *> _memoryLru;	// Most recently used first
+		std::list<Entry *> _diskLru;
+		std::map<std::string, time_t> _passUntil;
+		std::map<std::string, Fill *> _fills;
+		size_t _memoryMax;
+		size_t _memoryUsed;
+		size_t _diskMax;
+		size_t _diskUsed;
+		std::string _directory;
+		unsigned long _nextFile;
+		time_t _lastSweep;
+
+		CGICache();
+		void finishFill(Fill *fill);
+		bool store(Fill *fill, Response &response);
+		static bool isCacheable(const Response &response, unsigned long &ttl, unsigned long &stale);
+		bool writeBody(int sourceFd, int targetFd, off_t length) const;
+		void serve(Entry *entry, Response &response, FileIO fileIO, const char *status);
+		void touch(Entry *entry);
+		void trimMemory();
+		void trimDisk();
+		bool demote(Entry *entry);
+		void remove(Entry *entry);
+
+		CGICache(const CGICache &);
+		CGICache &operator=(const CGICache &);
+};
+
+#endif
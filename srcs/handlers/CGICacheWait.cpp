@@ -0,0 +1,64 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGICacheWait.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 17:05:31 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 17:05:31 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGICacheWait.hpp"
+
+CGICacheWait::CGICacheWait(CGICache::Fill *fill, const std::string &key, FileIO fileIO) :
+		CGIJob(-1),
+		_fill(fill),
+		_key(key),
+		_fileIO(fileIO),
+		_isTimedOut(false),
+		_isExpired(false),
+		_isRetry(false) {
+	_fill->retain();
+}
+
+CGICacheWait::~CGICacheWait() {
+	_fill->release();
+}
+
+int CGICacheWait::getReadFd() const {
+	return _fill->isFinished() ? -1 : _fill->getWakeFd();
+}
+
+void CGICacheWait::timeout() {
+	_isTimedOut = true;
+	_isExpired = _fill->isQueued();
+}
+
+bool CGICacheWait::isDone() const {
+	return _isTimedOut || _fill->isFinished();
+}
+
+bool CGICacheWait::isQueued() const {
+	return !_fill->isFinished() && _fill->isQueued();
+}
+
+unsigned long CGICacheWait::getQueueTimeout() const {
+	return _fill->getQueueTimeout();
+}
+
+void CGICacheWait::complete(Response &response) {
+	if (_isExpired) {
+		setError(response, 503, "CGI busy, try again later");
+		response.addHeader("Retry-After", "1");
+	} else if (_isTimedOut)
+		setError(response, 504, "CGI Timeout");
+	else {
+		CGICache::Lookup found = CGICache::getInstance().lookup(_key, response, _fileIO);
+		if (found == CGICache::CACHE_HIT)
+			response.addHeader("X-Cache-Status", "MISS"); // Fresh from the run it waited for
+		else if (found != CGICache::CACHE_STALE && !_fill->takeResponse(response))
+			_isRetry = true;
+	}
+}
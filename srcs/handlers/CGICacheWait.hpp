@@ -0,0 +1,47 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGICacheWait.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 17:05:31 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 17:05:31 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_CACHE_WAIT_HPP
+#define CGI_CACHE_WAIT_HPP
+
+#include "CGICache.hpp"
+#include "CGIJob.hpp"
+
+// A request parked on a cache Fill for its key. It watches the Fill's wake
+// pipe and, once the run is over, answers from the fresh entry. If the run's
+// response could not be cached, the first waiter gets it and the others ask
+// to be handled again (needsRetry), which then runs the script directly.
+class CGICacheWait : public CGIJob {
+	public:
+		CGICacheWait(CGICache::Fill *fill, const std::string &key, FileIO fileIO);
+
+		int getReadFd() const;
+		void onReadable() {}
+		void timeout();
+		bool isDone() const;
+		bool isQueued() const;
+		unsigned long getQueueTimeout() const;
+		bool needsRetry() const { return _isRetry; }
+		void complete(Response &response);
+
+	private:
+		CGICache::Fill *_fill;
+		std::string _key;
+		FileIO _fileIO;
+		bool _isTimedOut;
+		bool _isExpired;	// Timed out while the run still waited for a slot
+		bool _isRetry;
+
+		~CGICacheWait();
+};
+
+#endif
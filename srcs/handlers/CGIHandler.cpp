@@ -11,6 +11,7 @@
 /* ************************************************************************** */
 
 #include "CGIHandler.hpp"
+#include "CGICacheWait.hpp"
 #include <algorithm>
 #include <fcntl.h>
 #include <sstream>
@@ -19,280 +20,235 @@
 Logger &CGIHandler::_logger = Logger::getInstance();
 
 CGIHandler::CGIHandler() {
-	char *cwd = getcwd(NULL, 0);
-	if (cwd) {
-		_cwd = cwd;
-		free(cwd);
-	}
-	_logger.configure("logs/cgi.log", INFO, true, true);
+	// Working directory and descriptor pools are set up once (CGIResources::initialize)
 }
 
 CGIHandler::~CGIHandler() {
-	_envMap.clear();
 }
 
-Response CGIHandler::executeCGI(const Request &request, const std::string &cgiPath, const std::string &scriptPath) {
+Response CGIHandler::executeCGI(const Request &request, const LocationConfig &location, const std::string &cgiPath,
+								const std::string &scriptPath) {
 	_logger.info("=== Starting CGI Execution ===");
 	_logger.info("CGI Path: " + cgiPath);
 	_logger.info("Script Path: " + scriptPath);
-	_logger.info("Request Body Size: " + Utils::numToString(request.getBody().length()));
-	setupEnvironment(request, scriptPath);
-	char **env = createEnvArray();
-	if (!env)
-		return createErrorResponse(500, "Failed to setup environment");
+	if (request.isBodyStreamed())
+		_logger.info("Request Body Size: " + request.getHeader("Content-Length") + " (streamed)");
+	else
+		_logger.info("Request Body Size: " + Utils::numToString(request.getBody().length()));
+	setupEnvironment(request, location, scriptPath);
 
+	// The body reaches stdin through a pipe, fed by the event loop while the
+	// script runs (and, for streamed uploads, while the body still arrives).
+	// Both come ready-made (flags, size) from the pool.
+	CGIResources &resources = CGIResources::getInstance();
+	int			  input_pipe[2];
+	if (!resources.takePipe(CGIResources::TO_CHILD, input_pipe))
+		return createErrorResponse(500, "Failed to create pipe");
 	int output_pipe[2];
-	if (pipe(output_pipe) < 0) {
-		cleanup(env);
+	if (!resources.takePipe(CGIResources::FROM_CHILD, output_pipe)) {
+		close(input_pipe[0]);
+		close(input_pipe[1]);
 		return createErrorResponse(500, "Failed to create pipe");
 	}
 
-	#ifdef F_SETPIPE_SZ
-		fcntl(output_pipe[1], F_SETPIPE_SZ, CGI_PIPE_BUFSIZE);
-	#endif
+	CGIProcess::Launch launch;
+	launch.cgiPath = cgiPath;
+	launch.scriptPath = scriptPath;
+	launch.environment = _environment;
+	launch.stdinFd = input_pipe[0];
+	launch.stdoutFd = output_pipe[1];
+	CGIProcess *process = new CGIProcess(launch, location, output_pipe[0], input_pipe[1]);
 
-	// Temp file to store request body
-	char tempPath[] = "/tmp/webserv_cgi_XXXXXX";
-	int	 tempFd = mkstemp(tempPath);
-	if (tempFd < 0) {
-		cleanup(env);
-		close(output_pipe[0]);
-		close(output_pipe[1]);
-		return createErrorResponse(500, "Failed to create temp file");
+	// Started now or once a slot frees up; either way the event loop takes it
+	// from here and the response starts once the script's headers are in
+	CGIScheduler::Admission admission = CGIScheduler::getInstance().admit(process, location.cgi_lane);
+	if (admission == CGIScheduler::ADMIT_REJECTED) {
+		process->release();
+		Response busy = createErrorResponse(503, "CGI busy, try again later");
+		busy.addHeader("Retry-After", "1");
+		return busy;
 	}
+	if (admission == CGIScheduler::ADMIT_QUEUED)
+		_logger.info("Executing CGI: " + cgiPath + " (queued)");
+	else
+		_logger.info("Executing CGI: " + cgiPath);
+	Response response(200);
+	response.setCGIJob(process);
+	return response;
+}
 
-	const std::string &body = request.getBody();
-	const size_t	   CHUNK_SIZE = 8192;
-	size_t			   totalWritten = 0;
+Response CGIHandler::executeCachedCGI(const Request &request, const LocationConfig &location,
+									  const std::string &cgiPath, const std::string &scriptPath) {
+	CGICache		&cache = CGICache::getInstance();
+	std::string		 key = CGICache::makeKey(request, location);
+	Response		 response(200);
+	CGICache::Lookup found = cache.lookup(key, response, location.file_io);
+	if (found == CGICache::CACHE_HIT)
+		return response;
+	if (found == CGICache::CACHE_PASS)
+		return executeCGI(request, location, cgiPath, scriptPath);
 
-	while (totalWritten < body.length()) {
-		size_t	toWrite = std::min(CHUNK_SIZE, body.length() - totalWritten);
-		ssize_t written = write(tempFd, body.c_str() + totalWritten, toWrite);
-		if (written < 0) {
-			cleanup(env);
-			close(tempFd);
-			close(output_pipe[0]);
-			close(output_pipe[1]);
-			unlink(tempPath);
-			return createErrorResponse(500, "Failed to write to temp file");
-		}
-		totalWritten += written;
+	// One run per key: later misses wait on the run already under way
+	CGICache::Fill *fill = cache.findFill(key);
+	if (!fill) {
+		Response error;
+		if (!(fill = startCacheFill(request, location, cgiPath, scriptPath, key, error)))
+			return found == CGICache::CACHE_STALE ? response : error;
 	}
+	if (found == CGICache::CACHE_STALE) // Served as is while the fill refreshes it
+		return response;
+	_logger.info("CGI cache: waiting for " + request.getPath());
+	response.setCGIJob(new CGICacheWait(fill, key, location.file_io));
+	return response;
+}
 
-	const_cast<Request &>(request).clearBody();
-	lseek(tempFd, 0, SEEK_SET);
+CGICache::Fill *CGIHandler::startCacheFill(const Request &request, const LocationConfig &location,
+										   const std::string &cgiPath, const std::string &scriptPath,
+										   const std::string &key, Response &error) {
+	_logger.info("CGI cache: filling " + request.getPath());
+	setupEnvironment(request, location, scriptPath);
 
-	_logger.info("Executing CGI: " + cgiPath);
-	pid_t pid = fork();
-	if (pid < 0) {
-		cleanup(env);
-		close(tempFd);
-		close(output_pipe[0]);
-		close(output_pipe[1]);
-		unlink(tempPath);
-		return createErrorResponse(500, "Fork failed");
+	// No client is attached to the run, so the output is spooled to a file
+	// rather than piped, and the cache copies it out once the child exits
+	int spoolFd = CGIJob::createOutputFile(true);
+	if (spoolFd < 0) {
+		error = createErrorResponse(500, "Failed to create temp file");
+		return NULL;
 	}
-	for (int i = 0; i < 2; ++i) {
-		int flags = fcntl(output_pipe[i], F_GETFL, 0);
-		fcntl(output_pipe[i], F_SETFL, flags | O_NONBLOCK);
+	CGIProcess::Launch launch;
+	launch.cgiPath = cgiPath;
+	launch.scriptPath = scriptPath;
+	launch.environment = _environment;
+	launch.stdoutFd = dup(spoolFd);
+	launch.stdinFd = open("/dev/null", O_RDONLY);
+	if (launch.stdoutFd >= 0)
+		fcntl(launch.stdoutFd, F_SETFD, FD_CLOEXEC);
+	if (launch.stdinFd >= 0)
+		fcntl(launch.stdinFd, F_SETFD, FD_CLOEXEC);
+	CGIProcess *process = new CGIProcess(launch, location, -1, -1, spoolFd);
+	if (launch.stdoutFd < 0 || launch.stdinFd < 0) {
+		process->release();
+		error = createErrorResponse(500, "Failed to create temp file");
+		return NULL;
 	}
 
-	// Child process
-	if (pid == 0) {
-		close(output_pipe[0]);
-
-		if (dup2(tempFd, STDIN_FILENO) < 0) {
-			_logger.error("Failed to redirect stdin");
-			_exit(1);
-		}
-		if (dup2(output_pipe[1], STDOUT_FILENO) < 0) {
-			_logger.error("Failed to redirect stdout");
-			_exit(1);
-		}
-		close(tempFd);
-		close(output_pipe[1]);
-		execve(cgiPath.c_str(),
-			   (char *[]){const_cast<char *>(cgiPath.c_str()), const_cast<char *>(scriptPath.c_str()), NULL}, env);
-		_logger.error("execve failed: " + std::string(strerror(errno)));
-		_exit(1);
+	if (CGIScheduler::getInstance().admit(process, location.cgi_lane) == CGIScheduler::ADMIT_REJECTED) {
+		process->release();
+		error = createErrorResponse(503, "CGI busy, try again later");
+		error.addHeader("Retry-After", "1");
+		return NULL;
 	}
+	CGICache::Fill *fill = CGICache::getInstance().startFill(key, process, location);
+	if (!fill)
+		error = createErrorResponse(500, "Failed to create pipe");
+	return fill;
+}
 
-	// Parent process
-	cleanup(env);
-	close(tempFd);
-	close(output_pipe[1]);
-	unlink(tempPath);
+Response CGIHandler::executeFastCGI(const Request &request, const LocationConfig &location,
+									const std::string &scriptPath) {
+	_logger.info("FastCGI " + location.fastcgi_pass + ": " + scriptPath);
+	// The backend runs elsewhere, so it needs the absolute script path
+	if (!scriptPath.empty() && scriptPath[0] != '/')
+		setupEnvironment(request, location, CGIResources::getInstance().getWorkingDirectory() + "/" + scriptPath);
+	else
+		setupEnvironment(request, location, scriptPath);
 
-	Response response = handleCGIOutput(output_pipe[0], pid);
-	close(output_pipe[0]);
+	int rawFd = CGIJob::createOutputFile();
+	if (rawFd < 0)
+		return createErrorResponse(500, "Failed to create temp file");
 
+	Response response(200);
+	response.setCGIJob(new FastCGIRequest(location.fastcgi_pass, _environment, request.getBody(), rawFd));
 	return response;
 }
 
-Response CGIHandler::handleCGIOutput(int output_fd, pid_t pid) {
-	char tempPath[] = "/tmp/webserv_cgi_out_XXXXXX";
-	int	 raw_fd = mkstemp(tempPath);
-	if (raw_fd < 0) {
-		kill(pid, SIGTERM);
-		return createErrorResponse(500, "Failed to create temp file");
-	}
-	unlink(tempPath);
+Response CGIHandler::executePooledCGI(const Request &request, const LocationConfig &location,
+									 const std::string &scriptPath) {
+	_logger.info("CGI worker (" + location.cgi_worker + "): " + scriptPath);
+	setupEnvironment(request, location, scriptPath);
 
-	bool   process_done = false;
-	time_t start_time = time(NULL);
-	size_t raw_bytes = 0;
-
-	while (!process_done) {
-		int	  status;
-		pid_t result = waitpid(pid, &status, WNOHANG);
-		if (result == pid) {
-			process_done = true;
-			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-				close(raw_fd);
-				return createErrorResponse(500, "CGI process failed");
-			}
-		}
-		char	buffer[CGI_BUFSIZE];
-		ssize_t bytes = read(output_fd, buffer, sizeof(buffer));
-		if (bytes > 0) {
-			if (write(raw_fd, buffer, bytes) != bytes) {
-				close(raw_fd);
-				kill(pid, SIGTERM);
-				return createErrorResponse(500, "Failed to write CGI output");
-			}
-			raw_bytes += bytes;
-		} else if (bytes == 0 && process_done) {
-			break;
-		} else if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-			close(raw_fd);
-			kill(pid, SIGTERM);
-			return createErrorResponse(500, "Read error");
-		}
-		if (time(NULL) - start_time > CGI_TIMEOUT) {
-			close(raw_fd);
-			kill(pid, SIGTERM);
-			return createErrorResponse(504, "CGI Timeout");
-		}
-	}
-	return parseCGIOutput(raw_fd, raw_bytes);
-}
+	int rawFd = CGIJob::createOutputFile();
+	if (rawFd < 0)
+		return createErrorResponse(500, "Failed to create temp file");
 
-Response CGIHandler::parseCGIOutput(int raw_fd, size_t raw_bytes) {
-	lseek(raw_fd, 0, SEEK_SET);
-	char	 header_buf[8192] = {0};
-	ssize_t	 header_bytes = 0;
-	size_t	 header_size = 0;
-	bool	 found_header_end = false;
 	Response response(200);
-
-	while ((header_bytes = read(raw_fd, header_buf, sizeof(header_buf))) > 0) {
-		std::string header_chunk(header_buf, header_bytes);
-
-		size_t pos = header_chunk.find("\r\n\r\n");
-		if (pos != std::string::npos) {
-			header_size = pos + 4;
-			found_header_end = true;
-		} else {
-			pos = header_chunk.find("\n\n");
-			if (pos != std::string::npos) {
-				header_size = pos + 2;
-				found_header_end = true;
-			}
-		}
-		if (found_header_end) {
-			std::istringstream header_stream(header_chunk.substr(0, pos));
-			std::string		   line;
-			while (std::getline(header_stream, line)) {
-				if (line.empty())
-					continue;
-				if (!line.empty() && line[line.length() - 1] == '\r')
-					line = line.substr(0, line.length() - 1);
-				if (line.find("Status:") == 0) {
-					size_t status_pos = line.find_first_of("0123456789");
-					if (status_pos != std::string::npos) {
-						int status = std::atoi(line.substr(status_pos).c_str());
-						if (status >= 100 && status < 600)
-							response.setStatusCode(status);
-					}
-					continue;
-				}
-				size_t colon_pos = line.find(':');
-				if (colon_pos != std::string::npos) {
-					std::string name = line.substr(0, colon_pos);
-					std::string value = line.substr(colon_pos + 1);
-					while (!value.empty() && (value[0] == ' ' || value[0] == '\t')) value = value.substr(1);
-					response.addHeader(name, value);
-				}
-			}
-			break;
-		}
-	}
-	if (!found_header_end) {
-		close(raw_fd);
-		return createErrorResponse(500, "Invalid CGI output");
-	}
-	size_t body_size = raw_bytes - header_size;
-	response.addHeader("Content-Length", Utils::numToString(body_size));
-	lseek(raw_fd, header_size, SEEK_SET);
-	response.setFileDescriptor(raw_fd);
-
+	response.setCGIJob(new CGIWorkerRequest(CGIWorkerPool::get(location), _environment, request.getBody(), rawFd));
 	return response;
 }
 
-void CGIHandler::cleanup(char **env) {
-	for (int i = 0; env[i] != NULL; i++) delete[] env[i];
-	delete[] env;
+void CGIHandler::appendVariable(std::string &environment, const std::string &name, const std::string &value) {
+	environment += name;
+	environment += '=';
+	environment += value;
+	environment += '\0';
 }
 
-void CGIHandler::setupEnvironment(const Request &request, const std::string &scriptPath) {
-	_envMap.clear();
-
-	// Special header handling
-	if (request.hasHeader("X-Secret-Header-For-Test"))
-		_envMap["HTTP_X_SECRET_HEADER_FOR_TEST"] = request.getHeader("X-Secret-Header-For-Test");
+void CGIHandler::setupEnvironment(const Request &request, const LocationConfig &location,
+								  const std::string &scriptPath) {
+	// Server-wide variables were built once at startup; only the request's own are
+	// added, written straight into the block (RFC 3875 section 4.1)
+	_environment = location.cgi_env;
 
 	if (request.getMethod() == "POST") {
 		if (request.isChunked())
-			_envMap["CONTENT_LENGTH"] = Utils::numToString(request.getBody().length());
+			appendVariable(_environment, "CONTENT_LENGTH", Utils::numToString(request.getBody().length()));
 		else if (request.hasHeader("Content-Length"))
-			_envMap["CONTENT_LENGTH"] = request.getHeader("Content-Length");
+			appendVariable(_environment, "CONTENT_LENGTH", request.getHeader("Content-Length"));
 		if (request.hasHeader("Content-Type"))
-			_envMap["CONTENT_TYPE"] = request.getHeader("Content-Type");
+			appendVariable(_environment, "CONTENT_TYPE", request.getHeader("Content-Type"));
+	}
+	std::string authorization = request.getHeader("Authorization");
+	if (!authorization.empty())
+		appendVariable(_environment, "AUTH_TYPE", authorization.substr(0, authorization.find(' ')));
+
+	const std::string pathInfo = request.getPathInfo();
+	appendVariable(_environment, "REQUEST_METHOD", request.getMethod());
+	appendVariable(_environment, "SCRIPT_NAME", request.getScriptName());
+	appendVariable(_environment, "SCRIPT_FILENAME", scriptPath);
+	appendVariable(_environment, "PATH_INFO", pathInfo);
+	// php-cgi still looks here for the script when there is no extra path
+	appendVariable(_environment, "PATH_TRANSLATED", pathInfo.empty() ? scriptPath : location.root + pathInfo);
+	appendVariable(_environment, "QUERY_STRING", request.getQueryString());
+	_environment += "REQUEST_URI=";
+	_environment += request.getPath();
+	if (!request.getQueryString().empty()) {
+		_environment += '?';
+		_environment += request.getQueryString();
 	}
-	// Critical environment variables
-	_envMap["GATEWAY_INTERFACE"] = "CGI/1.1";
-	_envMap["REQUEST_METHOD"] = request.getMethod();
-	_envMap["PATH_INFO"] = request.getPath();
-	_envMap["PATH_TRANSLATED"] = scriptPath;
-	_envMap["QUERY_STRING"] = "";
-	_envMap["REMOTE_ADDR"] = "127.0.0.1";
-	_envMap["REQUEST_URI"] = request.getPath();
-	_envMap["SCRIPT_FILENAME"] = scriptPath;
-	_envMap["SCRIPT_NAME"] = request.getPath();
-	_envMap["SERVER_NAME"] = "localhost";
-	_envMap["SERVER_PORT"] = "8080";
-	_envMap["SERVER_PROTOCOL"] = "HTTP/1.1";
-	_envMap["SERVER_SOFTWARE"] = "webserv/1.0";
-	_envMap["REDIRECT_STATUS"] = "200";
+	_environment += '\0';
+	appendVariable(_environment, "SERVER_PROTOCOL", request.getVersion());
+
+	// The name the client asked for; HTTP/1.0 clients may not send one
+	const Request::Peer &peer = request.getPeer();
+	std::string			 host = request.getHeader("Host");
+	appendVariable(_environment, "SERVER_NAME", host.empty() ? peer.localAddr : host.substr(0, host.find(':')));
+	appendVariable(_environment, "REMOTE_ADDR", peer.remoteAddr);
+	appendVariable(_environment, "REMOTE_HOST", peer.remoteAddr); // No reverse lookups
+	appendVariable(_environment, "REMOTE_PORT", peer.remotePort);
+	appendVariable(_environment, "SERVER_ADDR", peer.localAddr);
+
+	const std::map<std::string, std::string> &headers = request.getHeaders();
+	for (std::map<std::string, std::string>::const_iterator it = headers.begin(); it != headers.end(); ++it)
+		appendHeaderVariable(_environment, it->first, it->second);
 }
 
-char **CGIHandler::createEnvArray() {
-	try {
-		size_t envSize = _envMap.size();
-		char **env = new char *[envSize + 1];
-		size_t i = 0;
+void CGIHandler::appendHeaderVariable(std::string &environment, const std::string &name, const std::string &value) {
+	// Already passed as CONTENT_* above; "Proxy" would become HTTP_PROXY (httpoxy).
+	// Header names keep the client's case, so "proxy:" must be caught too
+	std::string lowerName = Utils::toLower(name);
+	if (lowerName == "content-length" || lowerName == "content-type" || lowerName == "proxy")
+		return;
+	// "X_Forwarded_For" must not pass for "X-Forwarded-For"
+	for (size_t i = 0; i < name.length(); ++i)
+		if (!std::isalnum(static_cast<unsigned char>(name[i])) && name[i] != '-')
+			return;
 
-		for (std::map<std::string, std::string>::const_iterator it = _envMap.begin(); it != _envMap.end(); ++it, ++i) {
-			std::string envStr = it->first + "=" + it->second;
-			env[i] = new char[envStr.length() + 1];
-			std::strcpy(env[i], envStr.c_str());
-		}
-		env[envSize] = NULL;
-		return env;
-	} catch (const std::exception &e) {
-		_logger.error("Failed to create environment array: " + std::string(e.what()));
-		return NULL;
-	}
+	environment += "HTTP_";
+	for (size_t i = 0; i < name.length(); ++i)
+		environment += name[i] == '-' ? '_' : static_cast<char>(std::toupper(static_cast<unsigned char>(name[i])));
+	environment += '=';
+	environment += value;
+	environment += '\0';
 }
 
 Response CGIHandler::createErrorResponse(int code, const std::string &message) {
@@ -17,27 +17,50 @@
 #include "../http/Request.hpp"
 #include "../http/Response.hpp"
 #include "../utils/Logger.hpp"
+#include "CGICache.hpp"
+#include "CGIProcess.hpp"
+#include "CGIResources.hpp"
+#include "CGIScheduler.hpp"
+#include "CGIWorkerRequest.hpp"
+#include "FastCGIRequest.hpp"
 
 class CGIHandler {
 	private:
 		static Logger &_logger;
-		std::map<std::string, std::string> _envMap;
-		std::string _cwd;
-		std::string _tmpPath;
+		std::string _environment;	// "NAME=value\0" entries, static part first
 
-		Response handleCGIOutput(int output_fd, pid_t pid);
-		Response parseCGIOutput(int raw_fd, size_t raw_bytes);
-		void setupEnvironment(const Request& request, const std::string& scriptPath);
-		char **createEnvArray();
+		void setupEnvironment(const Request& request,
+							  const LocationConfig& location,
+							  const std::string& scriptPath);
 		Response createErrorResponse(int code, const std::string& message);
-		void cleanup(char** env);
+		CGICache::Fill* startCacheFill(const Request& request,
+									   const LocationConfig& location,
+									   const std::string& cgiPath,
+									   const std::string& scriptPath,
+									   const std::string& key,
+									   Response& error);
+		static void appendVariable(std::string& environment, const std::string& name, const std::string& value);
+		// HTTP_* variable for a request header, skipped if the name could be mistaken for another
+		static void appendHeaderVariable(std::string& environment, const std::string& name, const std::string& value);
 
 	public:
 		CGIHandler();
 		~CGIHandler();
 		Response executeCGI(const Request& request,
+							const LocationConfig& location,
 							const std::string& cgiPath,
 							const std::string& scriptPath);
+		// executeCGI behind the cgi_cache microcache (GET only)
+		Response executeCachedCGI(const Request& request,
+								  const LocationConfig& location,
+								  const std::string& cgiPath,
+								  const std::string& scriptPath);
+		Response executeFastCGI(const Request& request,
+								const LocationConfig& location,
+								const std::string& scriptPath);
+		Response executePooledCGI(const Request& request,
+								  const LocationConfig& location,
+								  const std::string& scriptPath);
 };
 
 #endif
@@ -0,0 +1,108 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIJob.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/18 14:05:47 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/18 14:05:47 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIJob.hpp"
+#include "CGIResources.hpp"
+
+Logger &CGIJob::_logger = Logger::getInstance();
+
+CGIJob::CGIJob(int rawFd) : _rawFd(rawFd), _rawBytes(0), _refCount(1) {
+}
+
+CGIJob::~CGIJob() {
+	releaseOutputFile(_rawFd);
+}
+
+void CGIJob::release() {
+	if (--_refCount == 0)
+		delete this;
+}
+
+int CGIJob::createOutputFile(bool isForChild) {
+	return CGIResources::getInstance().takeSpoolFile(isForChild);
+}
+
+void CGIJob::releaseOutputFile(int fd) {
+	CGIResources::getInstance().releaseSpoolFile(fd);
+}
+
+bool CGIJob::appendOutput(const char *data, size_t length) {
+	if (write(_rawFd, data, length) != static_cast<ssize_t>(length)) {
+		_logger.error("Failed to write CGI output");
+		return false;
+	}
+	_rawBytes += length;
+	return true;
+}
+
+bool CGIJob::parseOutput(Response &response) {
+	lseek(_rawFd, 0, SEEK_SET);
+	char	header_buf[8192] = {0};
+	ssize_t header_bytes = read(_rawFd, header_buf, sizeof(header_buf));
+	if (header_bytes <= 0)
+		return false;
+
+	std::string header_chunk(header_buf, header_bytes);
+	size_t		header_size = findHeaderEnd(header_chunk);
+	if (header_size == std::string::npos)
+		return false;
+	applyHeaders(header_chunk.substr(0, header_size), response);
+
+	response.addHeader("Content-Length", Utils::numToString(_rawBytes - header_size));
+	lseek(_rawFd, header_size, SEEK_SET);
+	response.setSpoolFile(_rawFd); // The response owns the output from here on
+	_rawFd = -1;
+	return true;
+}
+
+size_t CGIJob::findHeaderEnd(const std::string &output) {
+	size_t pos = output.find("\r\n\r\n");
+	if (pos != std::string::npos)
+		return pos + 4;
+	pos = output.find("\n\n");
+	if (pos != std::string::npos)
+		return pos + 2;
+	return std::string::npos;
+}
+
+void CGIJob::applyHeaders(const std::string &head, Response &response) {
+	std::istringstream header_stream(head);
+	std::string		   line;
+	while (std::getline(header_stream, line)) {
+		if (!line.empty() && line[line.length() - 1] == '\r')
+			line = line.substr(0, line.length() - 1);
+		if (line.empty())
+			continue;
+		if (line.find("Status:") == 0) {
+			size_t status_pos = line.find_first_of("0123456789");
+			if (status_pos != std::string::npos) {
+				int status = std::atoi(line.substr(status_pos).c_str());
+				if (status >= 100 && status < 600)
+					response.setStatusCode(status);
+			}
+			continue;
+		}
+		size_t colon_pos = line.find(':');
+		if (colon_pos != std::string::npos) {
+			std::string name = line.substr(0, colon_pos);
+			std::string value = line.substr(colon_pos + 1);
+			while (!value.empty() && (value[0] == ' ' || value[0] == '\t')) value = value.substr(1);
+			response.addHeader(name, value);
+		}
+	}
+}
+
+void CGIJob::setError(Response &response, int code, const std::string &message) {
+	response.setStatusCode(code);
+	response.addHeader("Content-Type", "text/html");
+	response.setBody("<html><body><h1>" + message + "</h1></body></html>");
+}
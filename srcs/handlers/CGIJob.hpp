@@ -0,0 +1,82 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIJob.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/18 14:05:47 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/18 14:05:47 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_JOB_HPP
+#define CGI_JOB_HPP
+
+#include "../WebServ.hpp"
+#include "../http/Response.hpp"
+#include "../utils/Logger.hpp"
+
+// Script work running on behalf of a connection: a forked CGI child or a
+// request to a FastCGI backend (or file work on an AIOPool thread, FileTask,
+// which waits the same way). The event loop watches the descriptors it
+// reports, the connection waits in CGI_RUNNING until isDone(), and complete()
+// then fills in the pending response (for a forked child, as soon as its
+// headers are in; the body follows through a BodyProducer). Reference counted: the pending response
+// carries it from the handler to the client state.
+class CGIJob {
+	public:
+		void retain() { ++_refCount; }
+		void release();
+
+		// Descriptors to watch, -1 when there is nothing to wait for
+		virtual int getReadFd() const = 0;
+		virtual int getWriteFd() const { return -1; }
+		virtual void onReadable() = 0;
+		virtual void onWritable() {}
+		// Write end of the script's stdin, fed by the connection's BodyPump
+		virtual int getInputFd() const { return -1; }
+		virtual void closeInput() {}
+		// Give up on the backend; complete() then answers 504
+		virtual void timeout() = 0;
+		virtual bool isDone() const = 0;
+		// Still waiting for a process slot; timeout() then answers 503 after
+		// getQueueTimeout() seconds instead of 504 after CGI_TIMEOUT
+		virtual bool isQueued() const { return false; }
+		virtual unsigned long getQueueTimeout() const { return 0; }
+		// After complete(): nothing to answer with, handle the request again
+		virtual bool needsRetry() const { return false; }
+		virtual void complete(Response &response) = 0;
+
+		// Unlinked temp file for spooling (script output, spilled request bodies), -1 on failure
+		// isForChild: a script writes into it directly, so it is never reused
+		static int createOutputFile(bool isForChild = false);
+		// Hand a spool file back for reuse once its content is no longer needed
+		static void releaseOutputFile(int fd);
+
+	protected:
+		static Logger &_logger;
+
+		// Script output (CGI headers + body), spooled until the job completes
+		int _rawFd;
+		size_t _rawBytes;
+
+		explicit CGIJob(int rawFd);
+		virtual ~CGIJob();
+
+		bool appendOutput(const char *data, size_t length);
+		// Parse the spooled CGI headers into response and hand it the body
+		bool parseOutput(Response &response);
+		// Length of the CGI header block including its blank line, npos if incomplete
+		static size_t findHeaderEnd(const std::string &output);
+		static void applyHeaders(const std::string &head, Response &response);
+		static void setError(Response &response, int code, const std::string &message);
+
+	private:
+		size_t _refCount;
+
+		CGIJob(const CGIJob &);
+		CGIJob &operator=(const CGIJob &);
+};
+
+#endif
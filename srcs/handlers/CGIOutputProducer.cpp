@@ -0,0 +1,57 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIOutputProducer.cpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 15:08:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 15:08:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIOutputProducer.hpp"
+
+CGIOutputProducer::CGIOutputProducer(CGIProcess *process, const std::string &buffered, off_t length) :
+		_process(process),
+		_buffered(buffered),
+		_remaining(length) {
+}
+
+CGIOutputProducer::~CGIOutputProducer() {
+	_process->release();
+}
+
+BodyProducer::Status CGIOutputProducer::produce(std::string &output) {
+	if (_remaining == 0)
+		return DONE; // Anything past Content-Length is dropped
+
+	if (_buffered.empty()) {
+		int fd = _process->getReadFd();
+		if (fd < 0)
+			return _remaining > 0 ? FAILED : DONE;
+		char	buffer[CGI_BUFSIZE];
+		ssize_t bytes = read(fd, buffer, sizeof(buffer));
+		if (bytes < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? AGAIN : FAILED;
+		if (bytes == 0) // Script closed stdout: short of its Content-Length is a cut-off body
+			return _remaining > 0 ? FAILED : DONE;
+		_buffered.assign(buffer, bytes);
+	}
+
+	if (_remaining > 0 && static_cast<off_t>(_buffered.length()) > _remaining)
+		_buffered.erase(_remaining);
+	if (_remaining > 0)
+		_remaining -= _buffered.length();
+	output.append(_buffered);
+	std::string().swap(_buffered);
+	return DATA;
+}
+
+bool CGIOutputProducer::isReady() const {
+	return !_buffered.empty() || _remaining == 0 || _process->getReadFd() < 0;
+}
+
+int CGIOutputProducer::getWaitFd() const {
+	return _process->getReadFd();
+}
@@ -0,0 +1,40 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIOutputProducer.hpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 15:08:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 15:08:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_OUTPUT_PRODUCER_HPP
+#define CGI_OUTPUT_PRODUCER_HPP
+
+#include "../http/BodyProducer.hpp"
+#include "CGIProcess.hpp"
+
+// Body of a running CGI script, read from its stdout pipe only when the
+// response has room for more. A slow client therefore leaves the pipe full
+// and the script blocks in write() instead of the output piling up here.
+// Keeps the process alive (and kills it when dropped early).
+class CGIOutputProducer : public BodyProducer {
+	public:
+		// buffered: body bytes read along with the headers; length: the
+		// script's Content-Length, or -1
+		CGIOutputProducer(CGIProcess *process, const std::string &buffered, off_t length);
+		~CGIOutputProducer();
+
+		Status produce(std::string &output);
+		bool isReady() const;
+		int getWaitFd() const;
+
+	private:
+		CGIProcess *_process;
+		std::string _buffered;
+		off_t _remaining;	// Bytes still allowed by Content-Length, -1 if unknown
+};
+
+#endif
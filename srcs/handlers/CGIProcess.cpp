@@ -0,0 +1,256 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIProcess.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/17 10:40:12 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/17 10:40:12 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIProcess.hpp"
+#include "CGIOutputProducer.hpp"
+#include "CGIScheduler.hpp"
+#include <spawn.h>
+
+std::map<pid_t, CGIProcess *> CGIProcess::_running;
+std::set<pid_t>				  CGIProcess::_abandoned;
+
+CGIProcess::CGIProcess(const Launch &launch, const LocationConfig &location, int outputFd, int inputFd, int spoolFd) :
+		CGIJob(spoolFd),
+		_launch(launch),
+		_lane(location.cgi_lane),
+		_queueTimeout(location.cgi_queue_timeout),
+		_pid(-1),
+		_outputFd(outputFd),
+		_inputFd(inputFd),
+		_hasExited(false),
+		_exitStatus(0),
+		_isTimedOut(false),
+		_isFailed(false),
+		_isExpired(false),
+		_headerSize(std::string::npos) {
+}
+
+CGIProcess::~CGIProcess() {
+	if (isQueued()) {
+		CGIScheduler::getInstance().cancel(this, _lane, false);
+	} else if (_pid > 0 && !_hasExited) {
+		// An abandoned child is killed; reapChildren() still collects the zombie
+		kill(_pid, SIGKILL);
+		_running.erase(_pid);
+		_abandoned.insert(_pid);
+		CGIScheduler::getInstance().finished(_lane);
+	}
+	closeLaunchFds();
+	closeOutput();
+	closeInput();
+}
+
+bool CGIProcess::start() {
+	_pid = spawn();
+	closeLaunchFds(); // The child has its own copies now
+	std::string().swap(_launch.environment);
+	if (_pid < 0) {
+		_isFailed = true;
+		return false;
+	}
+	_running[_pid] = this;
+	return true;
+}
+
+pid_t CGIProcess::spawn() const {
+	// envp points straight into the block, no per-variable allocation
+	const std::string &environment = _launch.environment;
+	std::vector<char *> envp;
+	for (size_t offset = 0; offset < environment.length(); offset = environment.find('\0', offset) + 1)
+		envp.push_back(const_cast<char *>(environment.data() + offset));
+	envp.push_back(NULL);
+	char *argv[] = {const_cast<char *>(_launch.cgiPath.c_str()), const_cast<char *>(_launch.scriptPath.c_str()),
+					NULL};
+
+	// posix_spawn avoids copying the server's page tables (vfork-style on
+	// Linux and macOS), so launch time does not grow with server memory.
+	// dup2 clears FD_CLOEXEC on the targets. Sockets, pipes and spools are all
+	// opened CLOEXEC, so the script holds no client connection of ours.
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, _launch.stdinFd, STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, _launch.stdoutFd, STDOUT_FILENO);
+
+	// The server ignores SIGPIPE; scripts get the default disposition back
+	posix_spawnattr_t attr;
+	sigset_t		  defaults, mask;
+	posix_spawnattr_init(&attr);
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGPIPE);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+
+	pid_t pid;
+	int	  error = posix_spawn(&pid, _launch.cgiPath.c_str(), &actions, &attr, argv, &envp[0]);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if (error != 0) {
+		_logger.error("posix_spawn failed: " + std::string(strerror(error)));
+		return -1;
+	}
+	return pid;
+}
+
+void CGIProcess::closeInput() {
+	if (_inputFd >= 0) { // EOF on the script's stdin
+		close(_inputFd);
+		_inputFd = -1;
+	}
+}
+
+void CGIProcess::onReadable() {
+	char buffer[CGI_BUFSIZE];
+
+	// Only the header block is read here; the body stays in the pipe for the producer
+	for (int i = 0; i < 4 && _outputFd >= 0 && _headerSize == std::string::npos; ++i) {
+		ssize_t bytes = read(_outputFd, buffer, sizeof(buffer));
+		if (bytes > 0) {
+			_head.append(buffer, bytes);
+			_headerSize = findHeaderEnd(_head);
+			if (_headerSize == std::string::npos && _head.length() > CGI_HEADER_MAX) {
+				_logger.error("CGI headers too large");
+				_isFailed = true;
+				closeOutput();
+				terminate();
+			}
+			continue;
+		}
+		if (bytes == 0) { // Child closed stdout, usually because it exited
+			closeOutput();
+			pollExit();
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			_isFailed = true;
+			closeOutput();
+			terminate();
+		}
+		return;
+	}
+}
+
+void CGIProcess::timeout() {
+	if (isQueued()) {
+		CGIScheduler::getInstance().cancel(this, _lane, true);
+		_isExpired = true;
+		return;
+	}
+	_logger.error("CGI Timeout, killing pid " + Utils::numToString(_pid));
+	_isTimedOut = true;
+	closeOutput();
+	terminate();
+}
+
+bool CGIProcess::isDone() const {
+	return _isTimedOut || _isFailed || _isExpired || _headerSize != std::string::npos ||
+		   (_outputFd < 0 && _hasExited);
+}
+
+bool CGIProcess::isQueued() const {
+	return _pid < 0 && !_isFailed && !_isExpired;
+}
+
+void CGIProcess::complete(Response &response) {
+	if (_isExpired) {
+		setError(response, 503, "CGI busy, try again later");
+		response.addHeader("Retry-After", "1");
+	} else if (_isTimedOut)
+		setError(response, 504, "CGI Timeout");
+	else if (_isFailed)
+		setError(response, 500, _pid < 0 ? "Failed to start CGI" : "Read error");
+	else if (_rawFd >= 0) { // Spooled run: the whole output is in the file
+		struct stat st;
+		_rawBytes = fstat(_rawFd, &st) == 0 ? st.st_size : 0;
+		if (!WIFEXITED(_exitStatus) || WEXITSTATUS(_exitStatus) != 0)
+			setError(response, 500, "CGI process failed");
+		else if (!parseOutput(response))
+			setError(response, 500, "Invalid CGI output");
+	} else if (_headerSize == std::string::npos) { // Output ended before the header block did
+		if (!WIFEXITED(_exitStatus) || WEXITSTATUS(_exitStatus) != 0)
+			setError(response, 500, "CGI process failed");
+		else
+			setError(response, 500, "Invalid CGI output");
+	} else {
+		// Headers go out now; the status is final even if the script fails later
+		applyHeaders(_head.substr(0, _headerSize), response);
+		off_t		length = -1;
+		std::string contentLength = response.getHeader("Content-Length");
+		if (!contentLength.empty()) {
+			char *end;
+			length = std::strtol(contentLength.c_str(), &end, 10);
+			if (*end != '\0' || length < 0) {
+				length = -1;
+				response.removeHeader("Content-Length");
+			}
+		}
+		retain(); // Held by the producer until the body is sent
+		response.setBodyProducer(new CGIOutputProducer(this, _head.substr(_headerSize), length), length);
+		std::string().swap(_head);
+	}
+}
+
+void CGIProcess::reapChildren() {
+	// Only our own children: waitpid(-1) would also take the CGIWorkerPool workers' exits
+	std::vector<pid_t> pids;
+	for (std::map<pid_t, CGIProcess *>::iterator it = _running.begin(); it != _running.end(); ++it)
+		pids.push_back(it->first);
+	int status;
+	for (size_t i = 0; i < pids.size(); ++i) {
+		std::map<pid_t, CGIProcess *>::iterator it = _running.find(pids[i]);
+		// Looked up again: markExited() may start or end other launches
+		if (it != _running.end() && waitpid(pids[i], &status, WNOHANG) == pids[i])
+			it->second->markExited(status);
+	}
+	for (std::set<pid_t>::iterator it = _abandoned.begin(); it != _abandoned.end();) {
+		if (waitpid(*it, &status, WNOHANG) != 0)
+			_abandoned.erase(it++); // Reaped, or not ours to wait for anymore
+		else
+			++it;
+	}
+}
+
+void CGIProcess::terminate() {
+	if (_pid > 0 && !_hasExited)
+		kill(_pid, SIGKILL);
+}
+
+void CGIProcess::closeLaunchFds() {
+	if (_launch.stdinFd >= 0) {
+		close(_launch.stdinFd);
+		_launch.stdinFd = -1;
+	}
+	if (_launch.stdoutFd >= 0) {
+		close(_launch.stdoutFd);
+		_launch.stdoutFd = -1;
+	}
+}
+
+void CGIProcess::closeOutput() {
+	if (_outputFd >= 0) {
+		close(_outputFd);
+		_outputFd = -1;
+	}
+}
+
+void CGIProcess::pollExit() {
+	// SIGCHLD may not have been processed yet when EOF shows up first
+	int status;
+	if (_pid > 0 && !_hasExited && waitpid(_pid, &status, WNOHANG) == _pid)
+		markExited(status);
+}
+
+void CGIProcess::markExited(int status) {
+	_hasExited = true;
+	_exitStatus = status;
+	_running.erase(_pid);
+	CGIScheduler::getInstance().finished(_lane); // May start a queued launch
+}
@@ -0,0 +1,86 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIProcess.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/17 10:40:12 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/17 10:40:12 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_PROCESS_HPP
+#define CGI_PROCESS_HPP
+
+#include "CGIJob.hpp"
+#include "../config/ServerConfig.hpp"
+
+// A forked CGI child. It is created with its pipes but only spawned once the
+// CGIScheduler grants it a slot; until then it waits in its location's queue
+// and body bytes collect in the stdin pipe. Its stdout pipe is read until the
+// CGI header block is complete; the job is then done and complete() hands the
+// rest of the pipe to the response as a CGIOutputProducer, so the body
+// reaches the client while the script still runs. The exit status arrives
+// through SIGCHLD (see reapChildren).
+//
+// Given a spool file instead of an output pipe (cache fills), the child
+// writes straight into it and the job is done once the child has exited.
+class CGIProcess : public CGIJob {
+	public:
+		// What to run, and the child's ends of the stdin/stdout pipes
+		struct Launch {
+			std::string cgiPath;
+			std::string scriptPath;
+			std::string environment;	// "NAME=value\0" entries
+			int stdinFd;
+			int stdoutFd;
+		};
+
+		CGIProcess(const Launch &launch, const LocationConfig &location, int outputFd, int inputFd, int spoolFd = -1);
+
+		// Spawn the child (called by the scheduler); false if it could not start
+		bool start();
+
+		int getReadFd() const { return _outputFd; }
+		int getInputFd() const { return _inputFd; }
+		void closeInput();
+		void onReadable();
+		void timeout();
+		bool isDone() const;
+		bool isQueued() const;
+		unsigned long getQueueTimeout() const { return _queueTimeout; }
+		void complete(Response &response);
+
+		// Collect the exited children this class started (called when the
+		// SIGCHLD pipe fires)
+		static void reapChildren();
+
+	private:
+		static std::map<pid_t, CGIProcess *> _running;
+		static std::set<pid_t> _abandoned;		// Killed with their job gone, not reaped yet
+
+		Launch _launch;
+		size_t _lane;
+		unsigned long _queueTimeout;
+		pid_t _pid;				// -1 until started
+		int _outputFd;
+		int _inputFd;
+		bool _hasExited;
+		int _exitStatus;
+		bool _isTimedOut;
+		bool _isFailed;
+		bool _isExpired;		// Gave up waiting for a slot
+		std::string _head;		// Output read so far, until the headers are complete
+		size_t _headerSize;		// npos until the blank line shows up
+
+		~CGIProcess();
+		pid_t spawn() const;
+		void terminate();
+		void closeOutput();
+		void closeLaunchFds();
+		void pollExit();
+		void markExited(int status);
+};
+
+#endif
@@ -0,0 +1,125 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIResources.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 17:48:14 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 17:48:14 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIResources.hpp"
+
+CGIResources *CGIResources::_instance = NULL;
+Logger		 &CGIResources::_logger = Logger::getInstance();
+
+CGIResources::CGIResources() : _spoolDirectory("/tmp") {
+}
+
+CGIResources &CGIResources::getInstance() {
+	if (!_instance)
+		_instance = new CGIResources();
+	return *_instance;
+}
+
+void CGIResources::initialize() {
+	char *cwd = getcwd(NULL, 0);
+	if (cwd) {
+		_cwd = cwd;
+		free(cwd);
+	}
+	refill();
+	while (_spoolFiles.size() < CGI_SPOOL_POOL / 2) {
+		int fd = makeSpoolFile();
+		if (fd < 0)
+			break;
+		_spoolFiles.push_back(fd);
+	}
+}
+
+bool CGIResources::takePipe(Direction direction, int fds[2]) {
+	std::vector<int> &pool = _pipes[direction];
+	if (pool.empty())
+		return makePipe(direction, fds);
+	fds[1] = pool.back();
+	pool.pop_back();
+	fds[0] = pool.back();
+	pool.pop_back();
+	return true;
+}
+
+int CGIResources::takeSpoolFile(bool isForChild) {
+	int fd;
+	if (_spoolFiles.empty()) {
+		fd = makeSpoolFile();
+	} else {
+		fd = _spoolFiles.back();
+		_spoolFiles.pop_back();
+	}
+	if (fd >= 0 && isForChild)
+		_childSpoolFiles.insert(fd);
+	return fd;
+}
+
+void CGIResources::releaseSpoolFile(int fd) {
+	if (fd < 0)
+		return;
+	if (_childSpoolFiles.erase(fd)) { // Shares its offset with whatever the script left running
+		close(fd);
+		return;
+	}
+	// Whoever had it is done with the content; the next user starts from empty
+	if (_spoolFiles.size() < CGI_SPOOL_POOL && ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0)
+		_spoolFiles.push_back(fd);
+	else
+		close(fd);
+}
+
+void CGIResources::refill() {
+	for (int direction = TO_CHILD; direction <= FROM_CHILD; ++direction) {
+		std::vector<int> &pool = _pipes[direction];
+		while (pool.size() < CGI_PIPE_POOL * 2) {
+			int fds[2];
+			if (!makePipe(static_cast<Direction>(direction), fds))
+				break;
+			pool.push_back(fds[0]);
+			pool.push_back(fds[1]);
+		}
+	}
+}
+
+bool CGIResources::makePipe(Direction direction, int fds[2]) const {
+	if (pipe(fds) < 0) {
+		_logger.error("Failed to create pipe: " + std::string(strerror(errno)));
+		return false;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+	// Output only: big pipe buffers count against a per-user limit
+	if (direction == FROM_CHILD)
+		fcntl(fds[1], F_SETPIPE_SZ, CGI_PIPE_BUFSIZE);
+#endif
+	// Only our end: the child's end stays blocking, as scripts expect
+	int ours = direction == TO_CHILD ? fds[1] : fds[0];
+	fcntl(ours, F_SETFL, fcntl(ours, F_GETFL, 0) | O_NONBLOCK);
+	return true;
+}
+
+int CGIResources::makeSpoolFile() const {
+	int fd = -1;
+#ifdef O_TMPFILE
+	fd = open(_spoolDirectory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+	if (fd < 0) { // No O_TMPFILE here, or not on this filesystem
+		std::string path = _spoolDirectory + "/webserv_cgi_out_XXXXXX";
+		fd = mkstemp(&path[0]);
+		if (fd < 0)
+			return -1;
+		unlink(path.c_str());
+		fcntl(fd, F_SETFD, FD_CLOEXEC); // Never inherited by CGI children
+	}
+	return fd;
+}
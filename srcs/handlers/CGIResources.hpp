@@ -0,0 +1,71 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIResources.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 17:48:14 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 17:48:14 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_RESOURCES_HPP
+#define CGI_RESOURCES_HPP
+
+#include "../WebServ.hpp"
+#include "../utils/Logger.hpp"
+
+// Plumbing every CGI launch needs, prepared outside the request path.
+//
+// Pipes come out of a pool of pairs that are already CLOEXEC, with the
+// server's end non-blocking and output pipes sized to CGI_PIPE_BUFSIZE;
+// refill() tops it up
+// between events. A pipe is used once: its EOF is what tells us the script
+// is done, and a stray grandchild may still hold the other end.
+//
+// Spool files (script output, spilled request bodies) are unnamed temp files
+// (O_TMPFILE where available). Released ones are truncated and kept for the
+// next request, up to CGI_SPOOL_POOL of them, unless a child was given the
+// file: like a pipe end, a grandchild may still be writing into it.
+class CGIResources {
+	public:
+		enum Direction {
+			TO_CHILD,	// Child's stdin: we write, non-blocking write end
+			FROM_CHILD	// Child's stdout: we read, non-blocking read end
+		};
+
+		static CGIResources &getInstance();
+
+		// Once at startup: working directory, pools filled
+		void initialize();
+		// Absolute paths for backends that do not share our working directory
+		const std::string &getWorkingDirectory() const { return _cwd; }
+
+		// fds[0] is the read end, fds[1] the write end; false if none could be made
+		bool takePipe(Direction direction, int fds[2]);
+		// isForChild: the file is handed to a script, so it is closed on release
+		int takeSpoolFile(bool isForChild = false);
+		void releaseSpoolFile(int fd);
+		// Refill the pipe pools (called from the event loop)
+		void refill();
+
+	private:
+		static CGIResources *_instance;
+		static Logger &_logger;
+
+		std::string _cwd;
+		std::vector<int> _pipes[2];		// Read/write pairs per direction, flattened
+		std::vector<int> _spoolFiles;
+		std::set<int> _childSpoolFiles;	// Taken for a script; never pooled again
+		std::string _spoolDirectory;
+
+		CGIResources();
+		bool makePipe(Direction direction, int fds[2]) const;
+		int makeSpoolFile() const;
+
+		CGIResources(const CGIResources &);
+		CGIResources &operator=(const CGIResources &);
+};
+
+#endif
@@ -0,0 +1,151 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIScheduler.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 14:12:09 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 14:12:09 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIScheduler.hpp"
+#include "CGIProcess.hpp"
+
+CGIScheduler *CGIScheduler::_instance = NULL;
+Logger		 &CGIScheduler::_logger = Logger::getInstance();
+
+CGIScheduler::CGIScheduler() : _maxRunning(0), _running(0), _nextLane(0) {
+}
+
+CGIScheduler &CGIScheduler::getInstance() {
+	if (!_instance)
+		_instance = new CGIScheduler();
+	return *_instance;
+}
+
+void CGIScheduler::resetLimit() {
+	_maxRunning = 0;
+}
+
+void CGIScheduler::configure(ServerConfig &config) {
+	if (config.cgi_max_processes > 0 && (_maxRunning == 0 || config.cgi_max_processes < _maxRunning))
+		_maxRunning = config.cgi_max_processes;
+
+	// Lanes outlive a reload, so children still running keep being counted
+	for (std::vector<LocationConfig>::iterator it = config.locations.begin(); it != config.locations.end(); ++it) {
+		std::string name = Utils::numToString(config.port) + " " + it->describe();
+
+		std::map<std::string, size_t>::iterator found = _laneIndex.find(name);
+		if (found == _laneIndex.end()) {
+			Lane lane;
+			lane.name = name;
+			lane.running = 0;
+			lane.started = 0;
+			lane.rejected = 0;
+			lane.expired = 0;
+			found = _laneIndex.insert(std::make_pair(name, _lanes.size())).first;
+			_lanes.push_back(lane);
+		}
+		_lanes[found->second].maxRunning = it->cgi_max_processes;
+		_lanes[found->second].maxQueued = it->cgi_queue;
+		it->cgi_lane = found->second;
+	}
+}
+
+CGIScheduler::Admission CGIScheduler::admit(CGIProcess *process, size_t lane) {
+	Lane &target = _lanes[lane];
+
+	// Nobody jumps the queue: a slot seen free while others wait is already theirs
+	if (target.queue.empty() && hasSlot(target)) {
+		start(process, lane);
+		return ADMIT_STARTED;
+	}
+	if (target.queue.size() >= target.maxQueued) {
+		++target.rejected;
+		_logger.warn("CGI queue full for " + target.name + ", request rejected");
+		return ADMIT_REJECTED;
+	}
+	target.queue.push_back(process);
+	return ADMIT_QUEUED;
+}
+
+void CGIScheduler::cancel(CGIProcess *process, size_t lane, bool isExpired) {
+	std::deque<CGIProcess *>		  &queue = _lanes[lane].queue;
+	std::deque<CGIProcess *>::iterator it = std::find(queue.begin(), queue.end(), process);
+	if (it == queue.end())
+		return;
+	queue.erase(it);
+	if (isExpired) {
+		++_lanes[lane].expired;
+		_logger.warn("CGI queue timeout for " + _lanes[lane].name);
+	}
+}
+
+void CGIScheduler::finished(size_t lane) {
+	--_lanes[lane].running;
+	--_running;
+	dispatch();
+}
+
+bool CGIScheduler::hasSlot(const Lane &lane) const {
+	size_t maxRunning = _maxRunning ? _maxRunning : CGI_MAX_PROCESSES;
+	return _running < maxRunning && (lane.maxRunning == 0 || lane.running < lane.maxRunning);
+}
+
+bool CGIScheduler::start(CGIProcess *process, size_t lane) {
+	if (!process->start())
+		return false; // The job fails on its own; no slot is taken
+	++_lanes[lane].running;
+	++_lanes[lane].started;
+	++_running;
+	return true;
+}
+
+void CGIScheduler::dispatch() {
+	// One launch per lane per turn, so every waiting location gets its share
+	size_t idle = 0;
+	while (idle < _lanes.size()) {
+		size_t index = _nextLane;
+		Lane  &lane = _lanes[index];
+		_nextLane = (_nextLane + 1) % _lanes.size();
+		if (lane.queue.empty() || !hasSlot(lane)) {
+			++idle;
+			continue;
+		}
+		CGIProcess *process = lane.queue.front();
+		lane.queue.pop_front();
+		start(process, index);
+		idle = 0;
+	}
+}
+
+std::string CGIScheduler::report() const {
+	size_t		  queued = 0;
+	unsigned long started = 0, rejected = 0, expired = 0;
+	for (std::vector<Lane>::const_iterator it = _lanes.begin(); it != _lanes.end(); ++it) {
+		queued += it->queue.size();
+		started += it->started;
+		rejected += it->rejected;
+		expired += it->expired;
+	}
+
+	std::ostringstream out;
+	out << "cgi_running " << _running << "\n"
+		<< "cgi_max_processes " << (_maxRunning ? _maxRunning : CGI_MAX_PROCESSES) << "\n"
+		<< "cgi_queued " << queued << "\n"
+		<< "cgi_started " << started << "\n"
+		<< "cgi_rejected " << rejected << "\n"
+		<< "cgi_expired " << expired << "\n";
+	for (std::vector<Lane>::const_iterator it = _lanes.begin(); it != _lanes.end(); ++it) {
+		if (!it->started && !it->rejected && !it->expired && !it->maxRunning)
+			continue; // Locations that never ran a script
+		out << "location " << it->name << ": running " << it->running;
+		if (it->maxRunning)
+			out << "/" << it->maxRunning;
+		out << " queued " << it->queue.size() << "/" << it->maxQueued << " started " << it->started
+			<< " rejected " << it->rejected << " expired " << it->expired << "\n";
+	}
+	return out.str();
+}
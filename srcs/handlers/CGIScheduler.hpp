@@ -0,0 +1,83 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIScheduler.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 14:12:09 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 14:12:09 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_SCHEDULER_HPP
+#define CGI_SCHEDULER_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include "../utils/Logger.hpp"
+#include <deque>
+
+class CGIProcess;
+
+// Admission control for forked CGI children. The process as a whole runs at
+// most cgi_max_processes of them (the lowest value any server block sets)
+// and each location may cap its own share. A launch that finds no free slot
+// waits in its location's bounded FIFO queue; freed slots are handed to the
+// queues round-robin, so one busy script endpoint cannot take every slot
+// while the others wait.
+class CGIScheduler {
+	public:
+		enum Admission {
+			ADMIT_STARTED,	// Child launched (or failed to; the job reports it)
+			ADMIT_QUEUED,	// Waiting for a slot
+			ADMIT_REJECTED	// Queue full
+		};
+
+		static CGIScheduler &getInstance();
+
+		// Called on (re)load: forget the old process limit, then let every
+		// server register its locations and lower it
+		void resetLimit();
+		void configure(ServerConfig &config);
+
+		Admission admit(CGIProcess *process, size_t lane);
+		// A queued launch gave up (queue timeout, client gone)
+		void cancel(CGIProcess *process, size_t lane, bool isExpired);
+		// A running child exited or was killed
+		void finished(size_t lane);
+
+		// Plain-text counters for the "cgi_status" location
+		std::string report() const;
+
+	private:
+		struct Lane {
+			std::string name;		// "port location"
+			size_t maxRunning;		// 0: only the process limit applies
+			size_t maxQueued;
+			size_t running;
+			std::deque<CGIProcess *> queue;
+			unsigned long started;
+			unsigned long rejected;	// Queue was full
+			unsigned long expired;	// Waited longer than cgi_queue_timeout
+		};
+
+		static CGIScheduler *_instance;
+		static Logger &_logger;
+
+		size_t _maxRunning;
+		size_t _running;
+		std::vector<Lane> _lanes;
+		std::map<std::string, size_t> _laneIndex;
+		size_t _nextLane;			// Round-robin position for freed slots
+
+		CGIScheduler();
+		bool hasSlot(const Lane &lane) const;
+		bool start(CGIProcess *process, size_t lane);
+		void dispatch();
+
+		CGIScheduler(const CGIScheduler &);
+		CGIScheduler &operator=(const CGIScheduler &);
+};
+
+#endif
@@ -0,0 +1,203 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIWorkerPool.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/19 11:02:36 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/19 11:02:36 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIWorkerPool.hpp"
+#include "CGIWorkerRequest.hpp"
+
+#define WORKER_FD 3 // Where the worker finds its end of the socketpair
+
+std::map<std::string, CGIWorkerPool *> CGIWorkerPool::_pools;
+std::set<pid_t>						   CGIWorkerPool::_retired;
+Logger								 &CGIWorkerPool::_logger = Logger::getInstance();
+
+CGIWorkerPool::CGIWorkerPool(const LocationConfig &location) :
+		_interpreter(location.cgi_path),
+		_wrapper(location.cgi_worker),
+		_minWorkers(location.cgi_workers_min),
+		_maxWorkers(location.cgi_workers_max),
+		_maxRequests(location.cgi_worker_requests),
+		_idleTimeout(location.cgi_worker_idle) {
+}
+
+CGIWorkerPool *CGIWorkerPool::get(const LocationConfig &location) {
+	std::string key = location.path + '\0' + location.cgi_path + '\0' + location.cgi_worker;
+
+	std::map<std::string, CGIWorkerPool *>::iterator it = _pools.find(key);
+	if (it != _pools.end())
+		return it->second;
+	CGIWorkerPool *pool = new CGIWorkerPool(location);
+	_pools[key] = pool;
+	while (pool->_workers.size() < pool->_minWorkers && pool->spawn()) {
+	}
+	return pool;
+}
+
+void CGIWorkerPool::maintainAll() {
+	static time_t lastRun = 0;
+	time_t		  now = time(NULL);
+	if (now == lastRun)
+		return;
+	lastRun = now;
+	for (std::map<std::string, CGIWorkerPool *>::iterator it = _pools.begin(); it != _pools.end(); ++it)
+		it->second->maintain(now);
+}
+
+bool CGIWorkerPool::submit(CGIWorkerRequest *request) {
+	_queue.push_back(request);
+	dispatch();
+	if (_workers.empty()) { // Could not start a single worker
+		cancel(request);
+		return false;
+	}
+	return true;
+}
+
+void CGIWorkerPool::cancel(CGIWorkerRequest *request) {
+	std::deque<CGIWorkerRequest *>::iterator it = std::find(_queue.begin(), _queue.end(), request);
+	if (it != _queue.end())
+		_queue.erase(it);
+}
+
+void CGIWorkerPool::release(int fd, bool reusable) {
+	size_t index = findWorker(fd);
+	if (index == _workers.size())
+		return;
+	Worker &worker = _workers[index];
+	worker.isBusy = false;
+	worker.lastUsed = time(NULL);
+	if (!reusable || ++worker.served >= _maxRequests)
+		retire(index); // The wrapper exits on EOF and reapWorkers() collects it
+	dispatch();
+}
+
+void CGIWorkerPool::discard(int fd) {
+	size_t index = findWorker(fd);
+	if (index == _workers.size())
+		return;
+	kill(_workers[index].pid, SIGKILL);
+	retire(index);
+	dispatch();
+}
+
+bool CGIWorkerPool::spawn() {
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		_logger.error("CGI worker socketpair failed: " + std::string(strerror(errno)));
+		return false;
+	}
+	fcntl(sv[0], F_SETFD, FD_CLOEXEC); // Siblings must not hold each other's sockets
+	fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		_logger.error("CGI worker fork failed: " + std::string(strerror(errno)));
+		close(sv[0]);
+		close(sv[1]);
+		return false;
+	}
+	if (pid == 0) {
+		// Keep only stdio and the request socket: a long-lived worker holding
+		// client sockets would keep those connections open
+		dup2(sv[1], WORKER_FD);
+		fcntl(WORKER_FD, F_SETFD, 0);
+		int devNull = open("/dev/null", O_RDONLY);
+		if (devNull >= 0)
+			dup2(devNull, STDIN_FILENO);
+		long maxFd = std::min(sysconf(_SC_OPEN_MAX), 65536L);
+		for (int fd = WORKER_FD + 1; fd < maxFd; ++fd) close(fd);
+		execl(_interpreter.c_str(), _interpreter.c_str(), _wrapper.c_str(), static_cast<char *>(NULL));
+		_exit(127);
+	}
+
+	close(sv[1]);
+	fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL, 0) | O_NONBLOCK);
+	Worker worker = {pid, sv[0], 0, time(NULL), false, false};
+	_workers.push_back(worker);
+	_logger.info("Started CGI worker " + Utils::numToString(pid) + ": " + _interpreter + " " + _wrapper);
+	return true;
+}
+
+void CGIWorkerPool::dispatch() {
+	while (!_queue.empty()) {
+		size_t index = 0;
+		while (index < _workers.size()) {
+			if (!_workers[index].isBusy && !isAlive(_workers[index].fd)) {
+				retire(index); // Died while idle
+				continue;
+			}
+			if (!_workers[index].isBusy)
+				break;
+			++index;
+		}
+		if (index == _workers.size() && (_workers.size() >= _maxWorkers || !spawn()))
+			return; // Everyone is busy: requests wait their turn instead of forking more
+
+		_workers[index].isBusy = true;
+		CGIWorkerRequest *request = _queue.front();
+		_queue.pop_front();
+		request->assign(_workers[index].fd);
+	}
+}
+
+void CGIWorkerPool::maintain(time_t now) {
+	for (size_t i = 0; i < _workers.size();) {
+		const Worker &worker = _workers[i];
+		if (_workers.size() > _minWorkers && !worker.isBusy && now - worker.lastUsed > _idleTimeout)
+			retire(i);
+		else
+			++i;
+	}
+	while (_workers.size() < _minWorkers && spawn()) {
+	}
+}
+
+void CGIWorkerPool::reapWorkers() {
+	int status;
+	for (std::map<std::string, CGIWorkerPool *>::iterator it = _pools.begin(); it != _pools.end(); ++it) {
+		std::vector<Worker> &workers = it->second->_workers;
+		for (size_t i = 0; i < workers.size(); ++i) {
+			if (workers[i].hasExited || waitpid(workers[i].pid, &status, WNOHANG) != workers[i].pid)
+				continue;
+			// Its socket reports EOF: dispatch() or the request on it retires it
+			workers[i].hasExited = true;
+			_logger.warn("CGI worker " + Utils::numToString(workers[i].pid) + " exited with status " +
+						 Utils::numToString(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status)));
+		}
+	}
+	for (std::set<pid_t>::iterator it = _retired.begin(); it != _retired.end();) {
+		if (waitpid(*it, &status, WNOHANG) != 0)
+			_retired.erase(it++); // Reaped, or not ours to wait for anymore
+		else
+			++it;
+	}
+}
+
+void CGIWorkerPool::retire(size_t index) {
+	if (!_workers[index].hasExited)
+		_retired.insert(_workers[index].pid);
+	close(_workers[index].fd);
+	_workers.erase(_workers.begin() + index);
+}
+
+size_t CGIWorkerPool::findWorker(int fd) const {
+	for (size_t i = 0; i < _workers.size(); ++i)
+		if (_workers[i].fd == fd)
+			return i;
+	return _workers.size();
+}
+
+bool CGIWorkerPool::isAlive(int fd) {
+	// An idle worker has nothing to say; EOF or stray bytes mean it is unusable
+	char	probe;
+	ssize_t bytes = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+	return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
@@ -0,0 +1,79 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIWorkerPool.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/19 11:02:36 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/19 11:02:36 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_WORKER_POOL_HPP
+#define CGI_WORKER_POOL_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include "../utils/Logger.hpp"
+#include <deque>
+
+class CGIWorkerRequest;
+
+// Long-lived interpreter processes for one location ("cgi_pass" running the
+// "cgi_worker" wrapper), so scripts run without a fork+exec per hit. Each
+// worker owns one end of a socketpair (fd 3 in the worker) and serves one
+// request at a time. Requests beyond cgi_workers max wait in a FIFO queue.
+class CGIWorkerPool {
+	public:
+		// Pool of a location, created (and preforked to its minimum) on first use
+		static CGIWorkerPool *get(const LocationConfig &location);
+		// Idle reaping and minimum size upkeep, at most once per second
+		static void maintainAll();
+		// Collect exited workers (called when the SIGCHLD pipe fires)
+		static void reapWorkers();
+
+		// Queue a request and dispatch it if a worker is free; false if none can start
+		bool submit(CGIWorkerRequest *request);
+		void cancel(CGIWorkerRequest *request);
+		// Worker finished its request cleanly (reusable) or left its stream unusable
+		void release(int fd, bool reusable);
+		// Worker misbehaved or timed out: kill it
+		void discard(int fd);
+
+	private:
+		struct Worker {
+			pid_t pid;
+			int fd;
+			size_t served;
+			time_t lastUsed;
+			bool isBusy;
+			bool hasExited;
+		};
+
+		static std::map<std::string, CGIWorkerPool *> _pools;
+		static std::set<pid_t> _retired;	// Let go of, not reaped yet
+		static Logger &_logger;
+
+		std::string _interpreter;
+		std::string _wrapper;
+		size_t _minWorkers;
+		size_t _maxWorkers;
+		size_t _maxRequests;
+		time_t _idleTimeout;
+		std::vector<Worker> _workers;
+		std::deque<CGIWorkerRequest *> _queue;
+
+		explicit CGIWorkerPool(const LocationConfig &location);
+		bool spawn();
+		void dispatch();
+		void maintain(time_t now);
+		void retire(size_t index);
+		size_t findWorker(int fd) const;
+		static bool isAlive(int fd);
+
+		CGIWorkerPool(const CGIWorkerPool &);
+		CGIWorkerPool &operator=(const CGIWorkerPool &);
+};
+
+#endif
@@ -0,0 +1,151 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIWorkerRequest.cpp                               :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/19 11:40:05 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/19 11:40:05 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIWorkerRequest.hpp"
+
+CGIWorkerRequest::CGIWorkerRequest(CGIWorkerPool *pool, const std::string &environment, const std::string &body,
+								   int rawFd) :
+		CGIJob(rawFd),
+		_pool(pool),
+		_workerFd(-1),
+		_isQueued(true),
+		_sendBuffer(frame(environment) + frame(body)),
+		_sendOffset(0),
+		_isEnded(false),
+		_isTimedOut(false),
+		_isFailed(false) {
+	if (!_pool->submit(this)) {
+		_isQueued = false;
+		fail("no worker could be started");
+	}
+}
+
+CGIWorkerRequest::~CGIWorkerRequest() {
+	if (_isQueued)
+		_pool->cancel(this);
+	else if (_workerFd >= 0) // Abandoned mid-request: the worker's stream is out of sync
+		_pool->discard(_workerFd);
+}
+
+void CGIWorkerRequest::assign(int workerFd) {
+	_isQueued = false;
+	_workerFd = workerFd;
+}
+
+int CGIWorkerRequest::getReadFd() const {
+	return _workerFd;
+}
+
+int CGIWorkerRequest::getWriteFd() const {
+	return (_workerFd >= 0 && _sendOffset < _sendBuffer.length()) ? _workerFd : -1;
+}
+
+void CGIWorkerRequest::onWritable() {
+	while (_workerFd >= 0 && _sendOffset < _sendBuffer.length()) {
+		ssize_t sent =
+			send(_workerFd, _sendBuffer.data() + _sendOffset, _sendBuffer.length() - _sendOffset, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				fail("send: " + std::string(strerror(errno)));
+			return;
+		}
+		_sendOffset += sent;
+	}
+	if (_sendOffset >= _sendBuffer.length())
+		std::string().swap(_sendBuffer); // Drop the request body early
+}
+
+void CGIWorkerRequest::onReadable() {
+	char buffer[CGI_BUFSIZE];
+
+	// Bounded so a chatty script cannot monopolise the loop
+	for (int i = 0; i < 4 && _workerFd >= 0; ++i) {
+		ssize_t bytes = recv(_workerFd, buffer, sizeof(buffer), 0);
+		if (bytes > 0) {
+			_recvBuffer.append(buffer, bytes);
+			if (!processFrames())
+				return;
+			continue;
+		}
+		if (bytes == 0)
+			fail("worker exited mid-request");
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			fail("recv: " + std::string(strerror(errno)));
+		return;
+	}
+}
+
+void CGIWorkerRequest::timeout() {
+	_logger.error("CGI worker timeout");
+	_isTimedOut = true;
+	if (_isQueued) {
+		_pool->cancel(this);
+		_isQueued = false;
+	} else if (_workerFd >= 0) {
+		_pool->discard(_workerFd);
+		_workerFd = -1;
+	}
+}
+
+bool CGIWorkerRequest::isDone() const {
+	return _isTimedOut || _isFailed || _isEnded;
+}
+
+void CGIWorkerRequest::complete(Response &response) {
+	if (_isTimedOut)
+		setError(response, 504, "CGI Timeout");
+	else if (_isFailed)
+		setError(response, 500, "CGI worker failed");
+	else if (!parseOutput(response))
+		setError(response, 500, "Invalid CGI output");
+}
+
+bool CGIWorkerRequest::processFrames() {
+	while (_recvBuffer.length() >= 4) {
+		const unsigned char *header = reinterpret_cast<const unsigned char *>(_recvBuffer.data());
+		size_t length = (static_cast<size_t>(header[0]) << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+		if (_recvBuffer.length() < 4 + length)
+			return true;
+		if (length == 0) { // End of this response
+			_recvBuffer.erase(0, 4);
+			_isEnded = true;
+			_pool->release(_workerFd, _recvBuffer.empty());
+			_workerFd = -1;
+			return false;
+		}
+		if (!appendOutput(_recvBuffer.data() + 4, length)) {
+			fail("cannot spool output");
+			return false;
+		}
+		_recvBuffer.erase(0, 4 + length);
+	}
+	return true;
+}
+
+void CGIWorkerRequest::fail(const std::string &reason) {
+	_logger.error("CGI worker: " + reason);
+	_isFailed = true;
+	if (_workerFd >= 0) {
+		_pool->discard(_workerFd);
+		_workerFd = -1;
+	}
+}
+
+std::string CGIWorkerRequest::frame(const std::string &data) {
+	size_t		length = data.length();
+	std::string framed(4, '\0');
+	framed[0] = (length >> 24) & 0xff;
+	framed[1] = (length >> 16) & 0xff;
+	framed[2] = (length >> 8) & 0xff;
+	framed[3] = length & 0xff;
+	return framed + data;
+}
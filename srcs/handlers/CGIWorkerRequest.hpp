@@ -0,0 +1,57 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIWorkerRequest.hpp                               :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/19 11:40:05 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/19 11:40:05 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGI_WORKER_REQUEST_HPP
+#define CGI_WORKER_REQUEST_HPP
+
+#include "CGIJob.hpp"
+#include "CGIWorkerPool.hpp"
+
+// One script run on a pooled CGI worker. Framing on the worker socket, every
+// length a 4-byte big-endian prefix:
+//   server -> worker: [env block "KEY=VALUE\0..."] [request body]
+//   worker -> server: [output chunk]... [empty chunk ends the response]
+// Until the pool assigns a worker the request waits without descriptors.
+class CGIWorkerRequest : public CGIJob {
+	public:
+		CGIWorkerRequest(CGIWorkerPool *pool, const std::string &environment, const std::string &body, int rawFd);
+
+		// Called by the pool when a worker is free
+		void assign(int workerFd);
+
+		int getReadFd() const;
+		int getWriteFd() const;
+		void onReadable();
+		void onWritable();
+		void timeout();
+		bool isDone() const;
+		void complete(Response &response);
+
+	private:
+		CGIWorkerPool *_pool;
+		int _workerFd;
+		bool _isQueued;
+		std::string _sendBuffer;
+		size_t _sendOffset;
+		std::string _recvBuffer;
+		bool _isEnded;
+		bool _isTimedOut;
+		bool _isFailed;
+
+		~CGIWorkerRequest();
+		bool processFrames();
+		void fail(const std::string &reason);
+
+		static std::string frame(const std::string &data);
+};
+
+#endif
@@ -19,15 +19,25 @@
 
 class DirectoryHandler {
 	public:
-		static Response handleDirectory(const std::string &dirPath, const LocationConfig &location, const std::string &requestPath, const ServerConfig *config);
-		static std::string createListing(const std::string &path, const std::string &urlPath);
+		// HTML index of the directory open on dirFd (st its fstat), linked
+		// under urlPath; "" if it cannot be read. Served from ListingCache
+		static std::string createListing(int dirFd, const struct stat &st, const std::string &urlPath);
+
+		// Pieces of the page, for ListingCache: head and parent link, one row per entry, foot
+		static void beginPage(const std::string &urlPath, std::string &page);
+		static std::string createRow(const std::string &name, const struct stat &st, const std::string &urlPath);
+		static void endPage(std::string &page);
+		// The same for autoindex_format json
+		static void beginJson(const std::string &urlPath, std::string &output);
+		static std::string createJsonEntry(const std::string &name, const struct stat &st);
+		static void endJson(size_t total, size_t page, size_t pageSize, std::string &output);
+		// "/dir" for "dir/": how the pieces above expect urlPath
+		static std::string displayPath(const std::string &urlPath);
 
 	private:
-		static std::string createListingHeader(const std::string &urlPath);
-		static std::string createDeleteScript();
 		static std::string formatFileSize(const struct stat &st);
 		static std::string formatModTime(const struct stat &st);
-		static std::string createListingBody(DIR *dir, const std::string &path, const std::string &urlPath);
+		static std::string escapeJson(const std::string &value);
 };
 
 #endif
@@ -0,0 +1,92 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   DirectoryReader.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 19:30:11 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 19:30:11 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "DirectoryReader.hpp"
+
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef SYS_getdents64
+// The record getdents64 fills in, which no libc header declares
+struct LinuxDirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+#endif
+
+#define DIRENT_BATCH 256 // readdir() entries per batch
+
+DirectoryReader::DirectoryReader(int dirFd) : _dirFd(dirFd), _dir(NULL), _isDone(false), _isFailed(false) {
+#ifdef SYS_getdents64
+	if (lseek(_dirFd, 0, SEEK_SET) < 0)
+		_isFailed = true;
+#else
+	int fd = dup(_dirFd);
+	_dir = fd >= 0 ? fdopendir(fd) : NULL;
+	if (_dir)
+		rewinddir(_dir);
+	else {
+		if (fd >= 0)
+			close(fd);
+		_isFailed = true;
+	}
+#endif
+	_isDone = _isFailed;
+}
+
+DirectoryReader::~DirectoryReader() {
+	if (_dir)
+		closedir(_dir);
+}
+
+bool DirectoryReader::next(std::vector<std::string> &names) {
+	while (!_isDone) {
+		size_t count = names.size();
+#ifdef SYS_getdents64
+		uint64_t buffer[4096]; // 8-byte aligned, as the kernel writes the records
+		long	 length = syscall(SYS_getdents64, _dirFd, buffer, sizeof(buffer));
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length <= 0) {
+			_isFailed = length < 0;
+			_isDone = true;
+			break;
+		}
+		const char *records = reinterpret_cast<const char *>(buffer);
+		for (long pos = 0; pos < length;) {
+			const LinuxDirent64 *record = reinterpret_cast<const LinuxDirent64 *>(records + pos);
+			pos += record->d_reclen;
+			if (!isDotOrDotDot(record->d_name))
+				names.push_back(record->d_name);
+		}
+#else
+		struct dirent *record = NULL;
+		for (int i = 0; i < DIRENT_BATCH && (record = readdir(_dir)) != NULL; ++i)
+			if (!isDotOrDotDot(record->d_name))
+				names.push_back(record->d_name);
+		if (!record)
+			_isDone = true;
+#endif
+		if (names.size() > count)
+			return true;
+	}
+	return false;
+}
+
+bool DirectoryReader::isDotOrDotDot(const char *name) {
+	return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
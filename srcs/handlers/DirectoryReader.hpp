@@ -0,0 +1,42 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   DirectoryReader.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 19:30:11 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 19:30:11 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef DIRECTORY_READER_HPP
+#define DIRECTORY_READER_HPP
+
+#include "../WebServ.hpp"
+
+// Entry names of an open directory, a batch at a time: one getdents64 call
+// of up to 32KB of records on Linux, readdir() elsewhere. "." and ".." are
+// left out. The directory fd stays the caller's.
+class DirectoryReader {
+	public:
+		explicit DirectoryReader(int dirFd);
+		~DirectoryReader();
+
+		// Appends the next batch to names; false once there is none left
+		bool next(std::vector<std::string> &names);
+		bool isFailed() const { return _isFailed; }
+
+	private:
+		int _dirFd;
+		DIR *_dir;
+		bool _isDone;
+		bool _isFailed;
+
+		static bool isDotOrDotDot(const char *name);
+
+		DirectoryReader(const DirectoryReader &);
+		DirectoryReader &operator=(const DirectoryReader &);
+};
+
+#endif
@@ -0,0 +1,343 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FastCGIRequest.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/18 15:31:22 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/18 15:31:22 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FastCGIRequest.hpp"
+#include <netdb.h>
+#include <sys/un.h>
+
+// FastCGI 1.0 wire constants
+enum {
+	FCGI_VERSION_1 = 1,
+	FCGI_BEGIN_REQUEST = 1,
+	FCGI_END_REQUEST = 3,
+	FCGI_PARAMS = 4,
+	FCGI_STDIN = 5,
+	FCGI_STDOUT = 6,
+	FCGI_STDERR = 7,
+	FCGI_RESPONDER = 1,
+	FCGI_KEEP_CONN = 1,
+	FCGI_REQUEST_COMPLETE = 0,
+	FCGI_HEADER_LEN = 8,
+	FCGI_MAX_CONTENT = 65535,
+	FCGI_REQUEST_ID = 1 // One request in flight per connection
+};
+
+std::map<std::string, std::vector<int> > FastCGIRequest::_pool;
+
+FastCGIRequest::FastCGIRequest(const std::string &address, const std::string &environment,
+							   const std::string &body, int rawFd) :
+		CGIJob(rawFd),
+		_address(address),
+		_params(encodeParams(environment)),
+		_body(body),
+		_fd(-1),
+		_isConnecting(false),
+		_isReused(false),
+		_sendOffset(0),
+		_stdinOffset(0),
+		_isStdinDone(false),
+		_hasResponse(false),
+		_isEnded(false),
+		_isTimedOut(false),
+		_isFailed(false) {
+	if (!start())
+		fail("cannot connect");
+}
+
+FastCGIRequest::~FastCGIRequest() {
+	if (_fd >= 0) // Abandoned mid-request: the backend may still answer, never pool it
+		close(_fd);
+}
+
+int FastCGIRequest::getReadFd() const {
+	return (_fd >= 0 && !_isConnecting) ? _fd : -1;
+}
+
+int FastCGIRequest::getWriteFd() const {
+	if (_fd < 0)
+		return -1;
+	return (_isConnecting || _sendOffset < _sendBuffer.length() || !_isStdinDone) ? _fd : -1;
+}
+
+void FastCGIRequest::onWritable() {
+	if (_isConnecting) {
+		int		  error = 0;
+		socklen_t length = sizeof(error);
+		if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+			fail("connect: " + std::string(strerror(error ? error : errno)));
+			return;
+		}
+		_isConnecting = false;
+	}
+
+	while (_fd >= 0) {
+		if (_sendOffset >= _sendBuffer.length()) {
+			refillSendBuffer();
+			if (_sendBuffer.empty())
+				return;
+		}
+		ssize_t sent = send(_fd, _sendBuffer.data() + _sendOffset, _sendBuffer.length() - _sendOffset, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				fail("send: " + std::string(strerror(errno)));
+			return;
+		}
+		_sendOffset += sent;
+	}
+}
+
+void FastCGIRequest::onReadable() {
+	char buffer[CGI_BUFSIZE];
+
+	// Bounded so a chatty backend cannot monopolise the loop
+	for (int i = 0; i < 4 && _fd >= 0 && !_isEnded; ++i) {
+		ssize_t bytes = recv(_fd, buffer, sizeof(buffer), 0);
+		if (bytes > 0) {
+			_recvBuffer.append(buffer, bytes);
+			if (!processRecords())
+				return;
+			continue;
+		}
+		if (bytes == 0)
+			fail("backend closed the connection");
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			fail("recv: " + std::string(strerror(errno)));
+		return;
+	}
+}
+
+void FastCGIRequest::timeout() {
+	_logger.error("FastCGI Timeout on " + _address);
+	_isTimedOut = true;
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+}
+
+bool FastCGIRequest::isDone() const {
+	return _isTimedOut || _isFailed || _isEnded;
+}
+
+void FastCGIRequest::complete(Response &response) {
+	if (_isTimedOut)
+		setError(response, 504, "Gateway Timeout");
+	else if (_isFailed)
+		setError(response, 502, "Bad Gateway");
+	else if (!parseOutput(response))
+		setError(response, 502, "Invalid FastCGI output");
+}
+
+bool FastCGIRequest::start() {
+	// BEGIN_REQUEST body: role (2 bytes), flags, 5 reserved bytes
+	const char begin[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+	_sendBuffer = makeRecord(FCGI_BEGIN_REQUEST, begin, sizeof(begin));
+	for (size_t offset = 0; offset < _params.length(); offset += FCGI_MAX_CONTENT) {
+		size_t length = std::min(static_cast<size_t>(FCGI_MAX_CONTENT), _params.length() - offset);
+		_sendBuffer += makeRecord(FCGI_PARAMS, _params.data() + offset, length);
+	}
+	_sendBuffer += makeRecord(FCGI_PARAMS, NULL, 0);
+	_sendOffset = 0;
+	_stdinOffset = 0;
+	_isStdinDone = false;
+	_recvBuffer.clear();
+	return connectBackend();
+}
+
+bool FastCGIRequest::connectBackend() {
+	_fd = takeIdleConnection(_address);
+	_isReused = (_fd >= 0);
+	_isConnecting = false;
+	if (_isReused)
+		return true;
+
+	struct sockaddr_storage addr = {};
+	socklen_t				addrLen = 0;
+	int						family = AF_INET;
+
+	if (_address.compare(0, 5, "unix:") == 0) {
+		struct sockaddr_un *unixAddr = reinterpret_cast<struct sockaddr_un *>(&addr);
+		std::string			path = _address.substr(5);
+		if (path.length() >= sizeof(unixAddr->sun_path))
+			return false;
+		family = AF_UNIX;
+		unixAddr->sun_family = AF_UNIX;
+		std::strcpy(unixAddr->sun_path, path.c_str());
+		addrLen = sizeof(struct sockaddr_un);
+	} else {
+		size_t colon = _address.rfind(':');
+		if (colon == std::string::npos)
+			return false;
+		struct addrinfo hints = {};
+		struct addrinfo *result = NULL;
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		std::string host = _address.substr(0, colon);
+		if (getaddrinfo(host.c_str(), _address.substr(colon + 1).c_str(), &hints, &result) != 0 || !result)
+			return false;
+		std::memcpy(&addr, result->ai_addr, result->ai_addrlen);
+		addrLen = result->ai_addrlen;
+		freeaddrinfo(result);
+	}
+
+	_fd = socket(family, SOCK_STREAM, 0);
+	if (_fd < 0)
+		return false;
+	fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+	fcntl(_fd, F_SETFD, FD_CLOEXEC);
+
+	if (connect(_fd, reinterpret_cast<struct sockaddr *>(&addr), addrLen) < 0) {
+		if (errno != EINPROGRESS && errno != EAGAIN) {
+			close(_fd);
+			_fd = -1;
+			return false;
+		}
+		_isConnecting = true; // Completion is reported as writability
+	}
+	return true;
+}
+
+void FastCGIRequest::fail(const std::string &reason) {
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+	// A pooled connection the backend closed while idle: replay on a fresh one
+	if (_isReused && !_hasResponse && start())
+		return;
+	_logger.error("FastCGI " + _address + ": " + reason);
+	_isFailed = true;
+}
+
+void FastCGIRequest::refillSendBuffer() {
+	_sendBuffer.clear();
+	_sendOffset = 0;
+	if (_isStdinDone)
+		return;
+	if (_stdinOffset < _body.length()) {
+		size_t length = std::min(static_cast<size_t>(FASTCGI_STDIN_CHUNK), _body.length() - _stdinOffset);
+		_sendBuffer = makeRecord(FCGI_STDIN, _body.data() + _stdinOffset, length);
+		_stdinOffset += length;
+	} else {
+		_sendBuffer = makeRecord(FCGI_STDIN, NULL, 0); // Empty record ends the stream
+		_isStdinDone = true;
+	}
+}
+
+bool FastCGIRequest::processRecords() {
+	while (_recvBuffer.length() >= FCGI_HEADER_LEN) {
+		const unsigned char *header = reinterpret_cast<const unsigned char *>(_recvBuffer.data());
+		size_t				 contentLength = (header[4] << 8) | header[5];
+		size_t				 recordLength = FCGI_HEADER_LEN + contentLength + header[6];
+		if (_recvBuffer.length() < recordLength)
+			return true;
+		if (header[0] != FCGI_VERSION_1) {
+			fail("unsupported protocol version");
+			return false;
+		}
+
+		int			requestId = (header[2] << 8) | header[3];
+		const char *content = _recvBuffer.data() + FCGI_HEADER_LEN;
+		_hasResponse = true;
+		if (requestId == FCGI_REQUEST_ID) { // Management records (id 0) are ignored
+			if (header[1] == FCGI_STDOUT) {
+				if (!appendOutput(content, contentLength)) {
+					fail("cannot spool output");
+					return false;
+				}
+			} else if (header[1] == FCGI_STDERR) {
+				_logger.warn("FastCGI stderr: " + std::string(content, contentLength));
+			} else if (header[1] == FCGI_END_REQUEST) {
+				if (contentLength < 8 || content[4] != FCGI_REQUEST_COMPLETE) {
+					fail("request rejected by backend");
+					return false;
+				}
+				_recvBuffer.erase(0, recordLength);
+				_isEnded = true;
+				// A backend that answered early (413, auth) has unread FCGI_STDIN on this stream
+				releaseConnection(_isStdinDone && _sendOffset == _sendBuffer.length() && _recvBuffer.empty());
+				return true;
+			}
+		}
+		_recvBuffer.erase(0, recordLength);
+	}
+	return true;
+}
+
+void FastCGIRequest::releaseConnection(bool keep) {
+	std::vector<int> &idle = _pool[_address];
+	if (keep && idle.size() < FASTCGI_MAX_IDLE)
+		idle.push_back(_fd);
+	else
+		close(_fd);
+	_fd = -1;
+}
+
+int FastCGIRequest::takeIdleConnection(const std::string &address) {
+	std::vector<int> &idle = _pool[address];
+	while (!idle.empty()) {
+		int fd = idle.back();
+		idle.pop_back();
+		// An idle connection must have nothing to read; EOF means the backend dropped it
+		char	probe;
+		ssize_t bytes = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+		if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return fd;
+		close(fd);
+	}
+	return -1;
+}
+
+std::string FastCGIRequest::makeRecord(unsigned char type, const char *data, size_t length) {
+	size_t		padding = (8 - length % 8) % 8;
+	std::string record(FCGI_HEADER_LEN, '\0');
+	record[0] = FCGI_VERSION_1;
+	record[1] = type;
+	record[2] = (FCGI_REQUEST_ID >> 8) & 0xff;
+	record[3] = FCGI_REQUEST_ID & 0xff;
+	record[4] = (length >> 8) & 0xff;
+	record[5] = length & 0xff;
+	record[6] = padding;
+	if (length)
+		record.append(data, length);
+	record.append(padding, '\0');
+	return record;
+}
+
+std::string FastCGIRequest::encodeParams(const std::string &environment) {
+	std::string encoded;
+	for (size_t offset = 0; offset < environment.length();) {
+		size_t end = environment.find('\0', offset);
+		if (end == std::string::npos)
+			end = environment.length();
+		size_t equals = environment.find('=', offset);
+		if (equals == std::string::npos || equals > end)
+			equals = end;
+		std::string name = environment.substr(offset, equals - offset);
+		std::string value = equals < end ? environment.substr(equals + 1, end - equals - 1) : "";
+		offset = end + 1;
+
+		size_t lengths[2] = {name.length(), value.length()};
+		for (int i = 0; i < 2; ++i) {
+			if (lengths[i] < 128) {
+				encoded += static_cast<char>(lengths[i]);
+			} else { // Four bytes, high bit set
+				encoded += static_cast<char>(((lengths[i] >> 24) & 0x7f) | 0x80);
+				encoded += static_cast<char>((lengths[i] >> 16) & 0xff);
+				encoded += static_cast<char>((lengths[i] >> 8) & 0xff);
+				encoded += static_cast<char>(lengths[i] & 0xff);
+			}
+		}
+		encoded += name + value;
+	}
+	return encoded;
+}
@@ -0,0 +1,72 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FastCGIRequest.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/18 15:31:22 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/18 15:31:22 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef FASTCGI_REQUEST_HPP
+#define FASTCGI_REQUEST_HPP
+
+#include "CGIJob.hpp"
+
+// One request to a FastCGI responder (php-fpm and friends), driven by the
+// event loop: BEGIN_REQUEST/PARAMS/STDIN go out as the socket accepts them,
+// STDOUT is spooled like CGI output until END_REQUEST. Backend connections
+// are opened with FCGI_KEEP_CONN and pooled per address; concurrent requests
+// spread over several pooled connections, one in flight on each, since
+// php-fpm does not multiplex requests on a single connection.
+class FastCGIRequest : public CGIJob {
+	public:
+		// address is "unix:/path" or "host:port"; environment is "NAME=value\0..."
+		FastCGIRequest(const std::string &address, const std::string &environment,
+					   const std::string &body, int rawFd);
+
+		int getReadFd() const;
+		int getWriteFd() const;
+		void onReadable();
+		void onWritable();
+		void timeout();
+		bool isDone() const;
+		void complete(Response &response);
+
+		static std::string encodeParams(const std::string &environment);
+
+	private:
+		// Idle keep-alive connections per backend address
+		static std::map<std::string, std::vector<int> > _pool;
+
+		std::string _address;
+		std::string _params;		// Encoded once, resent only if a pooled connection was stale
+		std::string _body;
+		int _fd;
+		bool _isConnecting;
+		bool _isReused;
+		std::string _sendBuffer;
+		size_t _sendOffset;
+		size_t _stdinOffset;
+		bool _isStdinDone;
+		std::string _recvBuffer;
+		bool _hasResponse;			// Any record received from the backend
+		bool _isEnded;
+		bool _isTimedOut;
+		bool _isFailed;
+
+		~FastCGIRequest();
+		bool start();
+		bool connectBackend();
+		void fail(const std::string &reason);
+		void refillSendBuffer();
+		bool processRecords();
+		void releaseConnection(bool keep);
+
+		static std::string makeRecord(unsigned char type, const char *data, size_t length);
+		static int takeIdleConnection(const std::string &address);
+};
+
+#endif
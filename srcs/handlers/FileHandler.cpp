@@ -11,127 +11,203 @@
 /* ************************************************************************** */
 
 #include "FileHandler.hpp"
-
-Response FileHandler::serveFile(const std::string &path, const std::string &urlPath) {
-	if (!isValidFilePath(path))
-		return Response(403, "Forbidden");
-
-	int fd = open(path.c_str(), O_RDONLY);
-	if (fd < 0)
-		return Response(404, "Not Found");
-
-	struct stat st;
-	if (fstat(fd, &st) < 0) {
-		close(fd);
-		return Response(500, "Internal Server Error");
+#include "UploadStream.hpp"
+
+Response FileHandler::serveFile(int fd, const struct stat &st, const std::string &path, const Request &request,
+								FileIO fileIO) {
+	std::string contentType = getType(path);
+	std::string etag = makeETag(st);
+	std::string lastModified = Utils::formatHttpDate(st.st_mtime);
+
+	// Byte ranges are only honoured while the validator in If-Range still matches
+	std::string rangeHeader = request.getHeader("Range");
+	if (!rangeHeader.empty() && isIfRangeSatisfied(request, etag, lastModified)) {
+		std::vector<ByteRange> ranges;
+		RangeResult			   result = parseRangeHeader(rangeHeader, st.st_size, ranges);
+		if (result == RANGE_UNSATISFIABLE) {
+			close(fd);
+			Response response = Response::makeErrorResponse(416);
+			response.addHeader("Content-Range", "bytes */" + Utils::numToString(st.st_size));
+			response.addHeader("Accept-Ranges", "bytes");
+			return response;
+		}
+		if (result == RANGE_SATISFIABLE) {
+			Response response = makeRangeResponse(fd, st, ranges, contentType, fileIO);
+			response.addHeader("ETag", etag);
+			response.addHeader("Last-Modified", lastModified);
+			return response;
+		}
 	}
 
 	Response response(200);
-	response.addHeader("Content-Type", getType(urlPath));
+	response.addHeader("Content-Type", contentType);
 	response.addHeader("Content-Length", Utils::numToString(st.st_size));
-	response.setFileDescriptor(fd);
+	response.addHeader("Accept-Ranges", "bytes");
+	response.addHeader("ETag", etag);
+	response.addHeader("Last-Modified", lastModified);
+	attachFile(response, fd, st, fileIO);
+	if (fileIO != FILE_IO_READ)
+		response.addFileSegment(0, st.st_size);
 
 	return response;
 }
 
-Response FileHandler::handleFileUpload(const Request &request, const LocationConfig &loc) {
-	std::string boundary = extractBoundary(request.getHeader("Content-Type"));
-	if (boundary.empty())
-		return Response(400, "Bad Request - Invalid Content-Type");
-
-	// Determine the upload path
-	std::string uploadPath;
-	if (!loc.root.empty()) {
-		uploadPath = loc.root;
-		if (uploadPath[uploadPath.length() - 1] != '/')
-			uploadPath += '/';
-		if (!loc.path.empty() && loc.path != "/") {
-			std::string pathComponent = loc.path;
-			if (pathComponent[0] == '/')
-				pathComponent = pathComponent.substr(1);
-			uploadPath += pathComponent;
+void FileHandler::attachFile(Response &response, int fd, const struct stat &st, FileIO fileIO) {
+	response.setFileIO(fileIO);
+	if (fileIO == FILE_IO_MMAP && st.st_size >= MMAP_MIN_SIZE && st.st_size <= MMAP_MAX_SIZE) {
+		MappedFile *mapping = MappedFile::acquire(fd, st);
+		if (mapping) {
+			response.setMappedFile(mapping);
+			return;
 		}
-	} else {
-		uploadPath = "www/upload"; // Default fallback
 	}
+	response.setFileDescriptor(fd);
+}
 
-	// Create directory if it doesn't exist
-	struct stat st;
-	if (stat(uploadPath.c_str(), &st) != 0) {
-		std::string mkdirCmd = "mkdir -p " + uploadPath;
-		if (system(mkdirCmd.c_str()) != 0)
-			return Response(500, "Internal Server Error - Cannot create upload directory");
-		// Set directory permissions
-		if (chmod(uploadPath.c_str(), 0755) != 0)
-			return Response(500, "Internal Server Error - Cannot set directory permissions");
+FileHandler::RangeResult FileHandler::parseRangeHeader(const std::string &header, off_t fileSize,
+														 std::vector<ByteRange> &ranges) {
+	if (header.compare(0, 6, "bytes=") != 0)
+		return RANGE_NONE;
+
+	std::istringstream specs(header.substr(6));
+	std::string		   spec;
+	size_t			   specCount = 0;
+
+	while (std::getline(specs, spec, ',')) {
+		spec = Utils::trim(spec);
+		if (spec.empty())
+			continue;
+		if (++specCount > MAX_RANGES)
+			return RANGE_NONE;
+
+		size_t dash = spec.find('-');
+		if (dash == std::string::npos)
+			return RANGE_NONE;
+		std::string firstStr = spec.substr(0, dash);
+		std::string lastStr = spec.substr(dash + 1);
+		if ((firstStr.empty() && lastStr.empty()) ||
+			firstStr.find_first_not_of("0123456789") != std::string::npos ||
+			lastStr.find_first_not_of("0123456789") != std::string::npos)
+			return RANGE_NONE;
+
+		// Saturate instead of overflowing on absurdly large positions
+		const off_t maxOffset = std::numeric_limits<off_t>::max() / 10 - 10;
+		off_t		first = 0;
+		off_t		last = 0;
+		for (size_t i = 0; i < firstStr.length() && first < maxOffset; ++i) first = first * 10 + (firstStr[i] - '0');
+		for (size_t i = 0; i < lastStr.length() && last < maxOffset; ++i) last = last * 10 + (lastStr[i] - '0');
+
+		ByteRange range;
+		if (firstStr.empty()) { // Suffix range: last N bytes
+			if (last == 0 || fileSize == 0)
+				continue;
+			range.first = last >= fileSize ? 0 : fileSize - last;
+			range.last = fileSize - 1;
+		} else {
+			if (!lastStr.empty() && last < first)
+				return RANGE_NONE;
+			if (first >= fileSize)
+				continue;
+			range.first = first;
+			range.last = (lastStr.empty() || last >= fileSize) ? fileSize - 1 : last;
+		}
+		ranges.push_back(range);
 	}
 
-	// Parse multipart form data
-	FileData fileData = parseMultipartData(request.getBody(), boundary);
-	if (!fileData.isValid)
-		return Response(400, "Bad Request - Invalid file data");
-
-	// Construct final file path
-	std::string filepath = uploadPath + "/" + fileData.filename;
-
-	// Save file
-	if (!saveUploadedFile(filepath, fileData.content))
-		return Response(500, "Internal Server Error - File save failed");
-
-	// Return success response
-	Response response(201);
-	response.addHeader("Content-Type", "text/plain");
-	response.setBody("File uploaded successfully");
-	return response;
+	if (specCount == 0)
+		return RANGE_NONE;
+	if (ranges.empty())
+		return RANGE_UNSATISFIABLE;
+
+	// Coalesce overlapping or adjacent ranges so a client cannot amplify the response
+	if (ranges.size() > 1) {
+		for (size_t i = 1; i < ranges.size(); ++i) {
+			ByteRange key = ranges[i];
+			size_t	  j = i;
+			for (; j > 0 && ranges[j - 1].first > key.first; --j) ranges[j] = ranges[j - 1];
+			ranges[j] = key;
+		}
+		std::vector<ByteRange> merged;
+		merged.push_back(ranges[0]);
+		for (size_t i = 1; i < ranges.size(); ++i) {
+			if (ranges[i].first <= merged.back().last + 1)
+				merged.back().last = std::max(merged.back().last, ranges[i].last);
+			else
+				merged.push_back(ranges[i]);
+		}
+		ranges.swap(merged);
+	}
+	return RANGE_SATISFIABLE;
 }
 
-std::string FileHandler::extractBoundary(const std::string &contentType) {
-	size_t boundaryPos = contentType.find("boundary=");
-	return (boundaryPos != std::string::npos) ? "--" + contentType.substr(boundaryPos + 9) : "";
+bool FileHandler::isIfRangeSatisfied(const Request &request, const std::string &etag,
+									 const std::string &lastModified) {
+	if (!request.hasHeader("If-Range"))
+		return true;
+	std::string validator = request.getHeader("If-Range");
+	if (!validator.empty() && (validator[0] == '"' || validator.compare(0, 2, "W/") == 0))
+		return validator == etag; // Weak validators never match (strong comparison)
+	return validator == lastModified;
 }
 
-FileHandler::FileData FileHandler::parseMultipartData(const std::string &body, const std::string &boundary) {
-	FileData data;
-	size_t	 partStart = body.find(boundary);
-	size_t	 headerStart = body.find("Content-Disposition:", partStart);
-	size_t	 filenamePos = body.find("filename=\"", headerStart);
-
-	if (partStart == std::string::npos || headerStart == std::string::npos || filenamePos == std::string::npos)
-		return data;
-
-	size_t filenameEnd = body.find("\"", filenamePos + 10);
-	data.filename = sanitizeFilename(body.substr(filenamePos + 10, filenameEnd - (filenamePos + 10)));
+Response FileHandler::makeRangeResponse(int fd, const struct stat &st, const std::vector<ByteRange> &ranges,
+										const std::string &contentType, FileIO fileIO) {
+	Response	response(206);
+	std::string totalSize = Utils::numToString(st.st_size);
+
+	response.addHeader("Accept-Ranges", "bytes");
+	attachFile(response, fd, st, fileIO);
+
+	if (ranges.size() == 1) {
+		const ByteRange &range = ranges[0];
+		response.addHeader("Content-Type", contentType);
+		response.addHeader("Content-Range", "bytes " + Utils::numToString(range.first) + "-" +
+												Utils::numToString(range.last) + "/" + totalSize);
+		response.addHeader("Content-Length", Utils::numToString(range.last - range.first + 1));
+		response.addFileSegment(range.first, range.last - range.first + 1);
+		return response;
+	}
 
-	size_t contentStart = body.find("\r\n\r\n", filenameEnd) + 4;
-	size_t contentEnd = body.find(boundary, contentStart) - 2;
-	data.content = body.substr(contentStart, contentEnd - contentStart);
-	data.isValid = true;
+	// Several ranges: multipart/byteranges with every part sliced straight from the file
+	std::ostringstream boundary;
+	boundary << "webserv_" << std::hex << (unsigned long)st.st_ino << (unsigned long)st.st_mtime
+			 << (unsigned long)time(NULL);
+
+	off_t contentLength = 0;
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		std::string partHeader = "\r\n--" + boundary.str() + "\r\nContent-Type: " + contentType +
+								 "\r\nContent-Range: bytes " + Utils::numToString(ranges[i].first) + "-" +
+								 Utils::numToString(ranges[i].last) + "/" + totalSize + "\r\n\r\n";
+		off_t length = ranges[i].last - ranges[i].first + 1;
+		response.addDataSegment(partHeader);
+		response.addFileSegment(ranges[i].first, length);
+		contentLength += partHeader.length() + length;
+	}
+	std::string closing = "\r\n--" + boundary.str() + "--\r\n";
+	response.addDataSegment(closing);
+	contentLength += closing.length();
 
-	return data;
+	response.addHeader("Content-Type", "multipart/byteranges; boundary=" + boundary.str());
+	response.addHeader("Content-Length", Utils::numToString(contentLength));
+	return response;
 }
 
-bool FileHandler::saveUploadedFile(const std::string &filepath, const std::string &content) {
-	const size_t CHUNK_SIZE = 65536;
-	int			 fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-	if (fd < 0)
-		return false;
-
-	size_t remaining = content.length();
-	size_t offset = 0;
-
-	while (remaining > 0) {
-		size_t	chunk = std::min(remaining, CHUNK_SIZE);
-		ssize_t written = write(fd, content.c_str() + offset, chunk);
-		if (written < 0) {
-			close(fd);
-			return false;
-		}
-		offset += written;
-		remaining -= written;
-	}
+std::string FileHandler::makeETag(const struct stat &st) {
+	std::ostringstream etag;
+	etag << "\"" << std::hex << (unsigned long)st.st_mtime << "-" << (unsigned long)st.st_size << "\"";
+	return etag.str();
+}
 
-	close(fd);
-	return true;
+Response FileHandler::handleFileUpload(const Request &request, const LocationConfig &loc) {
+	// Streamed from the socket by the server, already on disk
+	if (request.getBodySink())
+		return request.getBodySink()->finish(NULL);
+
+	// Body buffered whole: through the same parser, in one piece
+	UploadStream upload(loc);
+	if (upload.begin(request.getHeader("Content-Type")))
+		upload.feed(request.getBody().data(), request.getBody().length());
+	return upload.finish(NULL);
 }
 
 Response FileHandler::handleFileDelete(const Request &request, const LocationConfig &loc) {
@@ -152,16 +228,13 @@ Response FileHandler::handleFileDelete(const Request &request, const LocationCon
 
 std::string FileHandler::urlDecode(const std::string &encoded) {
 	std::string decoded;
+	decoded.reserve(encoded.length());
 	for (size_t i = 0; i < encoded.length(); ++i) {
-		if (encoded[i] == '%' && i + 2 < encoded.length()) {
-			int				   value;
-			std::istringstream iss(encoded.substr(i + 1, 2));
-			if (iss >> std::hex >> value) {
-				decoded += static_cast<char>(value);
-				i += 2;
-			} else {
-				decoded += encoded[i];
-			}
+		int high, low;
+		if (encoded[i] == '%' && i + 2 < encoded.length() && (high = Utils::hexDigit(encoded[i + 1])) >= 0 &&
+			(low = Utils::hexDigit(encoded[i + 2])) >= 0) {
+			decoded += static_cast<char>(high << 4 | low);
+			i += 2;
 		} else if (encoded[i] == '+') {
 			decoded += ' ';
 		} else {
@@ -171,36 +244,34 @@ std::string FileHandler::urlDecode(const std::string &encoded) {
 	return decoded;
 }
 
-std::string FileHandler::sanitizeFilename(const std::string &filename) {
-	std::string safe;
-	for (size_t i = 0; i < filename.length(); i++) {
-		char c = filename[i];
-		if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == ' ')
-			safe += c;
-	}
-	return safe;
-}
-
-std::string FileHandler::constructFilePath(const std::string &uri, const LocationConfig &location) {
-	std::string decodedUri = urlDecode(uri);
+std::string FileHandler::locationDirectory(const LocationConfig &location) {
 	std::string path = location.root;
+	// A regex location has no path of its own: the whole URI goes under its root
+	std::string locationPrefix = location.isRegex() ? "" : location.path;
 	// Remove trailing slash from root if present
 	if (!path.empty() && path[path.length() - 1] == '/')
 		path = path.substr(0, path.length() - 1);
 	// For non-root locations in www directory
-	if (location.path != "/" && !location.path.empty() && location.root == "www") {
-		std::string locationPath = location.path;
+	if (locationPrefix != "/" && !locationPrefix.empty() && location.root == "www") {
+		std::string locationPath = locationPrefix;
 		if (locationPath[0] == '/')
 			locationPath = locationPath.substr(1);
 		if (!path.empty() && path[path.length() - 1] != '/')
 			path += '/';
 		path += locationPath;
 	}
+	return path;
+}
+
+std::string FileHandler::constructFilePath(const std::string &uri, const LocationConfig &location) {
+	std::string decodedUri = urlDecode(uri);
+	std::string path = locationDirectory(location);
+	std::string locationPrefix = location.isRegex() ? "" : location.path;
 	// Process the relative path
 	std::string relativePath;
-	if (decodedUri.find(location.path) == 0) {
-		if (decodedUri != location.path) {
-			relativePath = decodedUri.substr(location.path.length());
+	if (decodedUri.find(locationPrefix) == 0) {
+		if (decodedUri != locationPrefix) {
+			relativePath = decodedUri.substr(locationPrefix.length());
 			if (!relativePath.empty() && relativePath[0] == '/')
 				relativePath = relativePath.substr(1);
 		}
@@ -214,22 +285,6 @@ std::string FileHandler::constructFilePath(const std::string &uri, const Locatio
 	return path;
 }
 
-bool FileHandler::isValidFilePath(const std::string &path) {
-	if (path.find("..") != std::string::npos)
-		return false;
-
-	struct stat st;
-	if (stat(path.c_str(), &st) != 0)
-		return false;
-
-	// Allow execute permission for .bla files
-	if (path.find(".bla") != std::string::npos) {
-		return (access(path.c_str(), R_OK | X_OK) == 0);
-	}
-
-	return (access(path.c_str(), R_OK) == 0);
-}
-
 std::string FileHandler::getType(const std::string &path) {
 	if (path == "/" || path.empty())
 		return "text/html";
@@ -20,25 +20,36 @@
 
 class FileHandler {
 	private:
-		struct FileData {
-			std::string filename;
-			std::string content;
-			bool isValid;
-			FileData() : isValid(false) {}
+		// Byte range handling (RFC 7233)
+		struct ByteRange {
+			off_t first;
+			off_t last;
 		};
+		enum RangeResult {
+			RANGE_NONE,			// No usable Range header, serve the full file
+			RANGE_SATISFIABLE,	// At least one range overlaps the file
+			RANGE_UNSATISFIABLE	// Valid header, but no range overlaps the file
+		};
+		static const size_t MAX_RANGES = 32;
+
+		static RangeResult parseRangeHeader(const std::string &header, off_t fileSize, std::vector<ByteRange> &ranges);
+		static bool isIfRangeSatisfied(const Request &request, const std::string &etag, const std::string &lastModified);
+		static Response makeRangeResponse(int fd, const struct stat &st, const std::vector<ByteRange> &ranges,
+										  const std::string &contentType, FileIO fileIO);
+		static void attachFile(Response &response, int fd, const struct stat &st, FileIO fileIO);
+		static std::string makeETag(const struct stat &st);
 
-		static std::string extractBoundary(const std::string &contentType);
-		static FileData parseMultipartData(const std::string &body, const std::string &boundary);
-		static bool saveUploadedFile(const std::string &filepath, const std::string &content);
-		static bool isValidFilePath(const std::string &path);
-		static std::string sanitizeFilename(const std::string &filename);
 		static std::string getType(const std::string &path);
 	public:
-		static Response serveFile(const std::string &path, const std::string &urlPath);
+		// Takes fd (from PathResolver) over; the extension of path picks the Content-Type
+		static Response serveFile(int fd, const struct stat &st, const std::string &path, const Request &request,
+								  FileIO fileIO = FILE_IO_READ);
 		static Response handleFileUpload(const Request &request, const LocationConfig &loc);
 		static Response handleFileDelete(const Request &request, const LocationConfig &loc);
 
 		static std::string constructFilePath(const std::string &uri, const LocationConfig &loc);
+		// Directory a location's URIs are looked up in
+		static std::string locationDirectory(const LocationConfig &loc);
 		static std::string urlDecode(const std::string &encoded);
 };
 
@@ -0,0 +1,129 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileTask.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 16:52:09 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 16:52:09 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FileTask.hpp"
+#include "../http/Compressor.hpp"
+#include "AIOPool.hpp"
+#include "FileHandler.hpp"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+FileTask::FileTask(Kind kind, const Request &request, const ServerConfig &config) :
+		CGIJob(-1),
+		_kind(kind),
+		_request(request),
+		_location(*request.getLocation()),
+		_config(&config),
+		_wantsGzip(false),
+		_sink(NULL),
+		_isAccepted(false),
+		_isFinished(false),
+		_isTimedOut(false) {
+	_request.setBodySink(NULL);
+	_request.clearBody();
+	_wakeFds[0] = _wakeFds[1] = -1;
+#ifdef __linux__
+	_wakeFds[0] = _wakeFds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+	if (pipe(_wakeFds) == 0) {
+		fcntl(_wakeFds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(_wakeFds[1], F_SETFD, FD_CLOEXEC);
+		fcntl(_wakeFds[0], F_SETFL, fcntl(_wakeFds[0], F_GETFL, 0) | O_NONBLOCK);
+	}
+#endif
+}
+
+FileTask::~FileTask() {
+	if (_target.file.fd >= 0) // Timed out before it was served
+		close(_target.file.fd);
+	if (_isAccepted)
+		delete _sink;
+	if (_wakeFds[0] >= 0)
+		close(_wakeFds[0]);
+	if (_wakeFds[1] >= 0 && _wakeFds[1] != _wakeFds[0])
+		close(_wakeFds[1]);
+}
+
+FileTask *FileTask::makeStatic(const Request &request, const ServerConfig &config) {
+	FileTask *task = new FileTask(FILE_STATIC, request, config);
+	task->_wantsGzip = task->_location.gzip_static && Compressor::acceptsGzip(request.getHeader("Accept-Encoding"));
+	return task;
+}
+
+FileTask *FileTask::makeDelete(const Request &request, const ServerConfig &config) {
+	return new FileTask(FILE_DELETE, request, config);
+}
+
+FileTask *FileTask::makePutFinish(const Request &request, BodySink *sink, const ServerConfig &config) {
+	FileTask *task = new FileTask(FILE_PUT_FINISH, request, config);
+	task->_sink = sink;
+	return task;
+}
+
+int FileTask::getReadFd() const {
+	return _wakeFds[0];
+}
+
+void FileTask::onReadable() {
+	// Only written once run() is over: isDone() reports it, nothing to drain
+}
+
+void FileTask::timeout() {
+	_isTimedOut = true;
+}
+
+bool FileTask::isDone() const {
+	return _isTimedOut || AIOPool::getInstance().isFinished(this);
+}
+
+void FileTask::complete(Response &response) {
+	if (_isTimedOut) {
+		setError(response, 504, "File operation timed out");
+		return;
+	}
+	Response done;
+	if (_kind == FILE_STATIC) {
+		done = RequestHandler(*_config).serveStatic(_request, _location, _target);
+		_target.file.fd = -1; // Taken over by the response
+	} else
+		done = _result;
+	done.mergeCookies(response); // Set by the handler on the placeholder response
+	response = done;
+}
+
+void FileTask::run() {
+	switch (_kind) {
+		case FILE_STATIC:
+			RequestHandler::findStatic(_request.getPath(), _location, _config->index,
+									   RequestHandler::streamsListing(_request, _location), _wantsGzip, _target);
+			break;
+		case FILE_DELETE:
+			_result = FileHandler::handleFileDelete(_request, _location);
+			break;
+		case FILE_PUT_FINISH:
+			_result = _sink->finish(_config);
+			break;
+	}
+}
+
+void FileTask::signal() {
+#ifdef __linux__
+	uint64_t one = 1;
+	ssize_t	 written = write(_wakeFds[1], &one, sizeof(one));
+#else
+	char	byte = 0;
+	ssize_t written = write(_wakeFds[1], &byte, 1);
+#endif
+	(void)written; // Full means it is already readable
+}
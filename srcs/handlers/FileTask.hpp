@@ -0,0 +1,73 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FileTask.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 16:52:09 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 16:52:09 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef FILE_TASK_HPP
+#define FILE_TASK_HPP
+
+#include "../http/BodySink.hpp"
+#include "../http/Request.hpp"
+#include "CGIJob.hpp"
+#include "RequestHandler.hpp"
+
+// The blocking half of a request to an "aio" location, run on an AIOPool
+// thread: resolving and opening a static file (with its index, autoindex
+// listing or .gz sidecar), unlinking for DELETE, renaming an uploaded PUT
+// body into place. The connection waits in CGI_RUNNING like it does for a
+// script, on the task's eventfd, and complete() then builds the response
+// on the event loop (MappedFile, Compressor and the rest are not shared
+// with the threads). run() only touches what the task owns.
+class FileTask : public CGIJob {
+	public:
+		enum Kind {
+			FILE_STATIC,
+			FILE_DELETE,
+			FILE_PUT_FINISH
+		};
+
+		// request is routed
+		static FileTask *makeStatic(const Request &request, const ServerConfig &config);
+		static FileTask *makeDelete(const Request &request, const ServerConfig &config);
+		// Takes sink over once the pool accepts the task
+		static FileTask *makePutFinish(const Request &request, BodySink *sink, const ServerConfig &config);
+
+		int getReadFd() const;
+		void onReadable();
+		void timeout();
+		bool isDone() const;
+		void complete(Response &response);
+
+		// On a pool thread
+		void run();
+		// Wakes the event loop; on a pool thread
+		void signal();
+
+	private:
+		friend class AIOPool;
+
+		Kind _kind;
+		Request _request;
+		LocationConfig _location;
+		const ServerConfig *_config;
+		int _wakeFds[2];			// eventfd twice, or a pipe
+		bool _wantsGzip;
+		BodySink *_sink;			// The connection's until the pool accepts the task
+		RequestHandler::StaticTarget _target;
+		Response _result;			// Of FILE_DELETE and FILE_PUT_FINISH
+		bool _isAccepted;			// Queued by the pool
+		bool _isFinished;			// Set by the pool, under its lock
+		bool _isTimedOut;
+
+		FileTask(Kind kind, const Request &request, const ServerConfig &config);
+		~FileTask();
+};
+
+#endif
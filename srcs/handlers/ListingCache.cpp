@@ -0,0 +1,226 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ListingCache.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 18:14:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 18:14:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ListingCache.hpp"
+#include "DirectoryHandler.hpp"
+#include "DirectoryReader.hpp"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+
+#define LISTING_WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB)
+#endif
+
+ListingCache *ListingCache::_instance = NULL;
+
+ListingCache::ListingCache() : _bytes(0), _inotifyFd(-1), _lostEvents(0) {
+	pthread_mutex_init(&_lock, NULL);
+#ifdef __linux__
+	_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+ListingCache &ListingCache::getInstance() {
+	if (!_instance)
+		_instance = new ListingCache();
+	return *_instance;
+}
+
+std::string ListingCache::get(int dirFd, const struct stat &st, const std::string &urlPath) {
+	Key key(st.st_dev, st.st_ino);
+	pthread_mutex_lock(&_lock);
+	readEvents();
+	std::map<Key, Listing *>::iterator it = _listings.find(key);
+	Listing *listing = it != _listings.end() ? it->second : NULL;
+	if (listing && listing->urlPath == urlPath && isCurrent(*listing, st)) {
+		if (!listing->changed.empty())
+			refresh(dirFd, *listing);
+		_lru.splice(_lru.begin(), _lru, listing->lru);
+		std::string page = listing->page;
+		pthread_mutex_unlock(&_lock);
+		return page;
+	}
+	if (!listing) {
+		// Watched before it is read, so nothing changing meanwhile goes unnoticed
+		listing = new Listing();
+		listing->key = key;
+		_lru.push_front(listing);
+		listing->lru = _lru.begin();
+		_listings[key] = listing;
+	}
+	if (listing->watch < 0)
+		watch(dirFd, *listing);
+	listing->changed.clear(); // The read below sees all of it
+	unsigned long lostEvents = _lostEvents;
+	pthread_mutex_unlock(&_lock);
+
+	// Read unlocked: other directories are served meanwhile
+	std::map<std::string, Entry> entries;
+	if (!scan(dirFd, urlPath, entries))
+		return "";
+
+	pthread_mutex_lock(&_lock);
+	readEvents();
+	it = _listings.find(key);
+	if (it == _listings.end()) { // Dropped while it was read: answer without keeping it
+		pthread_mutex_unlock(&_lock);
+		Listing unlisted;
+		unlisted.urlPath = urlPath;
+		unlisted.entries.swap(entries);
+		render(unlisted);
+		return unlisted.page;
+	}
+	listing = it->second;
+	listing->entries.swap(entries);
+	listing->urlPath = urlPath;
+	listing->mtime = st.st_mtime;
+	listing->isRacy = st.st_mtime >= time(NULL) - 1;
+	listing->isReady = _lostEvents == lostEvents;
+	refresh(dirFd, *listing); // Entries that changed while it was read, then the page
+	_lru.splice(_lru.begin(), _lru, listing->lru);
+	std::string page = listing->page;
+	trim();
+	pthread_mutex_unlock(&_lock);
+	return page;
+}
+
+bool ListingCache::isCurrent(const Listing &listing, const struct stat &st) const {
+	if (!listing.isReady)
+		return false;
+	if (listing.watch >= 0)
+		return true; // Whatever changed is in listing.changed
+	return !listing.isRacy && listing.mtime == st.st_mtime;
+}
+
+// Hands what inotify reported to the listings it concerns
+void ListingCache::readEvents() {
+#ifdef __linux__
+	if (_inotifyFd < 0)
+		return;
+	char	buffer[4096];
+	ssize_t length;
+	while ((length = read(_inotifyFd, buffer, sizeof(buffer))) > 0) {
+		ssize_t pos = 0;
+		while (pos + static_cast<ssize_t>(sizeof(struct inotify_event)) <= length) {
+			struct inotify_event event;
+			std::memcpy(&event, buffer + pos, sizeof(event)); // The buffer is not aligned for it
+			const char *name = buffer + pos + sizeof(event);
+			pos += sizeof(event) + event.len;
+
+			if (event.mask & IN_Q_OVERFLOW) { // Events were dropped: read every directory again
+				++_lostEvents;
+				for (std::map<Key, Listing *>::iterator it = _listings.begin(); it != _listings.end(); ++it)
+					it->second->isReady = false;
+				continue;
+			}
+			std::map<int, Listing *>::iterator it = _watches.find(event.wd);
+			if (it == _watches.end())
+				continue;
+			Listing *listing = it->second;
+			if (event.mask & IN_IGNORED) { // Directory gone, or its watch removed
+				listing->watch = -1;
+				listing->isReady = false;
+				_watches.erase(it);
+			} else if (event.len > 0)
+				listing->changed.insert(std::string(name));
+		}
+	}
+#endif
+}
+
+// Stats the entries inotify named again, then renders the page
+void ListingCache::refresh(int dirFd, Listing &listing) {
+	_bytes -= sizeOf(listing);
+	for (std::set<std::string>::const_iterator it = listing.changed.begin(); it != listing.changed.end(); ++it) {
+		struct stat st;
+		if (fstatat(dirFd, it->c_str(), &st, 0) != 0) {
+			listing.entries.erase(*it);
+			continue;
+		}
+		Entry &entry = listing.entries[*it];
+		entry.st = st;
+		entry.row = DirectoryHandler::createRow(*it, st, listing.urlPath);
+	}
+	listing.changed.clear();
+	render(listing);
+	_bytes += sizeOf(listing);
+}
+
+void ListingCache::render(Listing &listing) {
+	size_t length = 0;
+	for (std::map<std::string, Entry>::const_iterator it = listing.entries.begin(); it != listing.entries.end(); ++it)
+		length += it->second.row.length();
+	std::string page;
+	page.reserve(length + 8192);
+	DirectoryHandler::beginPage(listing.urlPath, page);
+	for (std::map<std::string, Entry>::const_iterator it = listing.entries.begin(); it != listing.entries.end(); ++it)
+		page += it->second.row;
+	DirectoryHandler::endPage(page);
+	listing.page.swap(page);
+}
+
+void ListingCache::watch(int dirFd, Listing &listing) {
+#ifdef __linux__
+	if (_inotifyFd < 0)
+		return;
+	// The fd's own directory, even if its path has changed since it was opened
+	std::string path = "/proc/self/fd/" + Utils::numToString(dirFd);
+	int			watch = inotify_add_watch(_inotifyFd, path.c_str(), LISTING_WATCH_EVENTS | IN_ONLYDIR);
+	if (watch < 0)
+		return; // Out of watches (fs.inotify.max_user_watches): judged by mtime
+	listing.watch = watch;
+	_watches[watch] = &listing;
+#else
+	(void)dirFd;
+	(void)listing;
+#endif
+}
+
+// Drops least recently used listings past AUTOINDEX_CACHE_SIZE or AUTOINDEX_CACHE_MEMORY
+void ListingCache::trim() {
+	while (_listings.size() > AUTOINDEX_CACHE_SIZE || (_bytes > AUTOINDEX_CACHE_MEMORY && _listings.size() > 1))
+		remove(_lru.back());
+}
+
+void ListingCache::remove(Listing *listing) {
+#ifdef __linux__
+	if (listing->watch >= 0) {
+		inotify_rm_watch(_inotifyFd, listing->watch);
+		_watches.erase(listing->watch);
+	}
+#endif
+	_bytes -= sizeOf(*listing);
+	_listings.erase(listing->key);
+	_lru.erase(listing->lru);
+	delete listing;
+}
+
+bool ListingCache::scan(int dirFd, const std::string &urlPath, std::map<std::string, Entry> &entries) {
+	DirectoryReader			 reader(dirFd);
+	std::vector<std::string> names;
+	while (reader.next(names)) {
+		for (size_t i = 0; i < names.size(); ++i) {
+			struct stat st;
+			if (fstatat(dirFd, names[i].c_str(), &st, 0) != 0)
+				continue; // Dangling symlink, or removed since
+			Entry &entry = entries[names[i]];
+			entry.st = st;
+			entry.row = DirectoryHandler::createRow(names[i], st, urlPath);
+		}
+		names.clear();
+	}
+	return !reader.isFailed();
+}
+
+size_t ListingCache::sizeOf(const Listing &listing) {
+	return listing.page.size() * 2; // The rows hold about as much again
+}
@@ -0,0 +1,87 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ListingCache.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 18:14:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 18:14:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LISTING_CACHE_HPP
+#define LISTING_CACHE_HPP
+
+#include "../WebServ.hpp"
+#include <list>
+#include <pthread.h>
+
+// Rendered autoindex pages, one per directory (device and inode), so that
+// serving a listing again costs neither a readdir nor a stat. A directory
+// is read with DirectoryReader (getdents64) and its entries stat'ed with
+// fstatat relative to its fd; each entry keeps its rendered row.
+//
+// On Linux an inotify watch on the directory reports what changed in it,
+// and only those entries are stat'ed again and their rows replaced. Without
+// a watch, a listing is good while the directory's mtime stays the same
+// (an entry created, removed or renamed changes it), and one read in the
+// same second the directory changed is read again next time. The event
+// loop and the AIOPool threads share it under one lock.
+class ListingCache {
+	public:
+		struct Entry {
+			struct stat st;
+			std::string row;		// Rendered table row
+		};
+
+		static ListingCache &getInstance();
+
+		// The page for the directory open on dirFd (st being its fstat),
+		// links going under urlPath; "" if it cannot be read
+		std::string get(int dirFd, const struct stat &st, const std::string &urlPath);
+
+	private:
+		typedef std::pair<dev_t, ino_t> Key;
+
+		struct Listing {
+			Key key;
+			std::string urlPath;
+			std::map<std::string, Entry> entries;	// By name
+			std::set<std::string> changed;			// Reported by inotify since the last get()
+			std::string page;
+			time_t mtime;
+			bool isRacy;							// Read in the second the directory last changed
+			bool isReady;							// Read at least once, no event lost since
+			int watch;								// inotify descriptor, -1 if none
+			std::list<Listing *>::iterator lru;
+
+			Listing() : mtime(0), isRacy(false), isReady(false), watch(-1) {}
+		};
+
+		static ListingCache *_instance;
+
+		std::map<Key, Listing *> _listings;
+		std::map<int, Listing *> _watches;
+		std::list<Listing *> _lru;		// Most recently used first
+		size_t _bytes;					// Held by pages and rows
+		int _inotifyFd;
+		unsigned long _lostEvents;		// inotify queue overflows
+		pthread_mutex_t _lock;
+
+		ListingCache();
+		bool isCurrent(const Listing &listing, const struct stat &st) const;
+		void readEvents();
+		void refresh(int dirFd, Listing &listing);
+		void render(Listing &listing);
+		void watch(int dirFd, Listing &listing);
+		void trim();
+		void remove(Listing *listing);
+		static bool scan(int dirFd, const std::string &urlPath, std::map<std::string, Entry> &entries);
+		static size_t sizeOf(const Listing &listing);
+
+		ListingCache(const ListingCache &);
+		ListingCache &operator=(const ListingCache &);
+};
+
+#endif
@@ -0,0 +1,145 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ListingProducer.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 19:48:36 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 19:48:36 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ListingProducer.hpp"
+#include "DirectoryHandler.hpp"
+
+bool ListingProducer::parseQuery(const std::string &queryString, Query &query) {
+	bool			   isListing = false;
+	std::istringstream parameters(queryString);
+	std::string		   parameter;
+	while (std::getline(parameters, parameter, '&')) {
+		size_t		equals = parameter.find('=');
+		std::string name = parameter.substr(0, equals);
+		std::string value = equals == std::string::npos ? "" : parameter.substr(equals + 1);
+		unsigned long number = std::strtoul(value.c_str(), NULL, 10);
+		if (name == "sort") {
+			isListing = true;
+			if (value == "name")
+				query.sort = SORT_NAME;
+			else if (value == "size")
+				query.sort = SORT_SIZE;
+			else if (value == "mtime")
+				query.sort = SORT_MTIME;
+		} else if (name == "order") {
+			isListing = true;
+			query.isDescending = (value == "desc");
+		} else if (name == "page") {
+			isListing = true;
+			query.page = std::max(1UL, number);
+		} else if (name == "page_size") {
+			isListing = true;
+			query.pageSize = std::min(static_cast<unsigned long>(AUTOINDEX_PAGE_MAX), std::max(1UL, number));
+		}
+	}
+	if (query.page || query.pageSize) {
+		query.page = std::max(static_cast<size_t>(1), query.page);
+		if (!query.pageSize)
+			query.pageSize = AUTOINDEX_PAGE_SIZE;
+		if (query.sort == SORT_NONE)
+			query.sort = SORT_NAME; // Pages of an unordered listing would overlap
+	}
+	return isListing;
+}
+
+ListingProducer::ListingProducer(int dirFd, const std::string &urlPath, const Query &query, AutoindexFormat format) :
+		_dirFd(dirFd),
+		_reader(dirFd),
+		_urlPath(urlPath),
+		_query(query),
+		_format(format),
+		_limit(std::numeric_limits<size_t>::max()),
+		_total(0),
+		_emitted(0),
+		_isStarted(false) {
+	if (_query.page && _query.page <= _limit / _query.pageSize)
+		_limit = _query.page * _query.pageSize;
+}
+
+ListingProducer::~ListingProducer() {
+	close(_dirFd);
+}
+
+BodyProducer::Status ListingProducer::produce(std::string &output) {
+	if (!_isStarted) {
+		_isStarted = true;
+		if (_format == AUTOINDEX_JSON)
+			DirectoryHandler::beginJson(_urlPath, output);
+		else
+			DirectoryHandler::beginPage(_urlPath, output);
+	}
+
+	// One batch per pull, so a large directory does not hold up the event loop
+	std::vector<std::string> names;
+	if (_reader.next(names)) {
+		for (size_t i = 0; i < names.size(); ++i) {
+			Item item;
+			if (fstatat(_dirFd, names[i].c_str(), &item.st, 0) != 0)
+				continue; // Dangling symlink, or removed since
+			item.name = names[i];
+			++_total;
+			if (_query.sort == SORT_NONE)
+				emit(item, output);
+			else
+				keep(item);
+		}
+		return output.empty() ? AGAIN : DATA; // Kept for a sorted page: pulled again, being ready
+	}
+	if (_reader.isFailed())
+		return FAILED;
+
+	if (_query.sort != SORT_NONE) {
+		std::sort_heap(_kept.begin(), _kept.end(), Before(_query));
+		size_t first = _query.page ? (_query.page - 1) * _query.pageSize : 0;
+		for (size_t i = first; i < _kept.size(); ++i) emit(_kept[i], output);
+		std::vector<Item>().swap(_kept);
+	}
+	if (_format == AUTOINDEX_JSON)
+		DirectoryHandler::endJson(_total, _query.page, _query.pageSize, output);
+	else
+		DirectoryHandler::endPage(output);
+	return DONE;
+}
+
+// Keeps item if it is among the first _limit entries in the listing's order
+void ListingProducer::keep(const Item &item) {
+	Before before(_query);
+	if (_kept.size() < _limit) {
+		_kept.push_back(item);
+		std::push_heap(_kept.begin(), _kept.end(), before);
+	} else if (before(item, _kept.front())) {
+		std::pop_heap(_kept.begin(), _kept.end(), before);
+		_kept.back() = item;
+		std::push_heap(_kept.begin(), _kept.end(), before);
+	}
+}
+
+void ListingProducer::emit(const Item &item, std::string &output) {
+	if (_format == AUTOINDEX_JSON) {
+		if (_emitted)
+			output += ",";
+		output += DirectoryHandler::createJsonEntry(item.name, item.st);
+	} else
+		output += DirectoryHandler::createRow(item.name, item.st, _urlPath);
+	++_emitted;
+}
+
+bool ListingProducer::Before::operator()(const Item &a, const Item &b) const {
+	int order = 0;
+	if (_query.sort == SORT_SIZE && a.st.st_size != b.st.st_size)
+		order = a.st.st_size < b.st.st_size ? -1 : 1;
+	else if (_query.sort == SORT_MTIME && a.st.st_mtime != b.st.st_mtime)
+		order = a.st.st_mtime < b.st.st_mtime ? -1 : 1;
+	else
+		order = a.name.compare(b.name); // Also breaks ties in size or mtime
+	return _query.isDescending ? order > 0 : order < 0;
+}
@@ -0,0 +1,86 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ListingProducer.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 19:48:36 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 19:48:36 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LISTING_PRODUCER_HPP
+#define LISTING_PRODUCER_HPP
+
+#include "../config/ServerConfig.hpp"
+#include "../http/BodyProducer.hpp"
+#include "DirectoryReader.hpp"
+
+// An autoindex listing sent while the directory is read, for a request
+// with ?sort=name|size|mtime, ?order=asc|desc, ?page=N or ?page_size=N, or
+// any request to an "autoindex_format json" location.
+//
+// Unsorted, each batch DirectoryReader returns goes out as soon as its
+// entries are stat'ed. Sorted, only the entries up to the end of the asked
+// page are kept while reading, in a heap of page * page_size (top-k
+// selection), and that page goes out once the whole directory is read. A
+// page without a sort key is sorted by name.
+class ListingProducer : public BodyProducer {
+	public:
+		enum SortKey {
+			SORT_NONE,	// Directory order, streamed
+			SORT_NAME,
+			SORT_SIZE,
+			SORT_MTIME
+		};
+		struct Query {
+			SortKey sort;
+			bool isDescending;
+			size_t page;		// From 1, 0 when not paged
+			size_t pageSize;
+
+			Query() : sort(SORT_NONE), isDescending(false), page(0), pageSize(0) {}
+		};
+
+		// Reads the listing parameters of queryString; false if there are none
+		static bool parseQuery(const std::string &queryString, Query &query);
+
+		// Takes dirFd over; urlPath as DirectoryHandler::displayPath() makes it
+		ListingProducer(int dirFd, const std::string &urlPath, const Query &query, AutoindexFormat format);
+
+		Status produce(std::string &output);
+		bool isReady() const { return true; } // AGAIN only hands the loop back between batches
+
+	private:
+		struct Item {
+			std::string name;
+			struct stat st;
+		};
+		// True when a is listed before b
+		class Before {
+			public:
+				explicit Before(const Query &query) : _query(query) {}
+				bool operator()(const Item &a, const Item &b) const;
+
+			private:
+				Query _query;
+		};
+
+		int _dirFd;
+		DirectoryReader _reader;
+		std::string _urlPath;
+		Query _query;
+		AutoindexFormat _format;
+		size_t _limit;				// Entries kept for a sorted page
+		std::vector<Item> _kept;	// Heap, the last one listed on top
+		size_t _total;
+		size_t _emitted;
+		bool _isStarted;
+
+		~ListingProducer();
+		void keep(const Item &item);
+		void emit(const Item &item, std::string &output);
+};
+
+#endif
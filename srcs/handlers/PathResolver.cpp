@@ -0,0 +1,233 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PathResolver.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 21:14:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 21:14:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "PathResolver.hpp"
+#include "FileHandler.hpp"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifdef SYS_openat2
+// struct open_how and the flags from <linux/openat2.h>, which older headers lack
+struct OpenHow {
+	unsigned long long flags;
+	unsigned long long mode;
+	unsigned long long resolve;
+};
+static const unsigned long long RESOLVE_NO_MAGICLINKS_FLAG = 0x02;
+static const unsigned long long RESOLVE_BENEATH_FLAG = 0x08;
+#endif
+
+PathResolver *PathResolver::_instance = NULL;
+
+PathResolver::PathResolver() {
+	pthread_mutex_init(&_rootsLock, NULL);
+}
+
+PathResolver &PathResolver::getInstance() {
+	if (!_instance)
+		_instance = new PathResolver();
+	return *_instance;
+}
+
+void PathResolver::reset() {
+	pthread_mutex_lock(&_rootsLock);
+	for (std::map<std::string, int>::iterator it = _roots.begin(); it != _roots.end(); ++it)
+		close(it->second);
+	_roots.clear();
+	pthread_mutex_unlock(&_rootsLock);
+}
+
+void PathResolver::configure(const ServerConfig &config) {
+	// A root missing now is retried on each request, as it may yet be created
+	for (std::vector<LocationConfig>::const_iterator it = config.locations.begin(); it != config.locations.end(); ++it)
+		openRoot(FileHandler::locationDirectory(*it));
+}
+
+int PathResolver::resolve(const std::string &uri, const LocationConfig &location, File &file) {
+	std::string relative;
+	int			status = relativePath(uri, location, relative);
+	if (status)
+		return status;
+	int rootFd = openRoot(FileHandler::locationDirectory(location));
+	if (rootFd < 0)
+		return statusFor(errno);
+	return open(rootFd, relative, file);
+}
+
+int PathResolver::resolveParent(const std::string &uri, const LocationConfig &location, int &dirFd,
+								std::string &name) {
+	std::string relative;
+	int			status = relativePath(uri, location, relative);
+	if (status)
+		return status;
+	if (relative.empty() || relative[relative.length() - 1] == '/')
+		return 409; // Names a directory, not a file
+	int rootFd = openRoot(FileHandler::locationDirectory(location));
+	if (rootFd < 0)
+		return statusFor(errno);
+
+	size_t slash = relative.rfind('/');
+	name = relative.substr(slash == std::string::npos ? 0 : slash + 1);
+	dirFd = openBeneath(rootFd, slash == std::string::npos ? "" : relative.substr(0, slash),
+						O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirFd < 0)
+		return errno == ENOENT || errno == ENOTDIR ? 409 : statusFor(errno); // No parent to create it in
+	return 0;
+}
+
+int PathResolver::relativePath(const std::string &uri, const LocationConfig &location, std::string &relative) const {
+	std::string path;
+	if (!normalize(uri, path))
+		return 400;
+
+	// Same split as FileHandler::constructFilePath: what follows the location prefix
+	std::string prefix = location.isRegex() ? "" : location.path;
+	if (path.compare(0, prefix.length(), prefix) != 0 && path + "/" != prefix)
+		return 404; // Routed on the raw URI, but its ".." leads out of the location
+	relative.clear();
+	if (path.length() > prefix.length()) {
+		size_t start = prefix.length();
+		if (path[start] == '/')
+			++start;
+		relative = path.substr(start);
+	}
+	return 0;
+}
+
+int PathResolver::extend(const File &base, const std::string &suffix, File &file) const {
+	if (base.relative.empty() && !suffix.empty() && suffix[0] == '/')
+		return open(base.rootFd, suffix.substr(1), file);
+	return open(base.rootFd, base.relative + suffix, file);
+}
+
+bool PathResolver::normalize(const std::string &uri, std::string &path) {
+	path.assign(1, '/');
+	path.reserve(uri.length() + 1);
+	size_t segment = 1; // Where the segment being copied starts in path
+
+	for (size_t i = 0;; ++i) {
+		bool atEnd = i >= uri.length();
+		char c = atEnd ? '/' : uri[i];
+		if (c == '%' && i + 2 < uri.length()) {
+			int high = Utils::hexDigit(uri[i + 1]);
+			int low = Utils::hexDigit(uri[i + 2]);
+			if (high >= 0 && low >= 0) {
+				c = static_cast<char>(high << 4 | low);
+				if (c == '\0')
+					return false;
+				i += 2;
+			}
+		}
+		if (c != '/') {
+			path += c;
+			continue;
+		}
+		// A segment ends: drop ".", fold "..", collapse "//"
+		size_t length = path.length() - segment;
+		if (length == 1 && path[segment] == '.') {
+			path.erase(segment);
+		} else if (length == 2 && path[segment] == '.' && path[segment + 1] == '.') {
+			if (segment == 1)
+				return false;
+			path.erase(path.rfind('/', segment - 2) + 1);
+		} else if (length > 0 && !atEnd) {
+			path += '/';
+		}
+		segment = path.length();
+		if (atEnd)
+			return true;
+	}
+}
+
+int PathResolver::openRoot(const std::string &directory) {
+	pthread_mutex_lock(&_rootsLock);
+	std::map<std::string, int>::iterator it = _roots.find(directory);
+	if (it != _roots.end()) {
+		int fd = it->second;
+		pthread_mutex_unlock(&_rootsLock);
+		return fd;
+	}
+#ifdef O_PATH
+	int flags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+#else
+	int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+#endif
+	int fd = ::open(directory.empty() ? "." : directory.c_str(), flags);
+	if (fd >= 0)
+		_roots[directory] = fd;
+	int error = errno;
+	pthread_mutex_unlock(&_rootsLock);
+	errno = error; // For statusFor()
+	return fd;
+}
+
+int PathResolver::open(int rootFd, const std::string &relative, File &file) const {
+	// Non-blocking so a FIFO cannot hang the open; it is refused after fstat
+	int fd = openBeneath(rootFd, relative, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0)
+		return statusFor(errno);
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return 500;
+	}
+	// Only files and directories are served: a FIFO or device would stall the event loop
+	bool isServable = S_ISREG(st.st_mode) || S_ISDIR(st.st_mode);
+	// .bla files (the tester's CGI extension) must also be executable to be served
+	if (S_ISREG(st.st_mode) && relative.find(".bla") != std::string::npos)
+		isServable = (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+	if (!isServable) {
+		close(fd);
+		return 403;
+	}
+	file.fd = fd;
+	file.st = st;
+	file.rootFd = rootFd;
+	file.relative = relative;
+	return 0;
+}
+
+int PathResolver::openBeneath(int dirFd, const std::string &relative, int flags) {
+	const char *name = relative.empty() ? "." : relative.c_str();
+#ifdef SYS_openat2
+	static bool hasOpenat2 = true;
+	if (hasOpenat2) {
+		OpenHow how;
+		how.flags = flags;
+		how.mode = 0;
+		how.resolve = RESOLVE_BENEATH_FLAG | RESOLVE_NO_MAGICLINKS_FLAG;
+		int fd = static_cast<int>(syscall(SYS_openat2, dirFd, name, &how, sizeof(how)));
+		if (fd >= 0 || errno != ENOSYS)
+			return fd;
+		hasOpenat2 = false; // Kernel older than 5.6
+	}
+#endif
+	return openat(dirFd, name, flags);
+}
+
+int PathResolver::statusFor(int error) {
+	switch (error) {
+		case EACCES:
+		case EPERM:
+		case EXDEV: // RESOLVE_BENEATH: the path leads out of the root
+		case ELOOP:
+			return 403;
+		case EMFILE:
+		case ENFILE:
+		case ENOMEM:
+			return 503;
+		default:
+			return 404;
+	}
+}
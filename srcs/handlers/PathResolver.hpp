@@ -0,0 +1,75 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PathResolver.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 21:14:52 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 21:14:52 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef PATH_RESOLVER_HPP
+#define PATH_RESOLVER_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include <pthread.h>
+
+// Maps a request URI to an open file under its location's root.
+//
+// The URI is percent-decoded and normalized in one pass ("." and empty
+// segments dropped, ".." folded), then opened relative to the fd of the
+// root directory, opened when the server starts and kept. On Linux the open
+// is openat2(RESOLVE_BENEATH), so neither ".." nor a symlink can lead out of
+// the root; elsewhere it is a plain openat() of the normalized path. What
+// comes back is the fd and its stat, and nothing after this touches the
+// path again.
+class PathResolver {
+	public:
+		struct File {
+			int fd;					// Owned by the caller, -1 if none
+			struct stat st;
+			int rootFd;				// The resolver's, do not close
+			std::string relative;	// Beneath rootFd, "" for the root itself
+
+			File() : fd(-1), rootFd(-1) {}
+		};
+
+		static PathResolver &getInstance();
+
+		// Closes the root directories, before the servers are (re)configured
+		void reset();
+		// Opens the root directory of each of config's locations
+		void configure(const ServerConfig &config);
+		// Opens what uri names under location's root; 0 or the HTTP status to answer with
+		int resolve(const std::string &uri, const LocationConfig &location, File &file);
+		// Opens base's path with suffix appended ("/index.html", ".gz"); 0 or an HTTP status
+		int extend(const File &base, const std::string &suffix, File &file) const;
+		// Opens the directory a file uri names would be created in (PUT), the
+		// fd going to dirFd and the file's name to name; 0 or an HTTP status
+		int resolveParent(const std::string &uri, const LocationConfig &location, int &dirFd, std::string &name);
+
+		// Decodes %XX and normalizes uri into path, which starts with "/";
+		// false if a ".." climbs above "/" or a NUL byte is encoded
+		static bool normalize(const std::string &uri, std::string &path);
+
+	private:
+		static PathResolver *_instance;
+
+		std::map<std::string, int> _roots;	// Root directory path to its fd
+		pthread_mutex_t _rootsLock;			// resolve() also runs on AIOPool threads
+
+		PathResolver();
+		int openRoot(const std::string &directory);
+		int relativePath(const std::string &uri, const LocationConfig &location, std::string &relative) const;
+		int open(int rootFd, const std::string &relative, File &file) const;
+		static int openBeneath(int dirFd, const std::string &relative, int flags);
+		static int statusFor(int error);
+
+		PathResolver(const PathResolver &);
+		PathResolver &operator=(const PathResolver &);
+};
+
+#endif
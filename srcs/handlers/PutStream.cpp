@@ -0,0 +1,191 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PutStream.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 10:31:07 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 10:31:07 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "PutStream.hpp"
+#include "PathResolver.hpp"
+
+#define MAX_RANGE_DIGITS 18 // Keeps a Content-Range number inside off_t
+
+PutStream::PutStream() :
+		_dirFd(-1),
+		_fd(-1),
+		_existed(false),
+		_ranged(false),
+		_first(0),
+		_last(0),
+		_total(-1),
+		_stored(0),
+		_offset(0) {
+}
+
+PutStream::~PutStream() {
+	closeFiles();
+	if (_dirFd >= 0)
+		close(_dirFd);
+}
+
+bool PutStream::begin(const Request &request, const LocationConfig &location) {
+	int status = PathResolver::getInstance().resolveParent(request.getPath(), location, _dirFd, _name);
+	if (status)
+		return fail(status);
+	struct stat st;
+	if (fstatat(_dirFd, _name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) {
+		if (S_ISDIR(st.st_mode))
+			return fail(409);
+		_existed = true;
+	}
+
+	const std::string &contentRange = request.getHeader("Content-Range");
+	if (!contentRange.empty()) {
+		_ranged = true;
+		if (!parseContentRange(contentRange))
+			return fail(400);
+		const std::string &contentLength = request.getHeader("Content-Length");
+		if (!contentLength.empty() && std::strtoul(contentLength.c_str(), NULL, 10) != static_cast<unsigned long>(_last - _first + 1))
+			return fail(400); // Body and range disagree
+		// Kept between requests: each piece continues what the last one stored
+		_tempName = "." + _name + ".part";
+		_fd = openat(_dirFd, _tempName.c_str(), O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0644);
+		if (_fd < 0 || fstat(_fd, &st) < 0)
+			return fail(500);
+		_stored = st.st_size;
+		if (_first > _stored || (_total >= 0 && _stored > _total))
+			return fail(416); // Would leave a hole, or the part belongs to another file
+		_offset = _first;
+		return true;
+	}
+
+	static unsigned long counter = 0;
+	for (int attempt = 0; _fd < 0 && attempt < 8; ++attempt) {
+		_tempName = ".put-" + Utils::numToString(static_cast<long>(getpid())) + "-" + Utils::numToString(++counter);
+		_fd = openat(_dirFd, _tempName.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (_fd < 0 && errno != EEXIST)
+			break;
+	}
+	if (_fd < 0) {
+		_tempName.clear();
+		return fail(500);
+	}
+	return true;
+}
+
+bool PutStream::feed(const char *data, size_t length) {
+	if (_status)
+		return false;
+	if (_ranged && static_cast<off_t>(length) > _last + 1 - _offset)
+		return fail(400); // More body than the range it claims to be
+	while (length > 0) {
+		ssize_t written = pwrite(_fd, data, length, _offset);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return fail(500);
+		}
+		data += written;
+		length -= written;
+		_offset += written;
+	}
+	return true;
+}
+
+ssize_t PutStream::receive(int socketFd, size_t limit) {
+	if (_ranged && static_cast<off_t>(limit) > _last + 1 - _offset)
+		return BodySink::receive(socketFd, limit); // Longer than its range: feed() refuses it
+	return spliceInto(socketFd, limit, _fd, _offset);
+}
+
+Response PutStream::finish(const ServerConfig *config) {
+	if (!_status && _ranged && _offset != _last + 1)
+		fail(400); // Body shorter than its range
+	if (!_status)
+		commit();
+	if (_status) {
+		Response response = Response::makeErrorResponse(_status, config);
+		if (_status == 416 && _stored > 0)
+			response.addHeader("Range", "bytes=0-" + Utils::numToString(static_cast<long>(_stored - 1)));
+		return response;
+	}
+
+	off_t extent = std::max(_stored, _offset);
+	if (_ranged && (_total < 0 || extent < _total)) {
+		// Stored so far, for the client to send the rest
+		Response response(202);
+		response.addHeader("Range", "bytes=0-" + Utils::numToString(static_cast<long>(extent - 1)));
+		return response;
+	}
+	if (_existed)
+		return Response(204);
+	Response response(201);
+	response.addHeader("Content-Type", "text/plain");
+	response.setBody("Created");
+	return response;
+}
+
+bool PutStream::fail(int status) {
+	if (!_status)
+		_status = status;
+	closeFiles();
+	return false;
+}
+
+// Puts the written file in place of the target, once it is whole
+bool PutStream::commit() {
+	if (_ranged && (_total < 0 || std::max(_stored, _offset) < _total))
+		return true; // More pieces to come; the part file stays
+	int fd = _fd;
+	_fd = -1;
+	if (close(fd) != 0 || renameat(_dirFd, _tempName.c_str(), _dirFd, _name.c_str()) != 0) {
+		unlinkat(_dirFd, _tempName.c_str(), 0);
+		_tempName.clear();
+		return fail(500);
+	}
+	_tempName.clear();
+	return true;
+}
+
+void PutStream::closeFiles() {
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+	// A part file is kept for the client to resume; a plain temp file is not
+	if (!_ranged && !_tempName.empty()) {
+		unlinkat(_dirFd, _tempName.c_str(), 0);
+		_tempName.clear();
+	}
+}
+
+// "bytes first-last/total", total being "*" when not known yet
+bool PutStream::parseContentRange(const std::string &value) {
+	if (Utils::toLower(value.substr(0, 6)) != "bytes ")
+		return false;
+	off_t	   numbers[3] = {0, 0, -1};
+	const char separators[3] = {'-', '/', '\0'};
+	size_t	   pos = 6;
+	for (int i = 0; i < 3; ++i) {
+		if (i == 2 && pos < value.length() && value[pos] == '*' && pos + 1 == value.length())
+			break;
+		size_t digits = 0;
+		numbers[i] = 0;
+		while (pos < value.length() && isdigit(static_cast<unsigned char>(value[pos])) && digits < MAX_RANGE_DIGITS) {
+			numbers[i] = numbers[i] * 10 + (value[pos++] - '0');
+			++digits;
+		}
+		if (digits == 0 || (separators[i] ? pos >= value.length() || value[pos] != separators[i] : pos != value.length()))
+			return false;
+		++pos;
+	}
+	_first = numbers[0];
+	_last = numbers[1];
+	_total = numbers[2];
+	return _first <= _last && (_total < 0 || _last < _total);
+}
@@ -0,0 +1,68 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   PutStream.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 10:31:07 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 10:31:07 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef PUT_STREAM_HPP
+#define PUT_STREAM_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include "../http/BodySink.hpp"
+#include "../http/Request.hpp"
+
+// A PUT body written to its target while it arrives. The body goes to a
+// hidden temp file in the target's directory, renamed over the target once
+// complete, so a reader sees either the old file or the whole new one.
+//
+// With a Content-Range ("bytes first-last/total") the body is one piece of
+// the file: pieces go to a ".<name>.part" file kept across requests, and
+// the target appears once the part file holds all total bytes. Until then
+// the answer is 202 with a Range header telling how much is stored.
+//
+// On Linux a Content-Length body is moved socket -> pipe -> file with
+// splice(), so its bytes never pass through user space.
+class PutStream : public BodySink {
+	public:
+		PutStream();
+		~PutStream(); // Removes the temp file of an unfinished plain PUT
+
+		// Opens the target's directory and the file to write; false, with
+		// getStatus() set, if the body cannot be taken
+		bool begin(const Request &request, const LocationConfig &location);
+		bool feed(const char *data, size_t length);
+		ssize_t receive(int socketFd, size_t limit);
+		// 201 for a new target, 204 for a replaced one, 202 for a piece of an
+		// unfinished file, or the error to answer with
+		Response finish(const ServerConfig *config);
+
+	private:
+		int _dirFd;				// Target's directory
+		std::string _name;		// Target, relative to _dirFd
+		std::string _tempName;	// File being written, relative to _dirFd
+		int _fd;
+		bool _existed;			// Target was there before
+		bool _ranged;			// Content-Range given
+		off_t _first;			// Range of this piece, or 0 and the body's end
+		off_t _last;
+		off_t _total;			// File size from Content-Range, -1 for "*"
+		off_t _stored;			// Size of the part file before this piece
+		off_t _offset;			// Where the next body byte goes
+
+		bool fail(int status);
+		bool parseContentRange(const std::string &value);
+		bool commit();
+		void closeFiles();
+
+		PutStream(const PutStream &);
+		PutStream &operator=(const PutStream &);
+};
+
+#endif
@@ -12,17 +12,24 @@
 
 #include "RequestHandler.hpp"
 #include "../server/SessionManager.hpp"
+#include "../http/Compressor.hpp"
+#include "AIOPool.hpp"
 #include "CGIHandler.hpp"
 #include "DirectoryHandler.hpp"
 #include "FileHandler.hpp"
+#include "FileTask.hpp"
+#include "ListingProducer.hpp"
+#include "PathResolver.hpp"
+#include "PutStream.hpp"
+#include "ResumableUploads.hpp"
+#include "UploadStream.hpp"
 
 RequestHandler::RequestHandler(const ServerConfig &config) : _config(config) {
 }
 
-Response RequestHandler::handleRequest(const Request &request) {
-	Request req = request;
-	req.setConfig(&_config);
-	const LocationConfig *location = getLocation(request.getPath());
+Response RequestHandler::handleRequest(Request &request) {
+	request.setConfig(&_config);
+	const LocationConfig *location = route(request);
 
 	if (!location)
 		return Response::makeErrorResponse(404, &_config);
@@ -34,9 +41,21 @@ Response RequestHandler::handleRequest(const Request &request) {
 		return redirect;
 	}
 
-	if (!isMethodAllowed(req.getMethod(), *location))
+	if (!isMethodAllowed(request.getMethod(), *location))
 		return Response::makeErrorResponse(405, &_config);
 
+	if (location->cgi_status) { // Scheduler counters, for monitoring
+		Response status(200);
+		status.addHeader("Content-Type", "text/plain");
+		status.addHeader("Cache-Control", "no-store");
+		status.setBody(CGIScheduler::getInstance().report() + AIOPool::getInstance().report() +
+					   SessionManager::getInstance().report());
+		return status;
+	}
+
+	if (location->upload_resumable && request.getMethod() != "GET") // Served by the tus-style protocol
+		return ResumableUploads::getInstance().handle(request, *location, &_config);
+
 	Response response;
 	if (request.getMethod() == "GET")
 		response = handleGET(request);
@@ -48,63 +67,93 @@ Response RequestHandler::handleRequest(const Request &request) {
 		response = handlePUT(request);
 	else
 		response = Response::makeErrorResponse(501, &_config); // Not Implemented
+	if (!response.getCGIJob()) // CGI replies are compressed once their headers are known
+		applyCompression(request, *location, response);
 
-	// Clean up expired sessions periodically
-	static time_t lastCleanup = 0;
-	if (time(NULL) - lastCleanup > 300) { // Every 5 minutes
-		SessionManager::getInstance().cleanupExpiredSessions();
-		lastCleanup = time(NULL);
-	}
-	handleCookies(request, response);
+	handleCookies(request, *location, response);
 	return response;
 }
 
-const LocationConfig *RequestHandler::getLocation(const std::string &path) const {
-	// First try regex patterns (including .bla files)
-	for (std::vector<LocationConfig>::const_iterator it = _config.locations.begin(); it != _config.locations.end();
-		 ++it) {
-		if (!it->path.empty() && it->path[0] == '~') {
-			size_t patternStart = it->path.find_first_not_of(" \t", 1);
-			if (patternStart == std::string::npos)
-				continue;
-
-			std::string pattern = it->path.substr(patternStart);
-			pattern = pattern.substr(0, pattern.find_first_of(" \t"));
-
-			// Remove $ anchor if present
-			bool hasEndAnchor = pattern[pattern.length() - 1] == '$';
-			if (hasEndAnchor)
-				pattern = pattern.substr(0, pattern.length() - 1);
-
-			// Check if path matches pattern
-			if (path.length() >= pattern.length()) {
-				std::string pathEnd = path.substr(path.length() - pattern.length());
-				if (pathEnd == pattern)
-					return &(*it);
-			}
-		}
-	}
+void RequestHandler::completeCGIResponse(const Request &request, Response &response) const {
+	const LocationConfig *location = request.getLocation();
+	if (location)
+		applyCompression(request, *location, response);
+}
 
-	// Then try exact and prefix matches
-	const LocationConfig *exactMatch = NULL;
-	const LocationConfig *prefixMatch = NULL;
-	size_t				  prefixLength = 0;
+bool RequestHandler::streamsBody(Request &request, size_t &maxBodySize) const {
+	// Only a forked CGI script reads its body from a pipe as it arrives
+	if (request.getMethod() != "POST")
+		return false;
+	const LocationConfig *location = route(request);
+	if (!location || !location->redirect.empty() || !isMethodAllowed("POST", *location) ||
+		!location->fastcgi_pass.empty() || !location->cgi_worker.empty())
+		return false;
+	const std::string &script = request.getScriptName();
+	size_t			   extPos = script.find_last_of('.');
+	if (extPos == std::string::npos || _config.cgi_handlers.find(script.substr(extPos)) == _config.cgi_handlers.end())
+		return false;
+	maxBodySize = location->client_max_body_size;
+	return true;
+}
 
-	for (std::vector<LocationConfig>::const_iterator it = _config.locations.begin(); it != _config.locations.end();
-		 ++it) {
-		if (it->path[0] == '~') // Skip regex locations
-			continue;
-		if (it->path == path) {
-			exactMatch = &(*it);
-			break;
-		}
-		if (path.find(it->path) == 0 && it->path.length() > prefixLength) {
-			prefixMatch = &(*it);
-			prefixLength = it->path.length();
-		}
+BodySink *RequestHandler::makeBodySink(Request &request, size_t &maxBodySize) const {
+	const std::string &method = request.getMethod();
+	bool isUpload = method == "POST" && request.getHeader("Content-Type").find("multipart/form-data") != std::string::npos;
+	if (!isUpload && method != "PUT" && method != "PATCH")
+		return NULL;
+	const LocationConfig *location = route(request);
+	if (!location || !location->redirect.empty() || !isMethodAllowed(method, *location) || location->cgi_status)
+		return NULL;
+
+	if (location->upload_resumable)
+		return method == "PATCH" ? ResumableUploads::getInstance().beginPatch(request, *location, maxBodySize) : NULL;
+	if (method == "PATCH")
+		return NULL;
+	if (method == "PUT") {
+		PutStream *put = new PutStream();
+		put->begin(request, *location);
+		maxBodySize = location->client_max_body_size;
+		return put;
+	}
+	// Same order as handlePOST: a CGI or FastCGI location takes the body itself
+	if (!location->fastcgi_pass.empty() || location->path.empty())
+		return NULL;
+	const std::string &script = request.getScriptName();
+	size_t			   extPos = script.find_last_of('.');
+	if (extPos != std::string::npos && _config.cgi_handlers.find(script.substr(extPos)) != _config.cgi_handlers.end())
+		return NULL;
+	UploadStream *upload = new UploadStream(*location);
+	upload->begin(request.getHeader("Content-Type"));
+	maxBodySize = location->client_max_body_size;
+	return upload;
+}
+
+std::string RequestHandler::findScriptName(const std::string &path) const {
+	size_t segment = 0;
+	while (segment < path.length()) {
+		size_t end = path.find('/', segment + 1);
+		if (end == std::string::npos)
+			end = path.length();
+		size_t dot = path.find_last_of('.', end - 1);
+		if (dot != std::string::npos && dot > segment &&
+			_config.cgi_handlers.find(path.substr(dot, end - dot)) != _config.cgi_handlers.end())
+			return path.substr(0, end);
+		segment = end;
 	}
+	return path;
+}
 
-	return exactMatch ? exactMatch : prefixMatch;
+const LocationConfig *RequestHandler::getLocation(const std::string &path) const {
+	int index = _config.router.match(path);
+	return index >= 0 ? &_config.locations[index] : NULL;
+}
+
+const LocationConfig *RequestHandler::route(Request &request) const {
+	if (!request.getLocation()) {
+		request.setScriptName(findScriptName(request.getPath()));
+		request.setLocation(getLocation(request.getPath()));
+	}
+	return request.getLocation();
 }
 
 bool RequestHandler::isMethodAllowed(const std::string &method, const LocationConfig &loc) const {
@@ -116,93 +165,169 @@ bool RequestHandler::isMethodAllowed(const std::string &method, const LocationCo
 }
 
 Response RequestHandler::handleGET(const Request &request) const {
-	std::string			  path = request.getPath();
-	const LocationConfig *location = getLocation(path);
+	const std::string	 &path = request.getPath();
+	const LocationConfig *location = request.getLocation();
 	if (!location)
 		return Response::makeErrorResponse(404, &_config);
 
-	std::string fullPath = FileHandler::constructFilePath(path, *location);
+	const std::string &script = request.getScriptName();
+	// A FastCGI backend answers for the whole location
+	if (!location->fastcgi_pass.empty()) {
+		CGIHandler handler;
+		return handler.executeFastCGI(request, *location, FileHandler::constructFilePath(script, *location));
+	}
 	// Check CGI for files
-	size_t extPos = path.find_last_of('.');
+	size_t extPos = script.find_last_of('.');
 	if (extPos != std::string::npos) {
-		std::string										   ext = path.substr(extPos);
+		std::string										   ext = script.substr(extPos);
 		std::map<std::string, std::string>::const_iterator handlerIt = _config.cgi_handlers.find(ext);
 
 		if (handlerIt != _config.cgi_handlers.end()) {
 			if (!location->cgi_path.empty()) { // Location has CGI configuration
-				CGIHandler handler;
-				Request	   req(request);
-				req.setConfig(&_config);
-				return handler.executeCGI(req, handlerIt->second, fullPath);
+				CGIHandler	handler;
+				std::string scriptPath = FileHandler::constructFilePath(script, *location);
+				if (!location->cgi_worker.empty())
+					return handler.executePooledCGI(request, *location, scriptPath);
+				if (location->cgi_cache)
+					return handler.executeCachedCGI(request, *location, handlerIt->second, scriptPath);
+				return handler.executeCGI(request, *location, handlerIt->second, scriptPath);
 			}
 		}
 	}
-	struct stat st;
-	if (stat(fullPath.c_str(), &st) != 0) {
-		size_t lastSlash = fullPath.find_last_of('/');
-		if (lastSlash != std::string::npos) {
-			std::string parentDir = fullPath.substr(0, lastSlash);
-			struct stat parentSt;
-			if (stat(parentDir.c_str(), &parentSt) == 0 && S_ISDIR(parentSt.st_mode))
-				return Response::makeErrorResponse(404, &_config);
+	Response pending;
+	if (location->aio && offload(FileTask::makeStatic(request, _config), pending))
+		return pending;
+	StaticTarget target;
+	findStatic(path, *location, _config.index, streamsListing(request, *location),
+			   location->gzip_static && Compressor::acceptsGzip(request.getHeader("Accept-Encoding")), target);
+	return serveStatic(request, *location, target);
+}
+
+void RequestHandler::findStatic(const std::string &path, const LocationConfig &location,
+								const std::string &defaultIndex, bool streamsListing,
+								bool wantsGzip, StaticTarget &target) {
+	PathResolver &resolver = PathResolver::getInstance();
+	target.status = resolver.resolve(path, location, target.file);
+	if (target.status)
+		return;
+	target.relative = target.file.relative;
+	// Handle directory: the resolver only opens what lies beneath the routed
+	// location's root, so any directory it yields may be answered
+	if (S_ISDIR(target.file.st.st_mode)) {
+		PathResolver::File directory = target.file;
+		target.file = PathResolver::File();
+		// First try the index file
+		if (findFirstExistingIndex(directory, location.index.empty() ? defaultIndex : location.index,
+										target.file))
+			target.relative = target.file.relative;
+		else {
+			target.isDirectory = true;
+			if (location.autoindex && streamsListing) {
+				target.file = directory; // Read by the producer as it sends
+				target.isStreamed = true;
+				return;
+			}
+			if (location.autoindex) { // Read through the fd it was opened with
+				target.listing = DirectoryHandler::createListing(directory.fd, directory.st, path);
+				if (target.listing.empty())
+					target.status = 500;
+			}
 		}
-		return Response::makeErrorResponse(404, &_config);
+		close(directory.fd);
+		return;
 	}
-	// Handle directory
-	if (S_ISDIR(st.st_mode)) {
-		if (path != "/" && path != location->path) { // Check if directory access is allowed
-			std::string locationRoot = location->root;
-			bool		isListedPath = false;
-			if (fullPath.find(locationRoot) == 0) {
-				isListedPath = true;
-			} else {
-				for (std::vector<LocationConfig>::const_iterator it = _config.locations.begin();
-					 it != _config.locations.end(); ++it) {
-					if (path.find(it->path) == 0) {
-						isListedPath = true;
-						break;
-					}
-				}
+	// Precompressed sidecar: file.gz next to file costs no CPU at all
+	if (wantsGzip) {
+		PathResolver::File gz;
+		if (resolver.extend(target.file, ".gz", gz) == 0) {
+			if (S_ISREG(gz.st.st_mode)) {
+				close(target.file.fd);
+				target.file = gz;
+				target.isGzip = true;
+				return;
 			}
-			if (!isListedPath)
-				return Response::makeErrorResponse(403, &_config);
+			close(gz.fd);
 		}
-		// First try the index file
-		std::string indexPath =
-			findFirstExistingIndex(fullPath, location->index.empty() ? _config.index : location->index);
-		if (!indexPath.empty())
-			return FileHandler::serveFile(indexPath, path);
-		if (location->autoindex)
-			return DirectoryHandler::handleDirectory(fullPath, *location, path, &_config);
-		if (path == "/" || path == location->path) {
+	}
+}
+
+Response RequestHandler::serveStatic(const Request &request, const LocationConfig &location,
+									 const StaticTarget &target) const {
+	if (target.status)
+		return Response::makeErrorResponse(target.status, &_config);
+	if (target.isStreamed) {
+		ListingProducer::Query query;
+		ListingProducer::parseQuery(request.getQueryString(), query);
+		Response response(200);
+		response.addHeader("Content-Type",
+						   location.autoindex_format == AUTOINDEX_JSON ? "application/json" : "text/html");
+		response.setBodyProducer(new ListingProducer(target.file.fd, DirectoryHandler::displayPath(request.getPath()),
+													 query, location.autoindex_format));
+		return response;
+	}
+	if (target.isDirectory) {
+		if (location.autoindex) {
+			Response response(200);
+			response.addHeader("Content-Type", "text/html");
+			response.setBody(target.listing);
+			return response;
+		}
+		if (request.getPath() == "/" || request.getPath() == location.path) {
 			Response response(200);
 			response.addHeader("Content-Type", "text/html");
 			return response;
 		}
 		return Response::makeErrorResponse(404, &_config);
 	}
-	return FileHandler::serveFile(fullPath, path);
+	Response response = FileHandler::serveFile(target.file.fd, target.file.st, target.relative, request, location.file_io);
+	if (target.isGzip && (response.getStatusCode() == 200 || response.getStatusCode() == 206))
+		response.addHeader("Content-Encoding", "gzip");
+	return response;
+}
+
+bool RequestHandler::streamsListing(const Request &request, const LocationConfig &location) {
+	ListingProducer::Query query;
+	return location.autoindex_format == AUTOINDEX_JSON || ListingProducer::parseQuery(request.getQueryString(), query);
+}
+
+bool RequestHandler::offload(FileTask *task, Response &pending) const {
+	if (task->getReadFd() < 0 || !AIOPool::getInstance().submit(task)) {
+		task->release(); // No eventfd, or the queue is full: done on the loop instead
+		return false;
+	}
+	pending = Response(200);
+	pending.setCGIJob(task);
+	return true;
 }
 
 Response RequestHandler::handlePOST(const Request &request) const {
-	std::string			  path = request.getPath();
-	const LocationConfig *location = getLocation(path);
+	const LocationConfig *location = request.getLocation();
 
 	if (!location)
 		return Response::makeErrorResponse(404, &_config);
 
-	// Check body size limit (skip for zero-length body)
-	if (!request.getBody().empty() && request.getBody().size() > location->client_max_body_size)
+	// Check body size limit (skip for zero-length body); a streamed body is judged by its declared length
+	size_t bodySize = request.isBodyStreamed() ? std::strtoul(request.getHeader("Content-Length").c_str(), NULL, 10)
+											   : request.getBody().size();
+	if (bodySize > location->client_max_body_size)
 		return Response::makeErrorResponse(413, &_config);
 
 	// CGI handling first
-	size_t extPos = path.find_last_of('.');
+	const std::string &script = request.getScriptName();
+	if (!location->fastcgi_pass.empty()) {
+		CGIHandler handler;
+		return handler.executeFastCGI(request, *location, FileHandler::constructFilePath(script, *location));
+	}
+	size_t extPos = script.find_last_of('.');
 	if (extPos != std::string::npos) {
-		std::string										   ext = path.substr(extPos);
+		std::string										   ext = script.substr(extPos);
 		std::map<std::string, std::string>::const_iterator handlerIt = _config.cgi_handlers.find(ext);
 		if (handlerIt != _config.cgi_handlers.end()) {
 			CGIHandler handler;
-			return handler.executeCGI(request, handlerIt->second, FileHandler::constructFilePath(path, *location));
+			if (!location->cgi_worker.empty())
+				return handler.executePooledCGI(request, *location, FileHandler::constructFilePath(script, *location));
+			return handler.executeCGI(request, *location, handlerIt->second,
+									  FileHandler::constructFilePath(script, *location));
 		}
 	}
 
@@ -223,41 +348,84 @@ Response RequestHandler::handlePOST(const Request &request) const {
 }
 
 Response RequestHandler::handleDELETE(const Request &request) const {
-	const LocationConfig *location = getLocation(request.getPath());
+	const LocationConfig *location = request.getLocation();
 	if (!location)
 		return Response::makeErrorResponse(404, &_config);
 
 	if (!isMethodAllowed("DELETE", *location))
 		return Response::makeErrorResponse(405, &_config);
 
+	Response pending;
+	if (location->aio && offload(FileTask::makeDelete(request, _config), pending))
+		return pending;
 	return FileHandler::handleFileDelete(request, *location);
 }
 
-std::string RequestHandler::findFirstExistingIndex(const std::string &dirPath, const std::string &indexFiles) const {
+bool RequestHandler::findFirstExistingIndex(const PathResolver::File &directory, const std::string &indexFiles,
+											PathResolver::File &index) {
 	std::istringstream iss(indexFiles);
 	std::string		   indexFile;
 
 	while (iss >> indexFile) {
 		if (!indexFile.empty() && indexFile[indexFile.length() - 1] == ';')
 			indexFile = indexFile.substr(0, indexFile.length() - 1);
-		std::string fullPath = dirPath + "/" + indexFile;
-		struct stat st;
-		if (stat(fullPath.c_str(), &st) == 0 && !S_ISDIR(st.st_mode))
-			return fullPath;
+		if (PathResolver::getInstance().extend(directory, "/" + indexFile, index) != 0)
+			continue;
+		if (!S_ISDIR(index.st.st_mode))
+			return true;
+		close(index.fd);
 	}
-	return "";
+	return false;
 }
 
 Response RequestHandler::handlePUT(const Request &request) const {
-	// NOT IMPLEMENTED - Just returns OK without saving
-	(void)request;
-	Response response(200);
-	response.addHeader("Content-Type", "text/plain");
-	response.setBody("OK");
-	return response;
+	Response pending;
+	if (request.getBodySink()) { // Already written while it arrived; the rename is left
+		if (request.getLocation()->aio &&
+			offload(FileTask::makePutFinish(request, request.getBodySink(), _config), pending))
+			return pending;
+		return request.getBodySink()->finish(&_config);
+	}
+	PutStream put;
+	if (put.begin(request, *request.getLocation()))
+		put.feed(request.getBody().data(), request.getBody().length());
+	return put.finish(&_config);
+}
+
+void RequestHandler::applyCompression(const Request &request, const LocationConfig &loc, Response &response) const {
+	if (!loc.gzip && !loc.gzip_static)
+		return;
+	if (response.getStatusCode() != 200 && response.getStatusCode() != 206)
+		return;
+	// Caches must key on Accept-Encoding whether or not this reply is compressed
+	response.addHeader("Vary", "Accept-Encoding");
+
+	if (!loc.gzip || !response.getHeader("Content-Encoding").empty() || response.getStatusCode() != 200 ||
+		!Compressor::acceptsGzip(request.getHeader("Accept-Encoding")) ||
+		!Compressor::isCompressibleType(response.getHeader("Content-Type"), loc.gzip_types))
+		return;
+
+	if (response.isStreamed()) {
+		// Unknown lengths (producers) are always worth compressing; HTTP/1.0 gets a close-delimited body
+		std::string contentLength = response.getHeader("Content-Length");
+		if (contentLength.empty() || std::strtoul(contentLength.c_str(), NULL, 10) >= loc.gzip_min_length)
+			response.enableGzipStream(loc.gzip_comp_level);
+	} else if (response.getBody().length() >= loc.gzip_min_length) {
+		response.setBody(Compressor::gzip(response.getBody(), loc.gzip_comp_level));
+		response.addHeader("Content-Encoding", "gzip");
+	}
+	// Another representation needs another entity tag (RFC 9110 8.8.3); weak, as
+	// the bytes depend on gzip_comp_level, so If-Range never matches it
+	std::string etag = response.getHeader("ETag");
+	if (response.getHeader("Content-Encoding") == "gzip" && etag.length() >= 2) {
+		if (etag.compare(0, 2, "W/") == 0)
+			etag.erase(0, 2);
+		response.addHeader("ETag", "W/" + etag.substr(0, etag.length() - 1) + "-gzip\"");
+	}
 }
 
-void RequestHandler::handleCookies(const Request &request, Response &response) const {
+void RequestHandler::handleCookies(const Request &request, const LocationConfig &location,
+								   Response &response) const {
 	// Set server identification cookie
 	response.setCookie("server", "webserv/1.0", "", "/");
 	// Check for existing session
@@ -270,11 +438,13 @@ void RequestHandler::handleCookies(const Request &request, Response &response) c
 	if (visitsIt != cookies.end())
 		visits = std::atoi(visitsIt->second.c_str()) + 1;
 	response.setCookie("visits", Utils::numToString(visits), "", "/");
-	// If no session exists or session is invalid, create a new one
-	if (it == cookies.end()) {
-		response.setSessionId(SessionManager::getInstance().createSession()->getId());
+	// A session is only made where the location asks for one, not for every bot and health check
+	SessionManager &sessions = SessionManager::getInstance();
+	if (it != cookies.end() && sessions.isValidSession(it->second))
+		return;
+	std::string sessionId = location.session ? sessions.createSession() : "";
+	if (!sessionId.empty()) {
+		response.setSessionId(sessionId);
 		response.setCookie("visits", "1", "", "/");
-	} else {
-		SessionManager::getInstance().updateSession(it->second);
 	}
 }
@@ -17,8 +17,25 @@
 #include "../http/Request.hpp"
 #include "../http/Response.hpp"
 #include "../config/ServerConfig.hpp"
+#include "PathResolver.hpp"
+
+class FileTask;
 
 class RequestHandler {
+	public:
+		// What a static GET found on disk: the file to send, or the status to answer with
+		struct StaticTarget {
+			int status;				// 0, or the HTTP error
+			PathResolver::File file;
+			bool isGzip;			// file is the .gz sidecar of what was asked for
+			bool isDirectory;		// A directory without index: listing or empty page
+			bool isStreamed;		// file is that directory, for a ListingProducer
+			std::string listing;	// Autoindex HTML
+			std::string relative;	// Of what was asked for, for its Content-Type
+
+			StaticTarget() : status(0), isGzip(false), isDirectory(false), isStreamed(false) {}
+		};
+
 	private:
 		const ServerConfig &_config;
 
@@ -28,14 +45,44 @@ class RequestHandler {
 		Response handlePUT(const Request &request) const;
 
 		const LocationConfig *getLocation(const std::string &uri) const;
+		// Resolves the location and script name once; later stages read them off the request
+		const LocationConfig *route(Request &request) const;
+		// "/cgi-bin/app.py" for "/cgi-bin/app.py/extra": up to the first segment with a CGI extension
+		std::string findScriptName(const std::string &path) const;
 		bool isMethodAllowed(const std::string &method, const LocationConfig &loc) const;
-		std::string findFirstExistingIndex(const std::string &dirPath, const std::string &indexFiles) const;
+		static bool findFirstExistingIndex(const PathResolver::File &directory, const std::string &indexFiles,
+										   PathResolver::File &index);
+
+		// Hands task to the AIOPool, pending then waiting on it; false (task
+		// dropped) when the pool cannot take it and the work is done inline
+		bool offload(FileTask *task, Response &pending) const;
 
-		void handleCookies(const Request &request, Response &response) const;
+		void handleCookies(const Request &request, const LocationConfig &location, Response &response) const;
+		void applyCompression(const Request &request, const LocationConfig &loc, Response &response) const;
 
 	public:
 		explicit RequestHandler(const ServerConfig &config);
-		Response handleRequest(const Request &request);
+		Response handleRequest(Request &request);
+		// Finishing touches for a CGI response filled in after the child exited
+		void completeCGIResponse(const Request &request, Response &response) const;
+		// True when the request goes to a forked CGI script that can read its
+		// body while it uploads; maxBodySize is the location's limit
+		bool streamsBody(Request &request, size_t &maxBodySize) const;
+		// The sink to write the body to disk with as it arrives, for a
+		// multipart upload (UploadStream), a PUT (PutStream) or a resumable
+		// upload's PATCH (ResumableUploads); NULL when the
+		// request is not one. A sink that already failed has getStatus() set
+		BodySink *makeBodySink(Request &request, size_t &maxBodySize) const;
+
+		// The blocking half of a static GET (open, index, listing, sidecar),
+		// safe on an AIOPool thread; streamsListing: a directory listing is
+		// left to a ListingProducer
+		static void findStatic(const std::string &path, const LocationConfig &location, const std::string &defaultIndex,
+							   bool streamsListing, bool wantsGzip, StaticTarget &target);
+		// JSON listings and sorted or paged ones are streamed, not cached
+		static bool streamsListing(const Request &request, const LocationConfig &location);
+		// The response for what findStatic() found; takes target.file.fd over
+		Response serveStatic(const Request &request, const LocationConfig &location, const StaticTarget &target) const;
 };
 
 #endif
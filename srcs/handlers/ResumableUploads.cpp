@@ -0,0 +1,397 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ResumableUploads.cpp                               :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 14:02:36 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 14:02:36 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ResumableUploads.hpp"
+#include "UploadStream.hpp"
+#include <sys/statvfs.h>
+
+#define TUS_VERSION "1.0.0"
+#define TUS_EXTENSIONS "creation,expiration,termination"
+#define UPLOAD_ID_BYTES 16 // 128 random bits, hex in the URL
+
+ResumableUploads *ResumableUploads::_instance = NULL;
+
+ResumableUploads::ResumableUploads() : _lastSweep(0) {
+}
+
+ResumableUploads &ResumableUploads::getInstance() {
+	if (!_instance)
+		_instance = new ResumableUploads();
+	return *_instance;
+}
+
+Response ResumableUploads::handle(const Request &request, const LocationConfig &location, const ServerConfig *config) {
+	const std::string &method = request.getMethod();
+	if (method == "OPTIONS") {
+		Response response(204);
+		response.addHeader("Tus-Resumable", TUS_VERSION);
+		response.addHeader("Tus-Version", TUS_VERSION);
+		response.addHeader("Tus-Extension", TUS_EXTENSIONS);
+		if (location.upload_max_file_size)
+			response.addHeader("Tus-Max-Size", Utils::numToString(location.upload_max_file_size));
+		return response;
+	}
+	std::string version = request.getHeader("Tus-Resumable");
+	if (!version.empty() && version != TUS_VERSION) {
+		Response response = status("", 412, config);
+		response.addHeader("Tus-Version", TUS_VERSION);
+		return response;
+	}
+	if (method == "POST")
+		return create(request, location, config);
+	if (method == "PATCH") {
+		if (request.getBodySink()) // Written while it arrived, through beginPatch()
+			return request.getBodySink()->finish(config);
+		Patch patch;
+		size_t maxBodySize;
+		openPatch(request, location, patch, maxBodySize);
+		patch.feed(request.getBody().data(), request.getBody().length());
+		return patch.finish(config);
+	}
+
+	std::string id;
+	Upload	   *upload = find(request, id);
+	if (!upload)
+		return status("", 404, config);
+	if (method == "DELETE") {
+		if (!upload->complete)
+			unlink(upload->tempPath.c_str()); // A PATCH still writing keeps its fd
+		_uploads.erase(id);
+		return status("", 204, config);
+	}
+	if (method == "HEAD") {
+		Response response = status(id, 200, config);
+		response.addHeader("Upload-Length", Utils::numToString(static_cast<long>(upload->length)));
+		response.addHeader("Cache-Control", "no-store");
+		return response;
+	}
+	return status("", 405, config);
+}
+
+ResumableUploads::Patch *ResumableUploads::beginPatch(const Request &request, const LocationConfig &location,
+													 size_t &maxBodySize) {
+	Patch *patch = new Patch();
+	std::string version = request.getHeader("Tus-Resumable");
+	if (!version.empty() && version != TUS_VERSION)
+		patch->_status = 412;
+	else
+		openPatch(request, location, *patch, maxBodySize);
+	return patch;
+}
+
+void ResumableUploads::openPatch(const Request &request, const LocationConfig &location, Patch &patch,
+								 size_t &maxBodySize) {
+	maxBodySize = location.client_max_body_size;
+	if (Utils::toLower(request.getHeader("Content-Type")) != "application/offset+octet-stream") {
+		patch._status = 415;
+		return;
+	}
+	std::string id;
+	Upload	   *upload = find(request, id);
+	off_t		offset;
+	if (!upload) {
+		patch._status = 404;
+		return;
+	}
+	if (!parseOffset(request.getHeader("Upload-Offset"), offset)) {
+		patch._status = 400;
+		return;
+	}
+	if (offset > upload->length || (upload->complete && offset < upload->length)) {
+		patch._status = 409; // Nothing there to write to any more
+		return;
+	}
+	const std::string &contentLength = request.getHeader("Content-Length");
+	if (!contentLength.empty() &&
+		std::strtoul(contentLength.c_str(), NULL, 10) > static_cast<unsigned long>(upload->length - offset)) {
+		patch._status = 413; // Past Upload-Length
+		return;
+	}
+	if (!upload->complete) {
+		patch._fd = open(upload->tempPath.c_str(), O_WRONLY | O_CLOEXEC);
+		if (patch._fd < 0) {
+			patch._status = 500;
+			return;
+		}
+	}
+	patch._id = id;
+	patch._start = offset;
+	patch._offset = offset;
+	patch._length = upload->length;
+	patch._recorded = false;
+	++upload->writers;
+	upload->expires = time(NULL) + upload->lifetime;
+	// Up to the rest of the upload, but no more than any body here. A longer
+	// Content-Length is refused whole with 413 before anything is written, so
+	// clients must send the upload in PATCHes of at most client_max_body_size.
+	maxBodySize = std::min(static_cast<size_t>(location.client_max_body_size),
+						   static_cast<size_t>(upload->length - offset));
+}
+
+void ResumableUploads::expire() {
+	time_t now = time(NULL);
+	if (now == _lastSweep)
+		return;
+	_lastSweep = now;
+	for (std::map<std::string, Upload>::iterator it = _uploads.begin(); it != _uploads.end();) {
+		if (it->second.writers == 0 && now >= it->second.expires) {
+			if (!it->second.complete)
+				unlink(it->second.tempPath.c_str());
+			_uploads.erase(it++);
+		} else {
+			++it;
+		}
+	}
+}
+
+Response ResumableUploads::create(const Request &request, const LocationConfig &location,
+								  const ServerConfig *config) {
+	Upload upload;
+	if (!parseOffset(request.getHeader("Upload-Length"), upload.length))
+		return status("", 400, config); // Upload-Defer-Length is not offered either
+	if (location.upload_max_file_size && static_cast<unsigned long>(upload.length) > location.upload_max_file_size) {
+		Response response = status("", 413, config);
+		response.addHeader("Tus-Max-Size", Utils::numToString(location.upload_max_file_size));
+		return response;
+	}
+	upload.directory = UploadStream::directoryOf(location);
+	if (!Utils::createDirectories(upload.directory))
+		return status("", 500, config);
+	// Nor more than the filesystem still has room for: the file is allocated whole
+	struct statvfs fs;
+	if (statvfs(upload.directory.c_str(), &fs) == 0 &&
+		static_cast<unsigned long long>(upload.length) >
+			static_cast<unsigned long long>(fs.f_bavail) * static_cast<unsigned long long>(fs.f_frsize)) {
+		Response response = status("", 413, config);
+		response.addHeader("Tus-Max-Size",
+						   Utils::numToString(static_cast<off_t>(fs.f_bavail * static_cast<off_t>(fs.f_frsize))));
+		return response;
+	}
+
+	std::string id = makeId();
+	upload.tempPath = upload.directory + "/.tus-" + id;
+	int fd = open(upload.tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return status("", 500, config);
+	// Reserve the blocks now, so a full disk shows here and not halfway
+	// through; where that cannot be done the file is left sparse
+	int error = 0;
+#ifdef __linux__
+	if (upload.length > 0 && fallocate(fd, 0, 0, upload.length) != 0)
+		error = errno;
+#endif
+	if (error == ENOSPC || error == EDQUOT || ftruncate(fd, upload.length) != 0) {
+		int code = error == ENOSPC || error == EDQUOT ? 507 : 500;
+		close(fd);
+		unlink(upload.tempPath.c_str());
+		return status("", code, config);
+	}
+	close(fd);
+
+	upload.finalName = UploadStream::sanitizeFilename(metadataFilename(request.getHeader("Upload-Metadata")));
+	if (upload.finalName.find_first_not_of('.') == std::string::npos)
+		upload.finalName = id;
+	std::string path = request.getPath();
+	if (path.empty() || path[path.length() - 1] != '/')
+		path += '/';
+	upload.location = path + id;
+	upload.lifetime = location.upload_resumable_expire;
+	upload.expires = time(NULL) + upload.lifetime;
+	_uploads[id] = upload;
+	record(id, 0, 0); // An empty upload is complete already
+
+	Response response = status("", 201, config);
+	response.addHeader("Location", upload.location);
+	response.addHeader("Upload-Expires", Utils::formatHttpDate(upload.expires));
+	return response;
+}
+
+// Response with code carrying the protocol headers, and the upload's offset when id is given
+Response ResumableUploads::status(const std::string &id, int code, const ServerConfig *config) {
+	Response response = code >= 400 ? Response::makeErrorResponse(code, config) : Response(code);
+	response.addHeader("Tus-Resumable", TUS_VERSION);
+	std::map<std::string, Upload>::iterator it = _uploads.find(id);
+	if (it != _uploads.end()) {
+		response.addHeader("Upload-Offset", Utils::numToString(static_cast<long>(offsetOf(it->second))));
+		response.addHeader("Upload-Expires", Utils::formatHttpDate(it->second.expires));
+	}
+	return response;
+}
+
+ResumableUploads::Upload *ResumableUploads::find(const Request &request, std::string &id) {
+	const std::string &path = request.getPath();
+	id = path.substr(path.rfind('/') + 1);
+	std::map<std::string, Upload>::iterator it = _uploads.find(id);
+	if (it == _uploads.end() || it->second.location != path)
+		return NULL;
+	return &it->second;
+}
+
+// A PATCH wrote [start, end): merge it into the index, and put the file in
+// place once the index covers all of it
+void ResumableUploads::record(const std::string &id, off_t start, off_t end) {
+	std::map<std::string, Upload>::iterator found = _uploads.find(id);
+	if (found == _uploads.end())
+		return; // Terminated meanwhile
+	Upload &upload = found->second;
+	upload.expires = time(NULL) + upload.lifetime;
+
+	if (end > start) {
+		std::map<off_t, off_t>			 &ranges = upload.ranges;
+		std::map<off_t, off_t>::iterator it = ranges.upper_bound(start);
+		if (it != ranges.begin()) {
+			std::map<off_t, off_t>::iterator previous = it;
+			--previous;
+			if (previous->second >= start) { // Overlaps or touches the range before
+				start = previous->first;
+				end = std::max(end, previous->second);
+				ranges.erase(previous);
+			}
+		}
+		while (it != ranges.end() && it->first <= end) {
+			end = std::max(end, it->second);
+			ranges.erase(it++);
+		}
+		ranges[start] = end;
+	}
+	if (!upload.complete && offsetOf(upload) == upload.length) {
+		std::string target = upload.directory + "/" + upload.finalName;
+		upload.complete = rename(upload.tempPath.c_str(), target.c_str()) == 0;
+	}
+}
+
+Response ResumableUploads::finishPatch(Patch &patch, const ServerConfig *config) {
+	patch.record();
+	if (patch._status)
+		return status("", patch._status, config);
+	std::map<std::string, Upload>::iterator it = _uploads.find(patch._id);
+	if (it == _uploads.end())
+		return status("", 404, config); // Terminated while the body arrived
+	if (offsetOf(it->second) == it->second.length && !it->second.complete)
+		return status("", 500, config); // All there, but the rename failed
+	return status(patch._id, 204, config);
+}
+
+off_t ResumableUploads::offsetOf(const Upload &upload) {
+	std::map<off_t, off_t>::const_iterator it = upload.ranges.find(0);
+	return it == upload.ranges.end() ? 0 : it->second;
+}
+
+std::string ResumableUploads::makeId() {
+	unsigned char bytes[UPLOAD_ID_BYTES];
+	int			  fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || read(fd, bytes, sizeof(bytes)) != static_cast<ssize_t>(sizeof(bytes))) {
+		for (size_t i = 0; i < sizeof(bytes); ++i) bytes[i] = static_cast<unsigned char>(rand());
+	}
+	if (fd >= 0)
+		close(fd);
+	static const char digits[] = "0123456789abcdef";
+	std::string		  id;
+	for (size_t i = 0; i < sizeof(bytes); ++i) {
+		id += digits[bytes[i] >> 4];
+		id += digits[bytes[i] & 15];
+	}
+	return id;
+}
+
+// "key base64value,key2 base64value2": the decoded value of "filename"
+std::string ResumableUploads::metadataFilename(const std::string &metadata) {
+	static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t			  start = 0;
+	while (start < metadata.length()) {
+		size_t		end = metadata.find(',', start);
+		std::string pair = Utils::trim(metadata.substr(start, end == std::string::npos ? std::string::npos : end - start));
+		start = end == std::string::npos ? metadata.length() : end + 1;
+		size_t space = pair.find(' ');
+		if (pair.substr(0, space) != "filename" || space == std::string::npos)
+			continue;
+
+		std::string decoded;
+		unsigned	bits = 0;
+		int			count = 0;
+		for (size_t i = space + 1; i < pair.length() && pair[i] != '='; ++i) {
+			const char *digit = pair[i] ? strchr(base64, pair[i]) : NULL;
+			if (!digit)
+				return "";
+			bits = (bits << 6) | (digit - base64);
+			if ((count += 6) >= 8) {
+				count -= 8;
+				decoded += static_cast<char>((bits >> count) & 0xFF);
+			}
+		}
+		return decoded;
+	}
+	return "";
+}
+
+bool ResumableUploads::parseOffset(const std::string &value, off_t &offset) {
+	if (value.empty() || value.length() > 18 || value.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	offset = 0;
+	for (size_t i = 0; i < value.length(); ++i) offset = offset * 10 + (value[i] - '0');
+	return true;
+}
+
+ResumableUploads::Patch::Patch() : _fd(-1), _start(0), _offset(0), _length(0), _recorded(true) {
+}
+
+ResumableUploads::Patch::~Patch() {
+	record();
+}
+
+bool ResumableUploads::Patch::feed(const char *data, size_t length) {
+	if (_status)
+		return false;
+	if (static_cast<off_t>(length) > _length - _offset) {
+		_status = 413; // Past Upload-Length
+		return false;
+	}
+	while (length > 0) {
+		ssize_t written = pwrite(_fd, data, length, _offset);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			_status = errno == ENOSPC || errno == EDQUOT ? 507 : 500;
+			return false;
+		}
+		data += written;
+		length -= written;
+		_offset += written;
+	}
+	return true;
+}
+
+ssize_t ResumableUploads::Patch::receive(int socketFd, size_t limit) {
+	if (static_cast<off_t>(limit) > _length - _offset)
+		return BodySink::receive(socketFd, limit); // Longer than the upload: feed() refuses it
+	return spliceInto(socketFd, limit, _fd, _offset);
+}
+
+Response ResumableUploads::Patch::finish(const ServerConfig *config) {
+	return ResumableUploads::getInstance().finishPatch(*this, config);
+}
+
+// What was written is kept, even of a failed or cut-off PATCH: the client
+// learns the new offset from HEAD and sends only the rest
+void ResumableUploads::Patch::record() {
+	if (_recorded)
+		return;
+	_recorded = true;
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+	std::map<std::string, Upload>::iterator it = ResumableUploads::getInstance()._uploads.find(_id);
+	if (it != ResumableUploads::getInstance()._uploads.end())
+		--it->second.writers;
+	ResumableUploads::getInstance().record(_id, _start, _offset);
+}
@@ -0,0 +1,109 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ResumableUploads.hpp                               :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 14:02:36 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 14:02:36 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef RESUMABLE_UPLOADS_HPP
+#define RESUMABLE_UPLOADS_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include "../http/BodySink.hpp"
+#include "../http/Request.hpp"
+#include "../http/Response.hpp"
+
+// Resumable uploads for "upload_resumable" locations, after the tus 1.0
+// protocol (core, creation, expiration, termination):
+//
+//   POST  /loc		Upload-Length: N		-> 201, Location: /loc/<id>
+//   HEAD  /loc/<id>						-> Upload-Offset: bytes stored from 0
+//   PATCH /loc/<id>	Upload-Offset: n, body	-> 204, the new Upload-Offset
+//   DELETE /loc/<id>						-> 204, upload dropped
+//
+// Each upload is a hidden file of its full length in the upload directory,
+// its blocks reserved with fallocate() when it is created, and an index of
+// the byte ranges written so far. A PATCH may start anywhere inside the
+// file, so a client can send ranges in parallel or retry one; the offset
+// reported is the end of the range that starts at 0. Once that covers the
+// whole length the file is renamed to its final name (the "filename" of
+// Upload-Metadata, else the id). Uploads untouched for
+// upload_resumable_expire seconds are dropped with their file.
+class ResumableUploads {
+	public:
+		// One PATCH body, written at its offset while it arrives
+		class Patch : public BodySink {
+			public:
+				~Patch(); // Records what was written, even of a cut-off body
+
+				bool feed(const char *data, size_t length);
+				ssize_t receive(int socketFd, size_t limit);
+				Response finish(const ServerConfig *config);
+
+			private:
+				friend class ResumableUploads;
+
+				std::string _id;
+				int _fd;
+				off_t _start;		// Upload-Offset of the PATCH
+				off_t _offset;		// Where the next body byte goes
+				off_t _length;		// Of the whole upload: no byte goes past it
+				bool _recorded;
+
+				Patch();
+				void record();
+		};
+
+		static ResumableUploads &getInstance();
+
+		// Answers OPTIONS, POST, HEAD, DELETE, and a PATCH whose body was buffered
+		Response handle(const Request &request, const LocationConfig &location, const ServerConfig *config);
+		// The sink for a PATCH body; one that already failed has getStatus() set
+		Patch *beginPatch(const Request &request, const LocationConfig &location, size_t &maxBodySize);
+		// Drops uploads past their expiry
+		void expire();
+
+	private:
+		struct Upload {
+			std::string directory;
+			std::string tempPath;		// Hidden file being filled
+			std::string finalName;
+			std::string location;		// URL path the upload lives under
+			off_t length;				// Upload-Length
+			std::map<off_t, off_t> ranges; // Written byte ranges, start to end, merged
+			unsigned long lifetime;		// Seconds of inactivity before it expires
+			time_t expires;
+			size_t writers;				// PATCHes in flight
+			bool complete;				// Renamed to finalName
+
+			Upload() : length(0), lifetime(0), expires(0), writers(0), complete(false) {}
+		};
+
+		static ResumableUploads *_instance;
+
+		std::map<std::string, Upload> _uploads;	// By id
+		time_t _lastSweep;
+
+		ResumableUploads();
+		void openPatch(const Request &request, const LocationConfig &location, Patch &patch, size_t &maxBodySize);
+		Response create(const Request &request, const LocationConfig &location, const ServerConfig *config);
+		Response status(const std::string &id, int code, const ServerConfig *config);
+		Upload *find(const Request &request, std::string &id);
+		void record(const std::string &id, off_t start, off_t end);
+		Response finishPatch(Patch &patch, const ServerConfig *config);
+		static off_t offsetOf(const Upload &upload);
+		static std::string makeId();
+		static std::string metadataFilename(const std::string &metadata);
+		static bool parseOffset(const std::string &value, off_t &offset);
+
+		ResumableUploads(const ResumableUploads &);
+		ResumableUploads &operator=(const ResumableUploads &);
+};
+
+#endif
@@ -0,0 +1,154 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UploadStream.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 23:05:19 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 23:05:19 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "UploadStream.hpp"
+
+UploadStream::UploadStream(const LocationConfig &location) :
+		_directory(directoryOf(location)),
+		_maxFileSize(location.upload_max_file_size),
+		_fd(-1),
+		_written(0) {
+}
+
+UploadStream::~UploadStream() {
+	discardPart();
+}
+
+std::string UploadStream::directoryOf(const LocationConfig &location) {
+	if (location.root.empty())
+		return "www/upload"; // Default fallback
+	std::string directory = location.root;
+	if (directory[directory.length() - 1] != '/')
+		directory += '/';
+	if (!location.path.empty() && location.path != "/" && !location.isRegex())
+		directory += location.path[0] == '/' ? location.path.substr(1) : location.path;
+	return directory;
+}
+
+bool UploadStream::begin(const std::string &contentType) {
+	if (!_parser.begin(contentType))
+		return fail(400);
+	if (!Utils::createDirectories(_directory))
+		return fail(500);
+	return true;
+}
+
+bool UploadStream::feed(const char *data, size_t length) {
+	if (_status)
+		return false;
+	if (_parser.feed(data, length, *this) == MultipartParser::MULTIPART_ERROR)
+		return fail(400); // Keeps the status of a handler failure
+	return true;
+}
+
+Response UploadStream::finish(const ServerConfig *config) {
+	if (!_status && !_parser.isDone())
+		fail(400); // Body ended before the closing delimiter
+	if (!_status && _saved.empty())
+		fail(400); // No file in it
+	if (_status)
+		return Response::makeErrorResponse(_status, config);
+
+	Response response(201);
+	response.addHeader("Content-Type", "text/plain");
+	if (_saved.size() == 1)
+		response.setBody("File uploaded successfully");
+	else
+		response.setBody(Utils::numToString(_saved.size()) + " files uploaded successfully");
+	return response;
+}
+
+bool UploadStream::beginPart(const MultipartParser::Part &part) {
+	if (!part.isFile)
+		return true; // A plain form field: its data is dropped
+	std::string filename = sanitizeFilename(part.filename);
+	if (filename.find_first_not_of('.') == std::string::npos)
+		return fail(400); // Nothing left of the name, or only "." and ".."
+
+	static unsigned long counter = 0;
+	_finalPath = _directory + "/" + filename;
+	for (int attempt = 0; _fd < 0 && attempt < 8; ++attempt) {
+		_tempPath = _directory + "/.upload-" + Utils::numToString(static_cast<long>(getpid())) + "-" +
+					Utils::numToString(++counter);
+		_fd = open(_tempPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (_fd < 0 && errno != EEXIST)
+			break;
+	}
+	if (_fd < 0) {
+		_tempPath.clear();
+		return fail(500);
+	}
+	_written = 0;
+	return true;
+}
+
+bool UploadStream::partData(const char *data, size_t length) {
+	if (_fd < 0)
+		return true;
+	_written += length;
+	if (_maxFileSize && _written > _maxFileSize)
+		return fail(413);
+	while (length > 0) {
+		ssize_t written = write(_fd, data, length);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return fail(500);
+		}
+		data += written;
+		length -= written;
+	}
+	return true;
+}
+
+bool UploadStream::endPart() {
+	if (_fd < 0)
+		return true;
+	int fd = _fd;
+	_fd = -1;
+	if (close(fd) != 0 || rename(_tempPath.c_str(), _finalPath.c_str()) != 0) {
+		unlink(_tempPath.c_str());
+		_tempPath.clear();
+		return fail(500);
+	}
+	_tempPath.clear();
+	_saved.push_back(_finalPath.substr(_directory.length() + 1));
+	return true;
+}
+
+bool UploadStream::fail(int status) {
+	if (!_status)
+		_status = status;
+	discardPart();
+	return false;
+}
+
+void UploadStream::discardPart() {
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+	if (!_tempPath.empty()) {
+		unlink(_tempPath.c_str());
+		_tempPath.clear();
+	}
+}
+
+std::string UploadStream::sanitizeFilename(const std::string &filename) {
+	std::string safe;
+	for (size_t i = 0; i < filename.length(); i++) {
+		char c = filename[i];
+		if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == ' ')
+			safe += c;
+	}
+	return safe;
+}
@@ -0,0 +1,61 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UploadStream.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 23:05:19 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 23:05:19 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef UPLOAD_STREAM_HPP
+#define UPLOAD_STREAM_HPP
+
+#include "../WebServ.hpp"
+#include "../config/ServerConfig.hpp"
+#include "../http/BodySink.hpp"
+#include "../http/MultipartParser.hpp"
+
+// A multipart/form-data upload written to the location's upload directory
+// while the body arrives. Each file part goes to a hidden temp file next to
+// its destination and is renamed over it once the part is complete, so a
+// reader never sees half a file. Form fields without a filename are skipped.
+class UploadStream : public BodySink, public MultipartParser::Handler {
+	public:
+		explicit UploadStream(const LocationConfig &location);
+		~UploadStream(); // Removes the temp file of an unfinished part
+
+		// False, with getStatus() set, if the body cannot be taken
+		bool begin(const std::string &contentType);
+		bool feed(const char *data, size_t length);
+		// 201, or the error to answer with
+		Response finish(const ServerConfig *config);
+
+		static std::string directoryOf(const LocationConfig &location);
+		// Keeps letters, digits and "-_. "; what is left may be empty or only dots
+		static std::string sanitizeFilename(const std::string &filename);
+
+		bool beginPart(const MultipartParser::Part &part);
+		bool partData(const char *data, size_t length);
+		bool endPart();
+
+	private:
+		MultipartParser _parser;
+		std::string _directory;
+		unsigned long _maxFileSize;	// Per file part, 0 for no own cap
+		int _fd;					// Temp file of the part being written, -1 if none
+		std::string _tempPath;
+		std::string _finalPath;
+		unsigned long _written;
+		std::vector<std::string> _saved;	// Names stored so far
+
+		bool fail(int status);
+		void discardPart();
+
+		UploadStream(const UploadStream &);
+		UploadStream &operator=(const UploadStream &);
+};
+
+#endif
@@ -0,0 +1,55 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodyProducer.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/16 11:24:09 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/16 11:24:09 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BODY_PRODUCER_HPP
+#define BODY_PRODUCER_HPP
+
+#include "../WebServ.hpp"
+
+// Source of response body fragments, usually of a length not known up front.
+// The response writer pulls from it and frames the output as chunked
+// (HTTP/1.1) or close-delimited (HTTP/1.0), or sends it as is when the
+// length was declared (setBodyProducer). Reference counted because
+// responses are copied on their way to the client state.
+class BodyProducer {
+	public:
+		enum Status {
+			DATA,	// Fragment appended to the output
+			AGAIN,	// Nothing yet; pulled again once isReady(), at the earliest next loop turn
+			DONE,	// Body complete
+			FAILED	// Abort: the connection is closed mid-body
+		};
+
+		BodyProducer() : _refCount(1) {}
+		virtual ~BodyProducer() {}
+
+		// Append the next fragment (never empty when returning DATA)
+		virtual Status produce(std::string &output) = 0;
+		// True when produce() would not return AGAIN
+		virtual bool isReady() const = 0;
+		// Descriptor whose readability may make the producer ready, -1 if none
+		virtual int getWaitFd() const { return -1; }
+
+		void retain() { ++_refCount; }
+		void release() {
+			if (--_refCount == 0)
+				delete this;
+		}
+
+	private:
+		size_t _refCount;
+
+		BodyProducer(const BodyProducer &);
+		BodyProducer &operator=(const BodyProducer &);
+};
+
+#endif
@@ -0,0 +1,124 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodyPump.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 10:31:18 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 10:31:18 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "BodyPump.hpp"
+#include <sys/poll.h>
+
+BodyPump::BodyPump() :
+		_isActive(false),
+		_sourceFd(-1),
+		_isSocket(false),
+		_remaining(0),
+		_pendingOffset(0),
+		_isPipeFull(false),
+		_canSplice(false) {
+}
+
+void BodyPump::begin(const std::string &buffered, int sourceFd, size_t remaining, bool isSocket) {
+	_isActive = true;
+	_sourceFd = sourceFd;
+	_isSocket = isSocket;
+	_remaining = sourceFd >= 0 ? remaining : 0;
+	_pending = buffered;
+	_pendingOffset = 0;
+	_isPipeFull = false;
+#ifdef __linux__
+	_canSplice = true;
+#endif
+}
+
+void BodyPump::reset() {
+	*this = BodyPump();
+}
+
+bool BodyPump::wantsSource() const {
+	// A file source is always readable, so only a socket is worth waiting for
+	return _isActive && _isSocket && _remaining > 0 && _pendingOffset >= _pending.length() && !_isPipeFull;
+}
+
+bool BodyPump::wantsSink() const {
+	return _isActive && (_pendingOffset < _pending.length() || _isPipeFull || (!_isSocket && _remaining > 0));
+}
+
+BodyPump::Status BodyPump::pump(int pipeFd) {
+	if (!_isActive)
+		return PUMP_DONE;
+	_isPipeFull = false;
+
+	for (;;) {
+		Status status = flushPending(pipeFd);
+		if (status != PUMP_DONE)
+			return status;
+		if (_remaining == 0)
+			return PUMP_DONE;
+		status = copyFromSource(pipeFd);
+		if (status != PUMP_DONE)
+			return status;
+	}
+}
+
+BodyPump::Status BodyPump::flushPending(int pipeFd) {
+	while (_pendingOffset < _pending.length()) {
+		ssize_t written = write(pipeFd, _pending.data() + _pendingOffset, _pending.length() - _pendingOffset);
+		if (written < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return PUMP_ERROR; // EPIPE: the script stopped reading
+			_isPipeFull = true;
+			return PUMP_MORE;
+		}
+		_pendingOffset += written;
+	}
+	std::string().swap(_pending);
+	_pendingOffset = 0;
+	return PUMP_DONE;
+}
+
+// Moves one slice from the source; PUMP_DONE means "made progress, go on"
+BodyPump::Status BodyPump::copyFromSource(int pipeFd) {
+	size_t slice = std::min(_remaining, static_cast<size_t>(BODY_PUMP_BUFSIZE));
+
+#ifdef __linux__
+	if (_canSplice) {
+		ssize_t moved = splice(_sourceFd, NULL, pipeFd, NULL, slice, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (moved > 0) {
+			_remaining -= moved;
+			return PUMP_DONE;
+		}
+		if (moved == 0)
+			return PUMP_ERROR; // Client closed before the whole body arrived
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			// Either side may be the one that would block; ask the pipe
+			_isPipeFull = !isPipeWritable(pipeFd);
+			return PUMP_MORE;
+		}
+		if (errno == EPIPE)
+			return PUMP_ERROR;
+		_canSplice = false; // Not spliceable here (EINVAL): copy instead
+	}
+#endif
+
+	char	buffer[BODY_PUMP_BUFSIZE];
+	ssize_t bytes = read(_sourceFd, buffer, slice);
+	if (bytes > 0) {
+		_remaining -= bytes;
+		_pending.assign(buffer, bytes);
+		return PUMP_DONE;
+	}
+	if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return PUMP_MORE;
+	return PUMP_ERROR;
+}
+
+bool BodyPump::isPipeWritable(int pipeFd) const {
+	struct pollfd pfd = {pipeFd, POLLOUT, 0};
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLOUT);
+}
@@ -0,0 +1,62 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodyPump.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 10:31:18 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 10:31:18 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BODY_PUMP_HPP
+#define BODY_PUMP_HPP
+
+#include "../WebServ.hpp"
+
+// Moves a request body of known length into a pipe (a CGI child's stdin)
+// without blocking: first the bytes already buffered in memory, then the
+// rest straight from the client socket or a spilled body file. On Linux the
+// source is spliced into the pipe; elsewhere at most BODY_PUMP_BUFSIZE bytes
+// are held. A full pipe stops reads from the socket, so a slow script
+// throttles the upload instead of the server buffering it.
+// Holds no descriptors of its own.
+class BodyPump {
+	public:
+		enum Status {
+			PUMP_MORE,		// Wait for wantsSource()/wantsSink() readiness
+			PUMP_DONE,		// Whole body delivered
+			PUMP_ERROR		// Source ended early or the reader went away
+		};
+
+		BodyPump();
+
+		void begin(const std::string &buffered, int sourceFd, size_t remaining, bool isSocket);
+		void reset();
+		bool isActive() const { return _isActive; }
+		// Bytes still expected from a socket source (unread when the pump stops early)
+		bool hasUnreadSocketData() const { return _isActive && _isSocket && _remaining > 0; }
+
+		// What the event loop should wait for before calling pump() again
+		bool wantsSource() const;
+		bool wantsSink() const;
+
+		Status pump(int pipeFd);
+
+	private:
+		bool _isActive;
+		int _sourceFd;
+		bool _isSocket;
+		size_t _remaining;		// Bytes left to take from the source
+		std::string _pending;	// Bytes taken but not yet in the pipe
+		size_t _pendingOffset;
+		bool _isPipeFull;
+		bool _canSplice;
+
+		Status flushPending(int pipeFd);
+		Status copyFromSource(int pipeFd);
+		bool isPipeWritable(int pipeFd) const;
+};
+
+#endif
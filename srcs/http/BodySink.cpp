@@ -0,0 +1,91 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodySink.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 10:12:40 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 10:12:40 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "BodySink.hpp"
+
+BodySink::BodySink() : _status(0), _canSplice(false) {
+	_pipe[0] = -1;
+	_pipe[1] = -1;
+#ifdef __linux__
+	_canSplice = true;
+#endif
+}
+
+BodySink::~BodySink() {
+	for (int i = 0; i < 2; ++i)
+		if (_pipe[i] >= 0)
+			close(_pipe[i]);
+}
+
+ssize_t BodySink::receive(int socketFd, size_t limit) {
+	char	buffer[CHUNK_BUFFER_SIZE];
+	ssize_t bytes = recv(socketFd, buffer, std::min(limit, sizeof(buffer)), MSG_DONTWAIT);
+	if (bytes > 0 && !feed(buffer, bytes))
+		return -1;
+	return bytes;
+}
+
+ssize_t BodySink::spliceInto(int socketFd, size_t limit, int fd, off_t &offset) {
+	if (_status)
+		return -1;
+#ifdef __linux__
+	if (_canSplice && _pipe[0] < 0) {
+		if (pipe(_pipe) < 0) {
+			_pipe[0] = _pipe[1] = -1;
+			_canSplice = false;
+		} else {
+			for (int i = 0; i < 2; ++i) fcntl(_pipe[i], F_SETFD, FD_CLOEXEC);
+			fcntl(_pipe[0], F_SETFL, fcntl(_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+#ifdef F_SETPIPE_SZ
+			fcntl(_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_BUFSIZE);
+#endif
+		}
+	}
+	if (_canSplice) {
+		size_t	slice = std::min(limit, static_cast<size_t>(SPLICE_PIPE_BUFSIZE));
+		ssize_t moved = splice(socketFd, NULL, _pipe[1], NULL, slice, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (moved >= 0 || errno != EINVAL) {
+			// Empty the pipe into the file before returning, so it never
+			// holds body bytes between calls
+			size_t left = moved > 0 ? moved : 0;
+			while (left > 0) {
+				loff_t	position = offset;
+				ssize_t written = splice(_pipe[0], NULL, fd, &position, left, SPLICE_F_MOVE);
+				if (written <= 0) {
+					if (written < 0 && errno == EINTR)
+						continue;
+					break;
+				}
+				offset = position;
+				left -= written;
+			}
+			while (left > 0) { // The file refused splice(): copy the rest out of the pipe
+				_canSplice = false;
+				char	buffer[RESPONSE_SIZE];
+				ssize_t bytes = read(_pipe[0], buffer, std::min(left, sizeof(buffer)));
+				if (bytes <= 0 || !feed(buffer, bytes)) {
+					if (!_status)
+						_status = 500;
+					return -1;
+				}
+				left -= bytes;
+			}
+			return moved;
+		}
+		_canSplice = false; // Not a spliceable socket: recv() instead
+	}
+#else
+	(void)fd;
+	(void)offset;
+#endif
+	return BodySink::receive(socketFd, limit);
+}
@@ -0,0 +1,54 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BodySink.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 10:12:40 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 10:12:40 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BODY_SINK_HPP
+#define BODY_SINK_HPP
+
+#include "../WebServ.hpp"
+#include "Response.hpp"
+
+// A request body written to disk while it arrives instead of being buffered
+// (multipart uploads, PUT). The server hands it the body; the request's
+// handler then asks it for the response.
+class BodySink {
+	public:
+		virtual ~BodySink();
+
+		// False, with getStatus() set, once the body cannot be taken any further
+		virtual bool feed(const char *data, size_t length) = 0;
+		// Takes up to limit body bytes straight from socketFd. Returns like
+		// recv(): bytes taken, 0 at EOF, -1 with errno set; -1 with
+		// getStatus() set when the sink failed
+		virtual ssize_t receive(int socketFd, size_t limit);
+		// The body has ended: the response to send
+		virtual Response finish(const ServerConfig *config) = 0;
+		int getStatus() const { return _status; }
+
+	protected:
+		int _status;	// HTTP status to fail with, 0 while all is well
+
+		BodySink();
+		// receive() for a sink writing to fd at offset, which it advances. On
+		// Linux the bytes go socket -> pipe -> file with splice() and never
+		// pass through user space; otherwise, or once either end refuses
+		// splice(), they go through feed() like receive()
+		ssize_t spliceInto(int socketFd, size_t limit, int fd, off_t &offset);
+
+	private:
+		int _pipe[2];		// Created on first use
+		bool _canSplice;
+
+		BodySink(const BodySink &);
+		BodySink &operator=(const BodySink &);
+};
+
+#endif
@@ -0,0 +1,70 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChunkDecoder.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 10:12:41 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 10:12:41 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ChunkDecoder.hpp"
+
+#define MAX_CHUNK_LINE 4096 // Size line with extensions, or one trailer
+
+ChunkDecoder::ChunkDecoder() : _state(SIZE_LINE), _remaining(0) {
+}
+
+ChunkDecoder::Status ChunkDecoder::feed(const char *data, size_t length, std::string &out) {
+	size_t pos = 0;
+
+	while (pos < length && _state != DONE) {
+		if (_state == DATA) {
+			size_t take = std::min(_remaining, length - pos);
+			out.append(data + pos, take);
+			pos += take;
+			_remaining -= take;
+			if (_remaining == 0)
+				_state = DATA_END;
+			continue;
+		}
+
+		// Every other state consumes CRLF-terminated lines
+		const char *end = static_cast<const char *>(memchr(data + pos, '\n', length - pos));
+		size_t		take = end ? end - (data + pos) + 1 : length - pos;
+		_line.append(data + pos, take);
+		pos += take;
+		if (!end) {
+			if (_line.length() > MAX_CHUNK_LINE)
+				return CHUNK_ERROR;
+			break;
+		}
+		if (_line.length() < 2 || _line[_line.length() - 2] != '\r')
+			return CHUNK_ERROR;
+		_line.erase(_line.length() - 2);
+
+		if (_state == DATA_END) {
+			if (!_line.empty())
+				return CHUNK_ERROR;
+			_state = SIZE_LINE;
+		} else if (_state == SIZE_LINE) {
+			size_t size = 0, i = 0;
+			for (; i < _line.length() && isxdigit(static_cast<unsigned char>(_line[i])); ++i) {
+				if (size > (static_cast<size_t>(-1) >> 4))
+					return CHUNK_ERROR;
+				size = (size << 4) | (isdigit(static_cast<unsigned char>(_line[i])) ? _line[i] - '0'
+																					: (tolower(_line[i]) - 'a' + 10));
+			}
+			if (i == 0 || (i < _line.length() && _line[i] != ';' && _line[i] != ' ' && _line[i] != '\t'))
+				return CHUNK_ERROR; // Anything after the size must be a chunk extension
+			_remaining = size;
+			_state = size ? DATA : TRAILER;
+		} else if (_line.empty()) { // Blank line ends the trailers
+			_state = DONE;
+		}
+		_line.clear();
+	}
+	return _state == DONE ? CHUNK_DONE : CHUNK_MORE;
+}
@@ -0,0 +1,48 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ChunkDecoder.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 10:12:41 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 10:12:41 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CHUNK_DECODER_HPP
+#define CHUNK_DECODER_HPP
+
+#include "../WebServ.hpp"
+
+// Incremental "Transfer-Encoding: chunked" decoder: bytes are fed as they
+// come off the socket, so a body never has to be buffered whole to be
+// unchunked (Request::unchunkData needs the complete message).
+class ChunkDecoder {
+	public:
+		enum Status {
+			CHUNK_MORE,		// Need more input
+			CHUNK_DONE,		// Last chunk and trailers consumed
+			CHUNK_ERROR		// Malformed framing
+		};
+
+		ChunkDecoder();
+
+		// Decode data, appending the payload to out
+		Status feed(const char *data, size_t length, std::string &out);
+
+	private:
+		enum State {
+			SIZE_LINE,
+			DATA,
+			DATA_END,
+			TRAILER,
+			DONE
+		};
+
+		State _state;
+		size_t _remaining;	// Payload bytes left in the current chunk
+		std::string _line;	// Partial size or trailer line
+};
+
+#endif
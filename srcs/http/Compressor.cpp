@@ -0,0 +1,81 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Compressor.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/12 14:10:21 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/12 14:10:21 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "Compressor.hpp"
+
+Compressor::Compressor(int level) : _initialized(false) {
+	std::memset(&_stream, 0, sizeof(_stream));
+	if (level < 1 || level > 9)
+		level = GZIP_COMP_LEVEL;
+	// windowBits 15 + 16 selects the gzip wrapper instead of raw zlib
+	_initialized = deflateInit2(&_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+Compressor::~Compressor() {
+	if (_initialized)
+		deflateEnd(&_stream);
+}
+
+bool Compressor::compress(const char *data, size_t length, bool finish, std::string &output) {
+	if (!_initialized)
+		return false;
+
+	char buffer[CGI_BUFSIZE];
+	_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	_stream.avail_in = static_cast<uInt>(length);
+
+	int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+	int result;
+	do {
+		_stream.next_out = reinterpret_cast<Bytef *>(buffer);
+		_stream.avail_out = sizeof(buffer);
+		result = deflate(&_stream, flush);
+		if (result == Z_STREAM_ERROR)
+			return false;
+		output.append(buffer, sizeof(buffer) - _stream.avail_out);
+	} while (_stream.avail_out == 0 || (finish && result != Z_STREAM_END));
+	return true;
+}
+
+std::string Compressor::gzip(const std::string &data, int level) {
+	Compressor	compressor(level);
+	std::string output;
+	if (!compressor.compress(data.data(), data.length(), true, output))
+		return "";
+	return output;
+}
+
+bool Compressor::acceptsGzip(const std::string &acceptEncoding) {
+	std::istringstream codings(acceptEncoding);
+	std::string		   coding;
+
+	while (std::getline(codings, coding, ',')) {
+		std::string name = Utils::trim(coding.substr(0, coding.find(';')));
+		if (name != "gzip" && name != "*")
+			continue;
+		// An explicit q=0 refuses the coding
+		size_t qPos = coding.find("q=");
+		if (qPos != std::string::npos && atof(coding.c_str() + qPos + 2) <= 0.0)
+			return false;
+		return true;
+	}
+	return false;
+}
+
+bool Compressor::isCompressibleType(const std::string &contentType, const std::vector<std::string> &types) {
+	std::string mime = Utils::trim(contentType.substr(0, contentType.find(';')));
+	for (std::vector<std::string>::const_iterator it = types.begin(); it != types.end(); ++it) {
+		if (*it == "*" || *it == mime)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,41 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Compressor.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/12 14:10:21 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/12 14:10:21 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef COMPRESSOR_HPP
+#define COMPRESSOR_HPP
+
+#include "../WebServ.hpp"
+#include <zlib.h>
+
+// Incremental gzip encoder around a zlib deflate stream
+class Compressor {
+	public:
+		explicit Compressor(int level = GZIP_COMP_LEVEL);
+		~Compressor();
+
+		// Feed input and append whatever compressed output is ready; finish flushes the gzip trailer
+		bool compress(const char *data, size_t length, bool finish, std::string &output);
+
+		// One-shot helpers
+		static std::string gzip(const std::string &data, int level = GZIP_COMP_LEVEL);
+		static bool acceptsGzip(const std::string &acceptEncoding);
+		static bool isCompressibleType(const std::string &contentType, const std::vector<std::string> &types);
+
+	private:
+		z_stream _stream;
+		bool _initialized;
+
+		Compressor(const Compressor &);
+		Compressor &operator=(const Compressor &);
+};
+
+#endif
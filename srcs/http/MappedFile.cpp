@@ -0,0 +1,149 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   MappedFile.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/14 18:02:44 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/14 18:02:44 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "MappedFile.hpp"
+#include <sys/mman.h>
+
+std::map<MappedFile::FileKey, MappedFile *> MappedFile::_cache;
+sigjmp_buf									MappedFile::_busJump;
+volatile sig_atomic_t						MappedFile::_busGuard = 0;
+bool										MappedFile::_busHandlerInstalled = false;
+
+MappedFile::MappedFile(int fd, char *data, const struct stat &st) :
+		_key(st.st_dev, st.st_ino),
+		_fd(fd),
+		_data(data),
+		_size(st.st_size),
+		_mtime(st.st_mtime),
+		_refCount(1),
+		_isCached(false),
+		_advisedUpTo(0) {
+}
+
+MappedFile::~MappedFile() {
+	munmap(_data, _size);
+	close(_fd);
+}
+
+MappedFile *MappedFile::acquire(int fd, const struct stat &st) {
+	if (st.st_size <= 0 || !S_ISREG(st.st_mode))
+		return NULL;
+
+	FileKey										   key(st.st_dev, st.st_ino);
+	std::map<FileKey, MappedFile *>::iterator it = _cache.find(key);
+	if (it != _cache.end()) {
+		MappedFile *cached = it->second;
+		if (cached->_size == st.st_size && cached->_mtime == st.st_mtime) {
+			cached->retain();
+			close(fd);
+			return cached;
+		}
+		cached->detach(); // File changed: current readers keep the old mapping
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	MappedFile *mapping = new MappedFile(fd, static_cast<char *>(data), st);
+	mapping->_isCached = true;
+	_cache[key] = mapping;
+	mapping->adviseWindow(0, MMAP_READAHEAD);
+	return mapping;
+}
+
+void MappedFile::retain() {
+	++_refCount;
+}
+
+void MappedFile::release() {
+	if (--_refCount > 0)
+		return;
+	detach();
+	delete this;
+}
+
+void MappedFile::detach() {
+	if (!_isCached)
+		return;
+	std::map<FileKey, MappedFile *>::iterator it = _cache.find(_key);
+	if (it != _cache.end() && it->second == this)
+		_cache.erase(it);
+	_isCached = false;
+}
+
+bool MappedFile::isValid(off_t end) {
+	struct stat st;
+	if (fstat(_fd, &st) == 0 && st.st_size >= end)
+		return true;
+	detach();
+	return false;
+}
+
+void MappedFile::adviseWindow(off_t offset, off_t length) {
+	// Only advise each region once, as the window slides forward
+	if (offset + length <= _advisedUpTo)
+		return;
+	if (offset < _advisedUpTo)
+		offset = _advisedUpTo;
+	if (offset >= _size)
+		return;
+	if (offset + length > _size)
+		length = _size - offset;
+
+	long  pageSize = sysconf(_SC_PAGESIZE);
+	off_t aligned = offset - offset % pageSize;
+	madvise(_data + aligned, length + (offset - aligned), MADV_WILLNEED);
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(_fd, offset, length, POSIX_FADV_WILLNEED);
+#endif
+	_advisedUpTo = offset + length;
+}
+
+void MappedFile::busHandler(int signum) {
+	if (_busGuard)
+		siglongjmp(_busJump, 1);
+	signal(signum, SIG_DFL);
+	raise(signum);
+}
+
+ssize_t MappedFile::copyOut(off_t offset, char *buffer, size_t length) {
+	if (offset >= _size)
+		return 0;
+	if ((off_t)length > _size - offset)
+		length = _size - offset;
+
+	if (!_busHandlerInstalled) {
+		struct sigaction sa = {};
+		sa.sa_handler = MappedFile::busHandler;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGBUS, &sa, NULL);
+		_busHandlerInstalled = true;
+	}
+
+	// Touching pages past a truncated end raises SIGBUS instead of returning an error
+	if (sigsetjmp(_busJump, 1) != 0) {
+		_busGuard = 0;
+		detach();
+		return -1;
+	}
+	_busGuard = 1;
+	std::memcpy(buffer, _data + offset, length);
+	_busGuard = 0;
+
+	adviseWindow(offset + length, MMAP_READAHEAD);
+	return length;
+}
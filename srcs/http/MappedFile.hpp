@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   MappedFile.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/14 18:02:44 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/14 18:02:44 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include "../WebServ.hpp"
+#include <setjmp.h>
+
+// Read-only mapping of a file, shared by every response streaming the same inode.
+// Instances are reference counted; the mapping goes away with its last reader.
+class MappedFile {
+	public:
+		// Returns a retained mapping for fd/st and takes ownership of fd, or NULL (fd untouched)
+		static MappedFile *acquire(int fd, const struct stat &st);
+		void retain();
+		void release();
+
+		const char *data() const { return _data; }
+		off_t size() const { return _size; }
+
+		// False once the file shrank below [0, end); the mapping is then dropped from the cache
+		bool isValid(off_t end);
+		// Hint the kernel to read ahead the window that is about to be sent
+		void adviseWindow(off_t offset, off_t length);
+		// Copy out of the mapping, surviving SIGBUS if the file was truncated meanwhile
+		ssize_t copyOut(off_t offset, char *buffer, size_t length);
+
+	private:
+		typedef std::pair<dev_t, ino_t> FileKey;
+		static std::map<FileKey, MappedFile *> _cache;
+
+		FileKey _key;
+		int _fd;
+		char *_data;
+		off_t _size;
+		time_t _mtime;
+		size_t _refCount;
+		bool _isCached;
+		off_t _advisedUpTo;
+
+		// SIGBUS guard for copyOut
+		static sigjmp_buf _busJump;
+		static volatile sig_atomic_t _busGuard;
+		static bool _busHandlerInstalled;
+		static void busHandler(int signum);
+
+		MappedFile(int fd, char *data, const struct stat &st);
+		~MappedFile();
+		void detach();
+
+		MappedFile(const MappedFile &);
+		MappedFile &operator=(const MappedFile &);
+};
+
+#endif
@@ -0,0 +1,219 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   MultipartParser.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 22:41:06 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 22:41:06 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "MultipartParser.hpp"
+
+#define MAX_PART_HEADERS 8192 // Headers of one part
+#define MAX_BOUNDARY 70		  // RFC 2046
+
+MultipartParser::MultipartParser() : _state(PREAMBLE) {
+	for (size_t i = 0; i < 256; ++i) _shift[i] = 1;
+}
+
+bool MultipartParser::begin(const std::string &contentType) {
+	std::string boundary = extractBoundary(contentType);
+	if (boundary.empty() || boundary.length() > MAX_BOUNDARY)
+		return false;
+	_state = PREAMBLE;
+	_delimiter = "\r\n--" + boundary;
+	_buffer = "\r\n"; // So that a body opening with the first delimiter finds it too
+
+	size_t length = _delimiter.length();
+	for (size_t i = 0; i < 256; ++i) _shift[i] = length;
+	for (size_t i = 0; i + 1 < length; ++i) _shift[static_cast<unsigned char>(_delimiter[i])] = length - 1 - i;
+	return true;
+}
+
+std::string MultipartParser::extractBoundary(const std::string &contentType) {
+	if (Utils::toLower(contentType).find("multipart/form-data") != 0)
+		return "";
+	return headerParameter(contentType, "boundary");
+}
+
+MultipartParser::Status MultipartParser::feed(const char *data, size_t length, Handler &handler) {
+	if (_delimiter.empty())
+		return MULTIPART_ERROR;
+	if (_state == EPILOGUE)
+		return MULTIPART_DONE;
+
+	size_t pos = 0;
+	size_t consumed;
+	while (!_buffer.empty()) {
+		// Join the held bytes with only as much new input as a delimiter
+		// straddling the two could need; the rest is parsed in place below
+		size_t held = _buffer.length();
+		size_t take = length - pos;
+		if (_state == BODY || _state == PREAMBLE)
+			take = std::min(take, _delimiter.length());
+		_buffer.append(data + pos, take);
+		pos += take;
+
+		Status status = parse(_buffer.data(), _buffer.length(), consumed, handler);
+		if (status != MULTIPART_MORE) {
+			std::string().swap(_buffer);
+			return status;
+		}
+		if (consumed >= held) { // Every held byte is gone: continue from data itself
+			pos -= _buffer.length() - consumed;
+			_buffer.clear();
+		} else {
+			_buffer.erase(0, consumed);
+			if (pos == length)
+				return MULTIPART_MORE;
+		}
+	}
+
+	Status status = parse(data + pos, length - pos, consumed, handler);
+	if (status == MULTIPART_MORE)
+		_buffer.assign(data + pos + consumed, length - pos - consumed);
+	return status;
+}
+
+MultipartParser::Status MultipartParser::parse(const char *data, size_t length, size_t &consumed,
+												 Handler &handler) {
+	size_t pos = 0;
+	size_t delimiterLength = _delimiter.length();
+
+	for (;;) {
+		consumed = pos;
+		if (_state == PREAMBLE || _state == BODY) {
+			size_t found = find(data, length, pos);
+			if (found == std::string::npos) {
+				// Hold back what could still be the start of a delimiter
+				size_t end = length > delimiterLength - 1 ? length - (delimiterLength - 1) : 0;
+				if (end > pos) {
+					if (_state == BODY && !handler.partData(data + pos, end - pos))
+						return MULTIPART_ERROR;
+					consumed = end;
+				}
+				return MULTIPART_MORE;
+			}
+			if (_state == BODY && ((found > pos && !handler.partData(data + pos, found - pos)) || !handler.endPart()))
+				return MULTIPART_ERROR;
+			pos = found + delimiterLength;
+			_state = DELIMITER_END;
+		} else if (_state == DELIMITER_END) {
+			size_t end = pos;
+			while (end < length && (data[end] == ' ' || data[end] == '\t')) // Transport padding
+				++end;
+			if (length - end < 2)
+				return length - pos > 64 ? MULTIPART_ERROR : MULTIPART_MORE;
+			if (data[end] == '-' && data[end + 1] == '-') {
+				_state = EPILOGUE;
+				return MULTIPART_DONE;
+			}
+			if (data[end] != '\r' || data[end + 1] != '\n')
+				return MULTIPART_ERROR;
+			pos = end + 2;
+			_state = HEADERS;
+		} else if (_state == HEADERS) {
+			size_t		end;
+			std::string block;
+			if (length - pos >= 2 && data[pos] == '\r' && data[pos + 1] == '\n') {
+				end = pos; // No headers at all
+			} else {
+				const char *found = NULL;
+				for (const char *p = data + pos; p + 3 < data + length; ++p) {
+					p = static_cast<const char *>(memchr(p, '\r', data + length - 3 - p));
+					if (!p)
+						break;
+					if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+						found = p;
+						break;
+					}
+				}
+				if (!found)
+					return length - pos > MAX_PART_HEADERS ? MULTIPART_ERROR : MULTIPART_MORE;
+				end = found - data + 2;
+				block.assign(data + pos, end - pos - 2);
+			}
+			if (end - pos > MAX_PART_HEADERS)
+				return MULTIPART_ERROR;
+			Part part;
+			if (!parseHeaders(block, part) || !handler.beginPart(part))
+				return MULTIPART_ERROR;
+			pos = end + 2;
+			_state = BODY;
+		} else {
+			consumed = length;
+			return MULTIPART_DONE;
+		}
+	}
+}
+
+// Boyer-Moore-Horspool: compares from the delimiter's last byte and skips by
+// the shift of the byte under it, so most of a file part is never looked at
+size_t MultipartParser::find(const char *data, size_t length, size_t from) const {
+	const char *needle = _delimiter.data();
+	size_t		last = _delimiter.length() - 1;
+
+	for (size_t i = from; i + last < length; i += _shift[static_cast<unsigned char>(data[i + last])]) {
+		if (data[i + last] == needle[last] && memcmp(data + i, needle, last) == 0)
+			return i;
+	}
+	return std::string::npos;
+}
+
+bool MultipartParser::parseHeaders(const std::string &block, Part &part) {
+	size_t start = 0;
+	while (start < block.length()) {
+		size_t end = block.find("\r\n", start);
+		if (end == std::string::npos)
+			end = block.length();
+		std::string line = block.substr(start, end - start);
+		start = end + 2;
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			return false;
+		std::string name = Utils::toLower(Utils::trim(line.substr(0, colon)));
+		std::string value = Utils::trim(line.substr(colon + 1));
+		if (name == "content-type") {
+			part.contentType = value;
+		} else if (name == "content-disposition") {
+			part.name = headerParameter(value, "name");
+			part.isFile = value.find("filename=") != std::string::npos;
+			part.filename = headerParameter(value, "filename");
+		}
+	}
+	return true;
+}
+
+// Value of a "; name=value" or "; name="value"" parameter, "" if absent
+std::string MultipartParser::headerParameter(const std::string &value, const std::string &name) {
+	size_t pos = value.find(';');
+	while (pos != std::string::npos) {
+		size_t		start = pos + 1;
+		size_t		equals = value.find('=', start);
+		if (equals == std::string::npos)
+			return "";
+		std::string key = Utils::toLower(Utils::trim(value.substr(start, equals - start)));
+		size_t		i = equals + 1;
+		while (i < value.length() && (value[i] == ' ' || value[i] == '\t'))
+			++i;
+		std::string parameter;
+		if (i < value.length() && value[i] == '"') {
+			for (++i; i < value.length() && value[i] != '"'; ++i) {
+				if (value[i] == '\\' && i + 1 < value.length())
+					++i;
+				parameter += value[i];
+			}
+			pos = value.find(';', i);
+		} else {
+			pos = value.find(';', i);
+			parameter = Utils::trim(value.substr(i, pos == std::string::npos ? std::string::npos : pos - i));
+		}
+		if (key == name)
+			return parameter;
+	}
+	return "";
+}
@@ -0,0 +1,77 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   MultipartParser.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/20 22:41:06 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/20 22:41:06 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MULTIPART_PARSER_HPP
+#define MULTIPART_PARSER_HPP
+
+#include "../WebServ.hpp"
+
+// Incremental multipart/form-data parser (RFC 7578). The body is fed as it
+// comes off the socket and each part's content is handed on as it goes, so
+// nothing but a delimiter's worth of bytes (or one part's headers) is held
+// between calls. Delimiters are found with Boyer-Moore-Horspool.
+class MultipartParser {
+	public:
+		enum Status {
+			MULTIPART_MORE,		// Need more input
+			MULTIPART_DONE,		// Closing delimiter seen; the epilogue is ignored
+			MULTIPART_ERROR		// Malformed body, or the handler gave up
+		};
+
+		struct Part {
+			std::string name;			// Form field name
+			std::string filename;		// As sent by the client, unsanitized
+			bool isFile;				// Had a filename parameter
+			std::string contentType;
+
+			Part() : isFile(false) {}
+		};
+
+		// Receives the parts in order; returning false stops the parser
+		class Handler {
+			public:
+				virtual ~Handler() {}
+				virtual bool beginPart(const Part &part) = 0;
+				virtual bool partData(const char *data, size_t length) = 0;
+				virtual bool endPart() = 0;
+		};
+
+		MultipartParser();
+
+		// Takes the boundary from a Content-Type header; false if it has none
+		bool begin(const std::string &contentType);
+		Status feed(const char *data, size_t length, Handler &handler);
+		bool isDone() const { return _state == EPILOGUE; }
+
+		static std::string extractBoundary(const std::string &contentType);
+
+	private:
+		enum State {
+			PREAMBLE,
+			DELIMITER_END,	// After a delimiter: "--" closes, CRLF starts a part
+			HEADERS,
+			BODY,
+			EPILOGUE
+		};
+
+		State _state;
+		std::string _delimiter;		// CRLF "--" boundary
+		size_t _shift[256];			// Horspool shift per byte
+		std::string _buffer;		// Input not consumed yet
+
+		Status parse(const char *data, size_t length, size_t &consumed, Handler &handler);
+		size_t find(const char *data, size_t length, size_t from) const;
+		static bool parseHeaders(const std::string &block, Part &part);
+		static std::string headerParameter(const std::string &value, const std::string &name);
+};
+
+#endif
@@ -16,12 +16,17 @@ Request::Request(const Request &other) {
 	_method = other._method;
 	_path = other._path;
 	_queryString = other._queryString;
+	_scriptName = other._scriptName;
 	_version = other._version;
 	_headers = other._headers;
 	_body = other._body;
 	_config = other._config;
+	_location = other._location;
+	_bodySink = other._bodySink;
 	_isChunked = other._isChunked;
 	_tempFilePath = other._tempFilePath;
+	_isBodyStreamed = other._isBodyStreamed;
+	_peer = other._peer;
 }
 
 Request &Request::operator=(const Request &other) {
@@ -29,36 +34,27 @@ Request &Request::operator=(const Request &other) {
 		_method = other._method;
 		_path = other._path;
 		_queryString = other._queryString;
+		_scriptName = other._scriptName;
 		_version = other._version;
 		_headers = other._headers;
 		_body = other._body;
 		_config = other._config;
+		_location = other._location;
+		_bodySink = other._bodySink;
 		_isChunked = other._isChunked;
 		_tempFilePath = other._tempFilePath;
+		_isBodyStreamed = other._isBodyStreamed;
+		_peer = other._peer;
 	}
 	return *this;
 }
 
 bool Request::parse(const std::string &rawRequest) {
-	size_t firstLineEnd = rawRequest.find("\r\n");
-	if (firstLineEnd == std::string::npos)
+	if (!parseHead(rawRequest))
 		return false;
+	_isBodyStreamed = false;
 
-	// Parse request line
-	if (!parseRequestLine(rawRequest.substr(0, firstLineEnd)))
-		return false;
-
-	// Parse headers
-	size_t headerEnd = rawRequest.find("\r\n\r\n");
-	if (headerEnd == std::string::npos)
-		return false;
-
-	if (!parseHeaders(rawRequest.substr(firstLineEnd + 2, headerEnd - (firstLineEnd + 2))))
-		return false;
-
-	// Check transfer encoding first
-	_isChunked = (getHeader("Transfer-Encoding") == "chunked");
-	size_t bodyStart = headerEnd + 4; // Start of body after headers
+	size_t bodyStart = rawRequest.find("\r\n\r\n") + 4; // Start of body after headers
 
 	if (_isChunked) {
 		try {
@@ -78,6 +74,29 @@ bool Request::parse(const std::string &rawRequest) {
 			_headers["Content-Length"] = Utils::numToString(_body.length());
 		}
 	}
+	return true;
+}
+
+bool Request::parseHead(const std::string &rawHead) {
+	size_t firstLineEnd = rawHead.find("\r\n");
+	if (firstLineEnd == std::string::npos)
+		return false;
+
+	// Parse request line
+	if (!parseRequestLine(rawHead.substr(0, firstLineEnd)))
+		return false;
+
+	// Parse headers
+	size_t headerEnd = rawHead.find("\r\n\r\n");
+	if (headerEnd == std::string::npos)
+		return false;
+
+	if (!parseHeaders(rawHead.substr(firstLineEnd + 2, headerEnd - (firstLineEnd + 2))))
+		return false;
+
+	// Check transfer encoding first
+	_isChunked = (getHeader("Transfer-Encoding") == "chunked");
+	_isBodyStreamed = true;
 	parseCookies();
 	return true;
 }
@@ -159,6 +178,10 @@ const std::string &Request::getPath() const {
 	return _path;
 }
 
+const std::string &Request::getVersion() const {
+	return _version;
+}
+
 const std::string &Request::getBody() const {
 	if (!_tempFilePath.empty())
 		const_cast<Request *>(this)->loadBodyFromTempFile();
@@ -239,6 +262,12 @@ std::string Request::unchunkData(const std::string &chunkedData) {
 	return result;
 }
 
+void Request::setBodyLength(size_t length) {
+	_headers["Content-Length"] = Utils::numToString(length);
+	_headers.erase("Transfer-Encoding");
+	_isChunked = false;
+}
+
 void Request::setTempFilePath(const std::string &path) {
 	_tempFilePath = path;
 }
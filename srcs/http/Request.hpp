@@ -15,27 +15,58 @@
 
 #include "../WebServ.hpp"
 
+struct LocationConfig;
+class BodySink;
+
 class Request {
 	public:
-		Request() : _config(NULL), _cookies(), _isChunked(false) {}
+		// Endpoints of the connection a request arrived on, formatted once at accept()
+		struct Peer {
+			std::string remoteAddr;
+			std::string remotePort;
+			std::string localAddr;
+		};
+
+		Request() :
+				_config(NULL), _location(NULL), _bodySink(NULL), _cookies(), _isChunked(false), _isBodyStreamed(false) {}
 		Request(const Request &other);
 		Request &operator=(const Request &other);
 
 		// Core parsing
 		bool parse(const std::string &rawRequest);
+		// Request line and headers only; the body is streamed separately
+		bool parseHead(const std::string &rawHead);
 
 		// Getters and setters
 		void setConfig(const void* config);
 		const std::string &getMethod() const;
 		const std::string &getPath() const;
+		const std::string &getQueryString() const { return _queryString; }
+		// Script part of the path ("/cgi-bin/app.py" of "/cgi-bin/app.py/extra"), the path if not set
+		const std::string &getScriptName() const { return _scriptName.empty() ? _path : _scriptName; }
+		std::string getPathInfo() const { return _path.substr(getScriptName().length()); }
+		void setScriptName(const std::string &scriptName) { _scriptName = scriptName; }
+		// Location the request was routed to, resolved once by RequestHandler (NULL: not yet, or none)
+		const LocationConfig *getLocation() const { return _location; }
+		void setLocation(const LocationConfig *location) { _location = location; }
+		const Peer &getPeer() const { return _peer; }
+		void setPeer(const Peer &peer) { _peer = peer; }
+		const std::string &getVersion() const;
 		const std::string &getBody() const;
 		void loadBodyFromTempFile();
 		void setTempFilePath(const std::string& path);
 		bool isChunked() const;
+		bool isBodyStreamed() const { return _isBodyStreamed; }
+		// Decoded length of a streamed body, once known (chunked bodies)
+		void setBodyLength(size_t length);
+		// Where the server already wrote the body as it arrived, NULL if it did not
+		BodySink *getBodySink() const { return _bodySink; }
+		void setBodySink(BodySink *bodySink) { _bodySink = bodySink; }
 
 		// Header operations
 		bool hasHeader(const std::string &name) const;
 		std::string getHeader(const std::string &name) const;
+		const std::map<std::string, std::string> &getHeaders() const { return _headers; }
 		bool parseHeaders(const std::string &headerSection);
 
 		void clearBody();
@@ -45,13 +76,18 @@ class Request {
 		std::string _method;
 		std::string _path;
 		std::string _queryString;
+		std::string _scriptName;
 		std::string _version;
 		std::map<std::string, std::string> _headers;
 		std::string _body;
 		const void *_config;
+		const LocationConfig *_location;
+		BodySink *_bodySink;			// Owned by the connection
 		std::string _tempFilePath;
 		std::map<std::string, std::string> _cookies;
 		bool _isChunked;
+		bool _isBodyStreamed;
+		Peer _peer;
 
 		// Parsing helpers
 		bool parseRequestLine(const std::string &line);
@@ -11,6 +11,14 @@
 /* ************************************************************************** */
 
 #include "Response.hpp"
+#include "../handlers/CGIJob.hpp"
+#include <sys/uio.h>
+#ifdef __linux__
+# include <sys/sendfile.h>
+# define HAS_SENDFILE 1
+#else
+# define HAS_SENDFILE 0
+#endif
 
 Response::Response(int statusCode, const std::string &serverName) :
 		_statusCode(statusCode),
@@ -19,7 +27,22 @@ Response::Response(int statusCode, const std::string &serverName) :
 		_bytesWritten(0),
 		_isStreaming(false),
 		_isHeadersSent(false),
-		_cookies() {
+		_cookies(),
+		_segmentIndex(0),
+		_segmentSent(0),
+		_sendOffset(0),
+		_producer(NULL),
+		_isProducerSized(false),
+		_gzipLevel(0),
+		_compressor(NULL),
+		_isChunked(true),
+		_isBodyComplete(false),
+		_isAborted(false),
+		_fileIO(FILE_IO_READ),
+		_isSpoolFile(false),
+		_mapping(NULL),
+		_mappingOffset(0),
+		_cgi(NULL) {
 	_headers["Server"] = serverName;
 	if (statusCode == 100) {
 		_rawOutput = "HTTP/1.1 100 Continue\r\n\r\n";
@@ -29,7 +52,99 @@ Response::Response(int statusCode, const std::string &serverName) :
 	setCookie("test_message", "hello");
 }
 
+// Copies are taken while a response travels from the handler to the client
+// state, before streaming starts, so the compressor state is never shared.
+// Producers and mappings are shared and reference counted.
+Response::Response(const Response &other) :
+		_statusCode(other._statusCode),
+		_headers(other._headers),
+		_body(other._body),
+		_isRawOutput(other._isRawOutput),
+		_rawOutput(other._rawOutput),
+		_fileDescriptor(other._fileDescriptor),
+		_bytesWritten(other._bytesWritten),
+		_isStreaming(other._isStreaming),
+		_isHeadersSent(other._isHeadersSent),
+		_cookies(other._cookies),
+		_segments(other._segments),
+		_segmentIndex(other._segmentIndex),
+		_segmentSent(other._segmentSent),
+		_sendBuffer(other._sendBuffer),
+		_sendOffset(other._sendOffset),
+		_producer(other._producer),
+		_isProducerSized(other._isProducerSized),
+		_gzipLevel(other._gzipLevel),
+		_compressor(NULL),
+		_isChunked(other._isChunked),
+		_isBodyComplete(other._isBodyComplete),
+		_isAborted(other._isAborted),
+		_fileIO(other._fileIO),
+		_isSpoolFile(other._isSpoolFile),
+		_mapping(other._mapping),
+		_mappingOffset(other._mappingOffset),
+		_cgi(other._cgi) {
+	if (_producer)
+		_producer->retain();
+	if (_mapping)
+		_mapping->retain();
+	if (_cgi)
+		_cgi->retain();
+}
+
+Response &Response::operator=(const Response &other) {
+	if (this != &other) {
+		delete _compressor;
+		_compressor = NULL;
+		_statusCode = other._statusCode;
+		_headers = other._headers;
+		_body = other._body;
+		_isRawOutput = other._isRawOutput;
+		_rawOutput = other._rawOutput;
+		_fileDescriptor = other._fileDescriptor;
+		_bytesWritten = other._bytesWritten;
+		_isStreaming = other._isStreaming;
+		_isHeadersSent = other._isHeadersSent;
+		_cookies = other._cookies;
+		_segments = other._segments;
+		_segmentIndex = other._segmentIndex;
+		_segmentSent = other._segmentSent;
+		_sendBuffer = other._sendBuffer;
+		_sendOffset = other._sendOffset;
+		if (other._producer)
+			other._producer->retain();
+		if (_producer)
+			_producer->release();
+		_producer = other._producer;
+		_isProducerSized = other._isProducerSized;
+		_gzipLevel = other._gzipLevel;
+		_isChunked = other._isChunked;
+		_isBodyComplete = other._isBodyComplete;
+		_isAborted = other._isAborted;
+		_fileIO = other._fileIO;
+		_isSpoolFile = other._isSpoolFile;
+		if (other._mapping)
+			other._mapping->retain();
+		if (_mapping)
+			_mapping->release();
+		_mapping = other._mapping;
+		_mappingOffset = other._mappingOffset;
+		if (other._cgi)
+			other._cgi->retain();
+		if (_cgi)
+			_cgi->release();
+		_cgi = other._cgi;
+	}
+	return *this;
+}
+
 Response::~Response() {
+	delete _compressor;
+	if (_producer)
+		_producer->release();
+	if (_mapping)
+		_mapping->release();
+	if (_cgi)
+		_cgi->release();
 }
 
 void Response::setStatusCode(int code) {
@@ -53,6 +168,15 @@ void Response::addHeader(const std::string &name, const std::string &value) {
 	}
 }
 
+std::string Response::getHeader(const std::string &name) const {
+	std::map<std::string, std::string>::const_iterator it = _headers.find(name);
+	return it != _headers.end() ? it->second : "";
+}
+
+void Response::removeHeader(const std::string &name) {
+	_headers.erase(name);
+}
+
 void Response::updateContentLength() {
 	_headers["Content-Length"] = Utils::numToString(_body.length());
 }
@@ -81,7 +205,9 @@ std::string Response::getStatusText() const {
 	// 2xx Success
 	case 200: return "OK";
 	case 201: return "Created";
+	case 202: return "Accepted";
 	case 204: return "No Content";
+	case 206: return "Partial Content";
 
 	// 3xx Redirection
 	case 301: return "Moved Permanently";
@@ -94,14 +220,18 @@ std::string Response::getStatusText() const {
 	case 403: return "Forbidden";
 	case 404: return "Not Found";
 	case 405: return "Method Not Allowed";
+	case 409: return "Conflict";
+	case 412: return "Precondition Failed";
 	case 413: return "Payload Too Large";
 	case 415: return "Unsupported Media Type";
+	case 416: return "Range Not Satisfiable";
 
 	// 5xx Server Errors
 	case 500: return "Internal Server Error";
 	case 501: return "Not Implemented";
 	case 502: return "Bad Gateway";
 	case 503: return "Service Unavailable";
+	case 507: return "Insufficient Storage";
 
 	default: return "Unknown";
 	}
@@ -138,10 +268,12 @@ Response Response::makeErrorResponse(int statusCode, const ServerConfig *config)
 	errorMessages[405] = "The requested method is not allowed for this resource.";
 	errorMessages[413] = "The request entity is larger than the server is willing to process.";
 	errorMessages[415] = "The server does not support the media type of the requested data.";
+	errorMessages[416] = "The requested range cannot be satisfied for this resource.";
 	errorMessages[500] = "The server encountered an unexpected condition.";
 	errorMessages[501] = "The server does not support the functionality required.";
 	errorMessages[502] = "The server received an invalid response from an upstream server.";
 	errorMessages[503] = "The server is temporarily unable to handle the request.";
+	errorMessages[507] = "The server has no room left to store the request.";
 
 	// Determine error category for styling
 	std::string colorClass = (statusCode >= 500) ? "#ffebee" : "#fff3e0";
@@ -190,60 +322,380 @@ Response Response::makeErrorResponse(int statusCode, const ServerConfig *config)
 	return response;
 }
 
+void Response::setSpoolFile(int fd) {
+	setFileDescriptor(fd);
+	_isSpoolFile = true;
+}
+
 void Response::setFileDescriptor(int fd) {
 	closeFileDescriptor(); // Close existing fd if any
 	_fileDescriptor = fd;
 	_isStreaming = true;
 	_bytesWritten = 0;
+	_segments.clear();
+	_segmentIndex = 0;
+	_segmentSent = 0;
+}
+
+void Response::setMappedFile(MappedFile *mapping) {
+	closeFileDescriptor();
+	if (_mapping)
+		_mapping->release();
+	_mapping = mapping; // Takes over the caller's reference
+	_mappingOffset = 0;
+	_isStreaming = true;
+	_bytesWritten = 0;
+	_segments.clear();
+	_segmentIndex = 0;
+	_segmentSent = 0;
+}
+
+void Response::addFileSegment(off_t offset, off_t length) {
+	BodySegment segment;
+	segment.offset = offset;
+	segment.length = length;
+	_segments.push_back(segment);
+}
+
+void Response::addDataSegment(const std::string &data) {
+	BodySegment segment;
+	segment.data = data;
+	segment.offset = 0;
+	segment.length = -1;
+	_segments.push_back(segment);
 }
 
 bool Response::writeNextChunk(int clientFd) {
-	if (!_isStreaming || _fileDescriptor < 0)
+	if (!_isStreaming || !isStreamed())
 		return false;
 
 	try {
-		// Send headers first if not sent
+		// Queue headers first; they go out through the same buffer as the body
 		if (!_isHeadersSent) {
-			std::string headers = getHeadersString();
-			ssize_t		headersSent = send(clientFd, headers.c_str(), headers.length(), MSG_NOSIGNAL);
-			if (headersSent < 0) {
-				if (errno == EAGAIN || errno == EWOULDBLOCK)
-					return true;
-				return false;
-			}
+			_sendBuffer = getHeadersString();
+			_sendOffset = 0;
 			_isHeadersSent = true;
 		}
 
-		// Send file content
-		char	buffer[RESPONSE_SIZE];
-		ssize_t bytesRead = read(_fileDescriptor, buffer, sizeof(buffer));
-
-		if (bytesRead > 0) {
-			ssize_t bytesWritten = send(clientFd, buffer, bytesRead, MSG_NOSIGNAL);
-			if (bytesWritten < 0) {
-				if (errno == EAGAIN || errno == EWOULDBLOCK)
-					return true;
+		// Uncompressed slices can skip the userspace copy entirely
+		if (!hasUnknownLength() &&
+			(_mapping || (_fileIO == FILE_IO_SENDFILE && HAS_SENDFILE && !_segments.empty())))
+			return writeZeroCopyChunk(clientFd);
+
+		// Refill once everything buffered has been sent
+		if (_sendOffset >= _sendBuffer.length()) {
+			_sendBuffer.clear();
+			_sendOffset = 0;
+			FillStatus status = fillSendBuffer();
+			if (status == FILL_AGAIN) // Producer has nothing yet
+				return true;
+			if (status == FILL_DONE) {
+				finishStreaming(); // Mark streaming as complete
 				return false;
 			}
-			_bytesWritten += bytesWritten;
-			return true;
-		} else if (bytesRead == 0) { // EOF reached
-			closeFileDescriptor();
-			_isStreaming = false; // Mark streaming as complete
+		}
+
+		ssize_t bytesWritten =
+			send(clientFd, _sendBuffer.data() + _sendOffset, _sendBuffer.length() - _sendOffset, MSG_NOSIGNAL);
+		if (bytesWritten < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return true;
+			_isAborted = true;
+			finishStreaming();
 			return false;
 		}
+		_sendOffset += bytesWritten;
+		_bytesWritten += bytesWritten;
+		return true;
 	} catch (const std::exception &e) {
-		closeFileDescriptor();
-		_isStreaming = false;
+		_isAborted = true;
+		finishStreaming();
+		return false;
+	}
+}
+
+bool Response::isReady() const {
+	if (!_producer || _isBodyComplete || _sendOffset < _sendBuffer.length())
+		return true;
+	return _producer->isReady();
+}
+
+bool Response::writeZeroCopyChunk(int clientFd) {
+	if (_sendOffset >= _sendBuffer.length()) {
+		_sendBuffer.clear();
+		_sendOffset = 0;
+	}
+
+	// Step over finished slices; inline parts are staged in the send buffer
+	while (_sendBuffer.empty() && _segmentIndex < _segments.size()) {
+		const BodySegment &segment = _segments[_segmentIndex];
+		if (segment.length < 0) {
+			_sendBuffer = segment.data;
+			++_segmentIndex;
+			break;
+		}
+		if (_segmentSent < segment.length)
+			break;
+		++_segmentIndex;
+		_segmentSent = 0;
+	}
+
+	// Current file slice, sent together with any staged inline bytes
+	off_t  sliceOffset = 0;
+	size_t sliceLength = 0;
+	if (_segmentIndex < _segments.size() && _segments[_segmentIndex].length >= 0) {
+		const BodySegment &segment = _segments[_segmentIndex];
+		off_t			   remaining = segment.length - _segmentSent;
+		sliceOffset = segment.offset + _segmentSent;
+		sliceLength = remaining < ZERO_COPY_SLICE ? (size_t)remaining : ZERO_COPY_SLICE;
+	}
+	if (_sendBuffer.empty() && sliceLength == 0) {
+		finishStreaming();
+		return false;
+	}
+
+	ssize_t sent;
+	if (_mapping) {
+		// A truncated file would fault inside the kernel copy: check before every slice
+		if (sliceLength > 0 && !_mapping->isValid(sliceOffset + sliceLength)) {
+			_isAborted = true;
+			finishStreaming();
+			return false;
+		}
+		struct iovec iov[2];
+		int			 count = 0;
+		if (!_sendBuffer.empty()) {
+			iov[count].iov_base = const_cast<char *>(_sendBuffer.data() + _sendOffset);
+			iov[count++].iov_len = _sendBuffer.length() - _sendOffset;
+		}
+		if (sliceLength > 0) {
+			iov[count].iov_base = const_cast<char *>(_mapping->data() + sliceOffset);
+			iov[count++].iov_len = sliceLength;
+			_mapping->adviseWindow(sliceOffset + sliceLength, MMAP_READAHEAD);
+		}
+		struct msghdr message = {};
+		message.msg_iov = iov;
+		message.msg_iovlen = count;
+		sent = sendmsg(clientFd, &message, MSG_NOSIGNAL);
+	} else if (!_sendBuffer.empty()) {
+		sent = send(clientFd, _sendBuffer.data() + _sendOffset, _sendBuffer.length() - _sendOffset, MSG_NOSIGNAL);
+	} else {
+#if HAS_SENDFILE
+		off_t offset = sliceOffset;
+		sent = sendfile(clientFd, _fileDescriptor, &offset, sliceLength);
+		if (sent == 0) { // File shrank underneath us
+			_isAborted = true;
+			finishStreaming();
+			return false;
+		}
+#else
+		sent = -1;
+		errno = ENOSYS;
+#endif
+	}
+
+	if (sent < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return true;
+		_isAborted = true;
+		finishStreaming();
 		return false;
 	}
-	return false;
+
+	// Inline bytes went out first, the rest came from the slice
+	size_t fromBuffer = std::min((size_t)sent, _sendBuffer.length() - _sendOffset);
+	_sendOffset += fromBuffer;
+	_segmentSent += sent - fromBuffer;
+	_bytesWritten += sent;
+	return true;
+}
+
+ssize_t Response::readBody(char *buffer, size_t size) {
+	if (!_mapping)
+		return read(_fileDescriptor, buffer, size);
+	ssize_t bytesRead = _mapping->copyOut(_mappingOffset, buffer, size);
+	if (bytesRead > 0)
+		_mappingOffset += bytesRead;
+	return bytesRead;
+}
+
+void Response::finishStreaming() {
+	closeFileDescriptor();
+	if (_producer) {
+		_producer->release();
+		_producer = NULL;
+	}
+	if (_mapping) {
+		_mapping->release();
+		_mapping = NULL;
+	}
+	_isStreaming = false;
+}
+
+void Response::enableGzipStream(int level) {
+	_gzipLevel = level;
+	_isBodyComplete = false;
+	_headers.erase("Content-Length");
+	_headers["Content-Encoding"] = "gzip";
+}
+
+void Response::setBodyProducer(BodyProducer *producer, off_t length) {
+	closeFileDescriptor();
+	if (_producer)
+		_producer->release();
+	_producer = producer; // Takes over the caller's reference
+	_isProducerSized = (length >= 0);
+	_isStreaming = true;
+	_isBodyComplete = false;
+	_bytesWritten = 0;
+	if (_isProducerSized)
+		_headers["Content-Length"] = Utils::numToString(length);
+	else
+		_headers.erase("Content-Length");
+}
+
+void Response::setCGIJob(CGIJob *job) {
+	if (_cgi)
+		_cgi->release();
+	_cgi = job; // Takes over the caller's reference; NULL detaches a finished job
+}
+
+void Response::setHttpVersion(const std::string &version) {
+	// HTTP/1.0 has no chunked coding: such bodies end when the connection closes
+	_isChunked = (version != "HTTP/1.0");
+}
+
+Response::FillStatus Response::fillSendBuffer() {
+	if (hasUnknownLength())
+		return fillEncodedBuffer();
+
+	// Producer of a declared length: fragments go out unframed
+	if (_producer) {
+		if (_isBodyComplete)
+			return FILL_DONE;
+		std::string			 piece;
+		BodyProducer::Status status = _producer->produce(piece);
+		if (status == BodyProducer::AGAIN)
+			return FILL_AGAIN;
+		if (status == BodyProducer::FAILED) {
+			_isAborted = true;
+			return FILL_DONE;
+		}
+		if (status == BodyProducer::DONE) {
+			_isBodyComplete = true;
+			if (piece.empty())
+				return FILL_DONE;
+		}
+		_sendBuffer.swap(piece);
+		return FILL_DATA;
+	}
+
+	char buffer[RESPONSE_SIZE];
+
+	// Plain stream: read sequentially from the current file position
+	if (_segments.empty()) {
+		ssize_t bytesRead = readBody(buffer, sizeof(buffer));
+		if (bytesRead <= 0)
+			return FILL_DONE;
+		_sendBuffer.assign(buffer, bytesRead);
+		return FILL_DATA;
+	}
+
+	// Segmented stream: inline parts and file slices read at their own offsets
+	while (_segmentIndex < _segments.size()) {
+		const BodySegment &segment = _segments[_segmentIndex];
+		if (segment.length < 0) {
+			_sendBuffer = segment.data;
+			++_segmentIndex;
+			return FILL_DATA;
+		}
+		off_t remaining = segment.length - _segmentSent;
+		if (remaining <= 0) {
+			++_segmentIndex;
+			_segmentSent = 0;
+			continue;
+		}
+		size_t	toRead = remaining < (off_t)sizeof(buffer) ? (size_t)remaining : sizeof(buffer);
+		ssize_t bytesRead = pread(_fileDescriptor, buffer, toRead, segment.offset + _segmentSent);
+		if (bytesRead <= 0) { // File shrank underneath us
+			_isAborted = true;
+			return FILL_DONE;
+		}
+		_segmentSent += bytesRead;
+		_sendBuffer.assign(buffer, bytesRead);
+		return FILL_DATA;
+	}
+	return FILL_DONE;
+}
+
+Response::FillStatus Response::fillEncodedBuffer() {
+	if (_isBodyComplete)
+		return FILL_DONE;
+	if (_gzipLevel > 0 && !_compressor)
+		_compressor = new Compressor(_gzipLevel);
+
+	// deflate holds small inputs back, so keep pulling until there is output
+	std::string output;
+	while (output.empty()) {
+		std::string			 piece;
+		BodyProducer::Status status = pullBody(piece);
+		if (status == BodyProducer::AGAIN)
+			return FILL_AGAIN;
+		if (status == BodyProducer::FAILED) {
+			_isAborted = true; // Never terminate the body: the client must see it truncated
+			return FILL_DONE;
+		}
+		bool finish = (status == BodyProducer::DONE);
+		if (_compressor) {
+			if (!_compressor->compress(piece.data(), piece.length(), finish, output)) {
+				_isAborted = true;
+				return FILL_DONE;
+			}
+		} else {
+			output.swap(piece);
+		}
+		if (finish) {
+			_sendBuffer = frameBody(output);
+			if (_isChunked)
+				_sendBuffer += "0\r\n\r\n";
+			_isBodyComplete = true;
+			return _sendBuffer.empty() ? FILL_DONE : FILL_DATA;
+		}
+	}
+	_sendBuffer = frameBody(output);
+	return FILL_DATA;
+}
+
+BodyProducer::Status Response::pullBody(std::string &piece) {
+	if (_producer)
+		return _producer->produce(piece);
+
+	char	buffer[RESPONSE_SIZE];
+	ssize_t bytesRead = readBody(buffer, sizeof(buffer));
+	if (bytesRead < 0)
+		return BodyProducer::FAILED;
+	if (bytesRead == 0)
+		return BodyProducer::DONE;
+	piece.assign(buffer, bytesRead);
+	return BodyProducer::DATA;
+}
+
+std::string Response::frameBody(const std::string &data) const {
+	if (!_isChunked || data.empty())
+		return data;
+	std::ostringstream size;
+	size << std::hex << data.length();
+	return size.str() + "\r\n" + data + "\r\n";
 }
 
 void Response::closeFileDescriptor() {
 	if (_fileDescriptor >= 0) {
-		close(_fileDescriptor);
+		if (_isSpoolFile)
+			CGIJob::releaseOutputFile(_fileDescriptor);
+		else
+			close(_fileDescriptor);
 		_fileDescriptor = -1;
+		_isSpoolFile = false;
 	}
 }
 
@@ -257,12 +709,25 @@ void Response::setCookie(const std::string &name, const std::string &value, cons
 	_cookies[name] = cookie;
 }
 
+void Response::mergeCookies(const Response &other) {
+	for (std::map<std::string, std::string>::const_iterator it = other._cookies.begin(); it != other._cookies.end(); ++it)
+		_cookies[it->first] = it->second;
+}
+
 std::string Response::getHeadersString() const {
 	std::string headers = "HTTP/1.1 " + Utils::numToString(_statusCode) + " " + getStatusText() + "\r\n";
 
 	// Add regular headers
-	for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it)
+	for (std::map<std::string, std::string>::const_iterator it = _headers.begin(); it != _headers.end(); ++it) {
+		if (hasUnknownLength() && (it->first == "Content-Length" || it->first == "Transfer-Encoding" ||
+								   (!_isChunked && it->first == "Connection")))
+			continue;
 		headers += it->first + ": " + it->second + "\r\n";
+	}
+
+	// Framing for bodies of unknown length
+	if (hasUnknownLength())
+		headers += _isChunked ? "Transfer-Encoding: chunked\r\n" : "Connection: close\r\n";
 
 	// Add cookies
 	for (std::map<std::string, std::string>::const_iterator it = _cookies.begin(); it != _cookies.end(); ++it)
@@ -15,6 +15,11 @@
 
 #include "../WebServ.hpp"
 #include "../config/ServerConfig.hpp"
+#include "BodyProducer.hpp"
+#include "Compressor.hpp"
+#include "MappedFile.hpp"
+
+class CGIJob;
 
 class Response {
 	private:
@@ -30,27 +35,98 @@ class Response {
 		bool _isHeadersSent;
 		std::map<std::string, std::string> _cookies;
 
+		// Body segments streamed from the file descriptor (byte ranges)
+		struct BodySegment {
+			std::string data;	// Inline data (multipart headers) when length < 0
+			off_t offset;		// File offset of the slice
+			off_t length;		// Slice length, -1 for inline data
+		};
+		std::vector<BodySegment> _segments;
+		size_t _segmentIndex;
+		off_t _segmentSent;
+		std::string _sendBuffer;
+		size_t _sendOffset;
+
+		// Bodies of unknown length: producer and/or gzip, framed chunked or close-delimited
+		BodyProducer *_producer;
+		bool _isProducerSized;	// Producer length declared in Content-Length
+		int _gzipLevel;
+		Compressor *_compressor;
+		bool _isChunked;
+		bool _isBodyComplete;
+		bool _isAborted;
+
+		// Zero-copy strategies for file slices
+		FileIO _fileIO;
+		bool _isSpoolFile;		// _fileDescriptor goes back to the CGI spool pool, not close()
+		MappedFile *_mapping;
+		off_t _mappingOffset;
+
+		// Running CGI job; the response is only filled in once it finishes
+		CGIJob *_cgi;
+
 		// Helper methods
 		void updateContentLength();
 		std::string getStatusText() const;
 		void closeFileDescriptor();
+		enum FillStatus {
+			FILL_DATA,
+			FILL_AGAIN,
+			FILL_DONE
+		};
+		FillStatus fillSendBuffer();
+		FillStatus fillEncodedBuffer();
+		BodyProducer::Status pullBody(std::string &piece);
+		bool writeZeroCopyChunk(int clientFd);
+		ssize_t readBody(char *buffer, size_t size);
+		void finishStreaming();
+		bool hasUnknownLength() const { return (_producer != NULL && !_isProducerSized) || _gzipLevel > 0; }
+		std::string frameBody(const std::string &data) const;
 
 	public:
 		explicit Response(int statusCode = 200, const std::string &serverName = "webserv/1.1");
+		Response(const Response &other);
+		Response &operator=(const Response &other);
 		~Response();
 		void setStatusCode(int code);
+		int getStatusCode() const { return _statusCode; }
+		const std::string &getBody() const { return _body; }
+		std::string getHeader(const std::string &name) const;
+		const std::map<std::string, std::string> &getHeaders() const { return _headers; }
+		void removeHeader(const std::string &name);
 		void setBody(const std::string &body);
 		void addHeader(const std::string &name, const std::string &value);
 		static Response makeErrorResponse(int statusCode, const ServerConfig *config = NULL);
 
 		bool isFileDescriptor() const { return _fileDescriptor >= 0; }
+		int getFileDescriptor() const { return _fileDescriptor; }
+		bool isStreamed() const { return _fileDescriptor >= 0 || _mapping != NULL || _producer != NULL; }
 		void setFileDescriptor(int fd);
+		// A CGI spool file: reused for another request once the body is sent
+		void setSpoolFile(int fd);
+		void setMappedFile(MappedFile *mapping);
+		void setFileIO(FileIO fileIO) { _fileIO = fileIO; }
+		void addFileSegment(off_t offset, off_t length);
+		void addDataSegment(const std::string &data);
+		void enableGzipStream(int level);
+		// length >= 0: the producer yields exactly that many bytes (Content-Length)
+		void setBodyProducer(BodyProducer *producer, off_t length = -1);
+		void setHttpVersion(const std::string &version);
+		bool isCloseDelimited() const { return hasUnknownLength() && !_isChunked; }
+		bool isReady() const;
+		// Descriptor to watch while !isReady(), -1 if none
+		int getWaitFd() const { return isReady() ? -1 : _producer->getWaitFd(); }
+		bool isAborted() const { return _isAborted; }
+		void setCGIJob(CGIJob *job);
+		CGIJob *getCGIJob() const { return _cgi; }
 		std::string toString() const;
 		bool writeNextChunk(int clientFd);
 		std::string getHeadersString() const;
 		void setCookie(const std::string& name, const std::string& value,
 					   const std::string& expires = "", const std::string& path = "/");
 		void clearCookie(const std::string& name);
+		// Takes other's cookies, over its own of the same name
+		void mergeCookies(const Response& other);
 		void setSessionId(const std::string& sessionId);
 		void clearSession();
 		Response makeRedirect(int code, const std::string& location);
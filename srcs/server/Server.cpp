@@ -11,7 +11,13 @@
 /* ************************************************************************** */
 
 #include "Server.hpp"
+#include "../handlers/AIOPool.hpp"
+#include "../handlers/CGICache.hpp"
+#include "../handlers/CGIScheduler.hpp"
+#include "../handlers/CGIWorkerPool.hpp"
+#include "../handlers/PathResolver.hpp"
 #include "../handlers/RequestHandler.hpp"
+#include "SessionManager.hpp"
 
 Logger &Server::_logger = Logger::getInstance();
 
@@ -38,6 +44,7 @@ bool Server::initializeSocket() {
 		_logger.error("Failed to create socket: " + std::string(strerror(errno)));
 		return false;
 	}
+	fcntl(_serverSocket, F_SETFD, FD_CLOEXEC); // CGI children must not keep the port bound
 
 	// Set socket options
 	int opt = 1;
@@ -80,7 +87,15 @@ void Server::setNonBlocking(int sockfd) {
 void Server::handleClientData(int clientFd) {
 	ClientState &client = _clients[clientFd];
 
-	if (client.state == WRITING_RESPONSE)
+	if (client.state == READING_BODY) {
+		readChunkedBody(clientFd, client);
+		return;
+	}
+	if (client.state == READING_UPLOAD) {
+		readUploadBody(clientFd, client);
+		return;
+	}
+	if (client.state != IDLE)
 		return;
 
 	char buffer[CHUNK_BUFFER_SIZE];
@@ -106,6 +121,12 @@ void Server::handleClientData(int clientFd) {
 					processCompleteRequests(clientFd, client);
 					return;
 				}
+				// A CGI script gets its body while it uploads instead of after
+				if (!client.isHeadChecked) {
+					client.isHeadChecked = true;
+					if (beginStreamedRequest(clientFd, client, headerEnd))
+						return;
+				}
 				if (!contentLength.empty()) {
 					size_t expectedLength = std::atoi(contentLength.c_str());
 					if (client.requestBuffer.length() >= headerEnd + 4 + expectedLength) {
@@ -144,6 +165,7 @@ void Server::processCompleteRequests(int clientFd, ClientState &client) {
 				return;
 			}
 		}
+		request.setPeer(client.peer);
 		std::string connection = request.getHeader("Connection");
 		client.keepAlive = (connection == "keep-alive");
 
@@ -151,16 +173,356 @@ void Server::processCompleteRequests(int clientFd, ClientState &client) {
 
 		RequestHandler handler(_config);
 		client.response = handler.handleRequest(request);
-		client.response.addHeader("Connection", client.keepAlive ? "keep-alive" : "close");
-		client.state = WRITING_RESPONSE;
-		client.bytesWritten = 0;
-		client.lastActivity = time(NULL);
+		if (client.response.getCGIJob()) {
+			// Park the connection; the loop keeps serving others while the script runs
+			if (client.response.getCGIJob()->getInputFd() >= 0)
+				client.bodyPump.begin(request.getBody(), -1, 0, false);
+			request.clearBody();
+			client.request = request;
+			parkCGI(clientFd, client);
+			return;
+		}
+		startResponse(client, request);
 	} catch (const std::exception &e) {
 		_logger.error("Error processing request: " + std::string(e.what()));
 		closeConnection(clientFd);
 	}
 }
 
+void Server::startResponse(ClientState &client, const Request &request) {
+	client.response.setHttpVersion(request.getVersion());
+	if (client.response.isCloseDelimited()) // Body length is only known once we close
+		client.keepAlive = false;
+	client.response.addHeader("Connection", client.keepAlive ? "keep-alive" : "close");
+	client.state = WRITING_RESPONSE;
+	client.bytesWritten = 0;
+	client.lastActivity = time(NULL);
+}
+
+bool Server::beginStreamedRequest(int clientFd, ClientState &client, size_t headerEnd) {
+	Request		   request;
+	RequestHandler handler(_config);
+	if (!request.parseHead(client.requestBuffer.substr(0, headerEnd + 4)))
+		return false;
+	BodySink *bodySink = NULL;
+	if (!handler.streamsBody(request, client.maxBodySize) &&
+		!(bodySink = handler.makeBodySink(request, client.maxBodySize)))
+		return false;
+
+	std::string buffered = client.requestBuffer.substr(headerEnd + 4);
+	std::string().swap(client.requestBuffer);
+	request.setPeer(client.peer);
+	client.keepAlive = (request.getHeader("Connection") == "keep-alive");
+	client.request = request;
+	if (bodySink) {
+		beginUpload(clientFd, client, bodySink, buffered);
+		return true;
+	}
+
+	if (request.isChunked()) {
+		// Scripts rely on CONTENT_LENGTH, so a chunked body is decoded into an
+		// unlinked temp file first and streamed from there
+		client.spillFd = CGIJob::createOutputFile();
+		if (client.spillFd < 0) {
+			rejectBody(client, 500);
+			return true;
+		}
+		client.state = READING_BODY;
+		spillChunks(clientFd, client, buffered.data(), buffered.length());
+		return true;
+	}
+	size_t length = std::strtoul(request.getHeader("Content-Length").c_str(), NULL, 10);
+	if (buffered.length() > length)
+		buffered.erase(length);
+	dispatchStreamed(clientFd, client, buffered, clientFd, length - buffered.length());
+	return true;
+}
+
+void Server::readChunkedBody(int clientFd, ClientState &client) {
+	char	buffer[CHUNK_BUFFER_SIZE];
+	ssize_t bytesRead = recv(clientFd, buffer, CHUNK_BUFFER_SIZE, MSG_DONTWAIT);
+
+	if (bytesRead > 0) {
+		client.lastActivity = time(NULL);
+		spillChunks(clientFd, client, buffer, bytesRead);
+	} else if (bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+		closeConnection(clientFd);
+	}
+}
+
+void Server::spillChunks(int clientFd, ClientState &client, const char *data, size_t length) {
+	std::string			 decoded;
+	ChunkDecoder::Status status = client.chunks.feed(data, length, decoded);
+
+	if (status == ChunkDecoder::CHUNK_ERROR) {
+		rejectBody(client, 400);
+		return;
+	}
+	client.spilledBytes += decoded.length();
+	if (client.spilledBytes > client.maxBodySize) {
+		rejectBody(client, 413);
+		return;
+	}
+	if (!decoded.empty() &&
+		write(client.spillFd, decoded.data(), decoded.length()) != static_cast<ssize_t>(decoded.length())) {
+		rejectBody(client, 500);
+		return;
+	}
+	if (status == ChunkDecoder::CHUNK_DONE) {
+		client.request.setBodyLength(client.spilledBytes);
+		lseek(client.spillFd, 0, SEEK_SET);
+		dispatchStreamed(clientFd, client, "", client.spillFd, client.spilledBytes);
+	}
+}
+
+void Server::dispatchStreamed(int clientFd, ClientState &client, const std::string &buffered, int sourceFd,
+							  size_t remaining) {
+	RequestHandler handler(_config);
+	client.response = handler.handleRequest(client.request);
+	client.bodyPump.begin(buffered, sourceFd, remaining, sourceFd == clientFd);
+
+	CGIJob *job = client.response.getCGIJob();
+	if (!job || job->getInputFd() < 0) { // Refused before the script started (413, 404, ...)
+		endBodyStream(client);
+		startResponse(client, client.request);
+		client.request = Request();
+		return;
+	}
+	parkCGI(clientFd, client);
+}
+
+void Server::rejectBody(ClientState &client, int code) {
+	// A sink's own failure is answered by the sink (a PUT's 416 tells what it holds)
+	if (client.bodySink && client.bodySink->getStatus() == code)
+		client.response = client.bodySink->finish(&_config);
+	else
+		client.response = Response::makeErrorResponse(code, &_config);
+	endBodyStream(client);
+	client.keepAlive = false; // The rest of the body is never read
+	startResponse(client, client.request);
+	client.request = Request();
+}
+
+void Server::beginUpload(int clientFd, ClientState &client, BodySink *bodySink, const std::string &buffered) {
+	client.bodySink = bodySink;
+	if (bodySink->getStatus()) { // Refused up front (bad target, no boundary, ...)
+		rejectBody(client, bodySink->getStatus());
+		return;
+	}
+	if (!client.request.isChunked()) {
+		client.bodyRemaining = std::strtoul(client.request.getHeader("Content-Length").c_str(), NULL, 10);
+		if (client.bodyRemaining > client.maxBodySize) {
+			rejectBody(client, 413);
+			return;
+		}
+	}
+	client.state = READING_UPLOAD;
+	feedUpload(clientFd, client, buffered.data(), buffered.length());
+}
+
+void Server::readUploadBody(int clientFd, ClientState &client) {
+	ssize_t bytesRead;
+	if (client.request.isChunked()) {
+		char buffer[CHUNK_BUFFER_SIZE];
+		bytesRead = recv(clientFd, buffer, CHUNK_BUFFER_SIZE, MSG_DONTWAIT);
+		if (bytesRead > 0) {
+			client.lastActivity = time(NULL);
+			feedUpload(clientFd, client, buffer, bytesRead);
+			return;
+		}
+	} else {
+		// The sink reads the socket itself (PUT splices it into the file), never past this body
+		bytesRead = client.bodySink->receive(clientFd, client.bodyRemaining);
+		if (bytesRead > 0) {
+			client.lastActivity = time(NULL);
+			client.bodyRemaining -= bytesRead;
+			if (client.bodyRemaining == 0)
+				finishUpload(clientFd, client);
+			return;
+		}
+		if (bytesRead < 0 && client.bodySink->getStatus()) {
+			rejectBody(client, client.bodySink->getStatus());
+			return;
+		}
+	}
+	if (bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+		closeConnection(clientFd);
+}
+
+void Server::feedUpload(int clientFd, ClientState &client, const char *data, size_t length) {
+	if (!client.request.isChunked()) {
+		length = std::min(length, client.bodyRemaining);
+		client.bodyRemaining -= length;
+		if (writeUpload(client, data, length) && client.bodyRemaining == 0)
+			finishUpload(clientFd, client);
+		return;
+	}
+	std::string			 decoded;
+	ChunkDecoder::Status status = client.chunks.feed(data, length, decoded);
+	if (status == ChunkDecoder::CHUNK_ERROR) {
+		rejectBody(client, 400);
+		return;
+	}
+	if (writeUpload(client, decoded.data(), decoded.length()) && status == ChunkDecoder::CHUNK_DONE) {
+		client.request.setBodyLength(client.spilledBytes);
+		finishUpload(clientFd, client);
+	}
+}
+
+bool Server::writeUpload(ClientState &client, const char *data, size_t length) {
+	client.spilledBytes += length;
+	if (client.spilledBytes > client.maxBodySize) {
+		rejectBody(client, 413);
+		return false;
+	}
+	if (length && !client.bodySink->feed(data, length)) {
+		rejectBody(client, client.bodySink->getStatus());
+		return false;
+	}
+	return true;
+}
+
+void Server::finishUpload(int clientFd, ClientState &client) {
+	// The usual handling, which finds the body already on disk
+	RequestHandler handler(_config);
+	client.request.setBodySink(client.bodySink);
+	client.response = handler.handleRequest(client.request);
+	client.request.setBodySink(NULL);
+	if (client.response.getCGIJob()) { // An aio location finishes it on an AIOPool thread, sink and all
+		client.bodySink = NULL;
+		endBodyStream(client);
+		parkCGI(clientFd, client);
+		return;
+	}
+	endBodyStream(client);
+	startResponse(client, client.request);
+	client.request = Request();
+}
+
+void Server::pumpBody(int clientFd, ClientState &client) {
+	CGIJob			*job = client.response.getCGIJob();
+	BodyPump::Status status = client.bodyPump.pump(job->getInputFd());
+
+	client.lastActivity = time(NULL);
+	if (status == BodyPump::PUMP_MORE) {
+		// A script still receiving its upload is not stuck: time it from the last body bytes
+		if (!client.isCGIQueued)
+			armCGITimer(clientFd, client);
+		return;
+	}
+	if (status == BodyPump::PUMP_ERROR)
+		_logger.warn("CGI request body cut short");
+	endBodyStream(client);
+	job->closeInput();
+}
+
+void Server::endBodyStream(ClientState &client) {
+	if (client.bodyPump.hasUnreadSocketData())
+		client.keepAlive = false; // The rest of the body would be taken for the next request
+	client.endBody();
+}
+
+void Server::parkCGI(int clientFd, ClientState &client) {
+	client.state = CGI_RUNNING;
+	client.cgiTimer = 0;
+	armCGITimer(clientFd, client);
+	client.lastActivity = time(NULL);
+	if (client.bodyPump.isActive())
+		pumpBody(clientFd, client);
+}
+
+void Server::armCGITimer(int clientFd, ClientState &client) {
+	// A launch still waiting for a slot gets the queue timeout, a running one CGI_TIMEOUT
+	CGIJob *job = client.response.getCGIJob();
+	client.isCGIQueued = job->isQueued();
+	if (client.cgiTimer)
+		_timers.cancel(client.cgiTimer);
+	client.cgiTimer =
+		_timers.schedule((client.isCGIQueued ? job->getQueueTimeout() : CGI_TIMEOUT) * 1000L, clientFd);
+}
+
+void Server::handleCGIEvent(int clientFd, fd_set &readSet, fd_set &writeSet) {
+	ClientState &client = _clients[clientFd];
+	CGIJob		*job = client.response.getCGIJob();
+
+	if (client.isCGIQueued && !job->isQueued()) // Got its slot: the script's own clock starts now
+		armCGITimer(clientFd, client);
+	if (client.isCGIQueued && !client.bodyPump.wantsSource() && hasClientLeft(clientFd)) {
+		closeConnection(clientFd); // Frees its place in the queue instead of a slot later
+		return;
+	}
+
+	if (client.bodyPump.isActive()) {
+		int inputFd = job->getInputFd();
+		if ((client.bodyPump.wantsSource() && FD_ISSET(clientFd, &readSet)) ||
+			(client.bodyPump.wantsSink() && FD_ISSET(inputFd, &writeSet)))
+			pumpBody(clientFd, client);
+	}
+
+	int writeFd = job->getWriteFd();
+	if (writeFd >= 0 && FD_ISSET(writeFd, &writeSet)) {
+		job->onWritable();
+		client.lastActivity = time(NULL);
+	}
+	int readFd = job->getReadFd();
+	if (readFd >= 0 && FD_ISSET(readFd, &readSet)) {
+		job->onReadable();
+		client.lastActivity = time(NULL);
+	}
+	if (job->isDone())
+		finishCGI(clientFd, client);
+}
+
+bool Server::hasClientLeft(int clientFd) const {
+	char	probe;
+	ssize_t bytes = recv(clientFd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+	return bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+void Server::finishCGI(int clientFd, ClientState &client) {
+	if (client.cgiTimer) {
+		_timers.cancel(client.cgiTimer);
+		client.cgiTimer = 0;
+	}
+	endBodyStream(client); // The script may exit without reading all of it
+	CGIJob *job = client.response.getCGIJob();
+	job->retain(); // complete() may replace the response holding it
+	job->complete(client.response);
+	client.response.setCGIJob(NULL);
+	bool isRetry = job->needsRetry();
+	job->release();
+
+	RequestHandler handler(_config);
+	if (isRetry) { // Waited on a cache fill that had nothing to share: handle it afresh
+		client.response = handler.handleRequest(client.request);
+		if (client.response.getCGIJob()) {
+			parkCGI(clientFd, client);
+			return;
+		}
+	} else
+		handler.completeCGIResponse(client.request, client.response);
+	startResponse(client, client.request);
+	client.request = Request();
+}
+
+void Server::expireTimers() {
+	long long now = TimerQueue::now();
+	int		  clientFd;
+
+	while (_timers.popExpired(now, clientFd)) {
+		std::map<int, ClientState>::iterator it = _clients.find(clientFd);
+		if (it == _clients.end() || it->second.state != CGI_RUNNING)
+			continue;
+		it->second.cgiTimer = 0;
+		if (it->second.isCGIQueued && !it->second.response.getCGIJob()->isQueued()) {
+			armCGITimer(clientFd, it->second); // Started meanwhile; not a queue timeout
+			continue;
+		}
+		it->second.response.getCGIJob()->timeout();
+		finishCGI(clientFd, it->second);
+	}
+}
+
 void Server::handleNewConnection() {
 	struct sockaddr_in addr = {};
 	socklen_t		   addrLen = sizeof(addr);
@@ -182,13 +544,28 @@ void Server::handleNewConnection() {
 		return;
 	}
 	setNonBlocking(clientFd);
+	fcntl(clientFd, F_SETFD, FD_CLOEXEC); // A CGI child holding it would delay our FIN
 	int keepAlive = 1;
 	setsockopt(clientFd, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(keepAlive));
 	// Initialize client state
 	_clients[clientFd] = ClientState();
+	setPeer(clientFd, addr, _clients[clientFd].peer);
 	updateMaxFileDescriptor();
 }
 
+void Server::setPeer(int clientFd, const struct sockaddr_in &remote, Request::Peer &peer) const {
+	char			   buffer[INET_ADDRSTRLEN];
+	struct sockaddr_in local = {};
+	socklen_t		   localLen = sizeof(local);
+
+	peer.remoteAddr = inet_ntop(AF_INET, &remote.sin_addr, buffer, sizeof(buffer)) ? buffer : "";
+	peer.remotePort = Utils::numToString(static_cast<long>(ntohs(remote.sin_port)));
+	// The listener may be bound to 0.0.0.0; the connection knows the address it came in on
+	if (getsockname(clientFd, (struct sockaddr *)&local, &localLen) == 0 &&
+		inet_ntop(AF_INET, &local.sin_addr, buffer, sizeof(buffer)))
+		peer.localAddr = buffer;
+}
+
 void Server::handleClientWrite(int clientFd) {
 	ClientState &client = _clients[clientFd];
 
@@ -196,12 +573,13 @@ void Server::handleClientWrite(int clientFd) {
 		return;
 
 	try {
-		if (client.response.isFileDescriptor()) {
+		if (client.response.isStreamed()) {
 			bool continueStreaming = client.response.writeNextChunk(clientFd);
 			if (!continueStreaming) {
+				bool isAborted = client.response.isAborted();
 				client.clear();
 				client.state = IDLE;
-				if (!client.keepAlive)
+				if (!client.keepAlive || isAborted) // A cut-off body leaves the stream out of sync
 					closeConnection(clientFd);
 			}
 		} else {
@@ -241,8 +619,10 @@ void Server::closeConnection(int clientFd) {
 		return;
 
 	if (_clients.find(clientFd) != _clients.end()) {
+		if (_clients[clientFd].cgiTimer)
+			_timers.cancel(_clients[clientFd].cgiTimer);
 		_clients[clientFd].clear();
-		_clients.erase(clientFd);
+		_clients.erase(clientFd); // Drops the response, which kills a still-running CGI child
 	}
 
 	try {
@@ -283,6 +663,19 @@ void Server::initialize() {
 		throw std::runtime_error("Failed to initialize socket");
 	}
 
+	// Give every location its CGI queue and apply this block's process limit
+	CGIScheduler::getInstance().configure(_config);
+	CGICache::getInstance().configure(_config);
+	PathResolver::getInstance().configure(_config);
+	AIOPool::getInstance().configure(_config);
+	SessionManager::getInstance().configure(_config);
+
+	// Prefork CGI worker pools so the first requests do not pay for interpreter startup
+	for (std::vector<LocationConfig>::const_iterator it = _config.locations.begin(); it != _config.locations.end();
+		 ++it)
+		if (!it->cgi_worker.empty())
+			CGIWorkerPool::get(*it);
+
 	_logger.info("Server initialized on " + _host + ":" + Utils::numToString(_port));
 	updateMaxFileDescriptor();
 }
@@ -301,6 +694,7 @@ void Server::handleExistingConnections(fd_set &readSet, fd_set &writeSet) {
 
 	// Close idle connections
 	for (size_t i = 0; i < toClose.size(); ++i) closeConnection(toClose[i]);
+	expireTimers();
 
 	// Handle active connections
 	std::vector<int> activeClients;
@@ -310,9 +704,15 @@ void Server::handleExistingConnections(fd_set &readSet, fd_set &writeSet) {
 	for (size_t i = 0; i < activeClients.size(); ++i) {
 		int fd = activeClients[i];
 		if (_clients.find(fd) != _clients.end()) { // Check if the client still exists
+			if (_clients[fd].state == CGI_RUNNING) {
+				handleCGIEvent(fd, readSet, writeSet);
+				continue;
+			}
+			int waitFd = _clients[fd].state == WRITING_RESPONSE ? _clients[fd].response.getWaitFd() : -1;
 			if (FD_ISSET(fd, &readSet))
 				handleClientData(fd);
-			if (_clients.find(fd) != _clients.end() && FD_ISSET(fd, &writeSet))
+			if (_clients.find(fd) != _clients.end() &&
+				(FD_ISSET(fd, &writeSet) || (waitFd >= 0 && FD_ISSET(waitFd, &readSet))))
 				handleClientWrite(fd);
 		}
 	}
@@ -335,7 +735,15 @@ bool Server::isConnectionIdle(time_t currentTime, const ClientState &client) con
 
 void Server::updateMaxFileDescriptor() {
 	_maxFd = _serverSocket;
-	for (std::map<int, ClientState>::const_iterator it = _clients.begin(); it != _clients.end(); ++it)
+	for (std::map<int, ClientState>::const_iterator it = _clients.begin(); it != _clients.end(); ++it) {
 		if (it->first >= 0 && it->first < FD_SETSIZE)
 			_maxFd = std::max(_maxFd, it->first);
+		if (it->second.state == CGI_RUNNING) { // The job's pipe or backend socket is watched too
+			_maxFd = std::max(_maxFd, it->second.response.getCGIJob()->getReadFd());
+			_maxFd = std::max(_maxFd, it->second.response.getCGIJob()->getWriteFd());
+			_maxFd = std::max(_maxFd, it->second.response.getCGIJob()->getInputFd());
+		}
+		if (it->second.state == WRITING_RESPONSE)
+			_maxFd = std::max(_maxFd, it->second.response.getWaitFd());
+	}
 }
@@ -15,8 +15,14 @@
 
 #include "../WebServ.hpp"
 #include "../config/ServerConfig.hpp"
+#include "../handlers/CGIJob.hpp"
+#include "../http/BodyPump.hpp"
+#include "../http/BodySink.hpp"
+#include "../http/ChunkDecoder.hpp"
+#include "../http/Request.hpp"
 #include "../http/Response.hpp"
 #include "../utils/Logger.hpp"
+#include "../utils/TimerQueue.hpp"
 
 class Server {
 	public:
@@ -30,9 +36,13 @@ class Server {
 		void handleExistingConnections(fd_set &readSet, fd_set &writeSet);
 		int getServerSocket() const { return _serverSocket; }
 		int getMaxFd() const { return _maxFd; }
+		long msUntilNextTimer() const { return _timers.timeUntilNext(TimerQueue::now()); }
 
 		enum ConnectionState {
 			IDLE,
+			READING_BODY,		// Chunked CGI upload being decoded to spillFd
+			READING_UPLOAD,		// Body going to disk through bodySink (multipart, PUT)
+			CGI_RUNNING,
 			WRITING_RESPONSE
 		};
 		struct ClientState {
@@ -45,6 +55,18 @@ class Server {
 			Response response;
 			size_t bytesWritten;
 			std::string tempFile;
+			Request request;				// Kept while a CGI child runs
+			Request::Peer peer;				// Addresses of this connection, for CGI
+			TimerQueue::TimerId cgiTimer;
+			bool isCGIQueued;				// cgiTimer is the queue timeout, not CGI_TIMEOUT
+			bool isHeadChecked;				// Headers already routed for body streaming
+			BodyPump bodyPump;				// Request body on its way to the script's stdin
+			ChunkDecoder chunks;
+			int spillFd;					// Decoded chunked body, unlinked temp file
+			size_t spilledBytes;
+			size_t maxBodySize;
+			BodySink *bodySink;				// Body going to disk as it arrives
+			size_t bodyRemaining;			// Content-Length bytes of it still to read
 
 			ClientState() :
 					state(IDLE),
@@ -52,9 +74,31 @@ class Server {
 					contentLength(0),
 					keepAlive(true),
 					response(200),
-					bytesWritten(0) {}
+					bytesWritten(0),
+					cgiTimer(0),
+					isCGIQueued(false),
+					isHeadChecked(false),
+					spillFd(-1),
+					spilledBytes(0),
+					maxBodySize(0),
+					bodySink(NULL),
+					bodyRemaining(0) {}
+			void endBody() {
+				bodyPump.reset();
+				chunks = ChunkDecoder();
+				if (spillFd >= 0) {
+					CGIJob::releaseOutputFile(spillFd);
+					spillFd = -1;
+				}
+				spilledBytes = 0;
+				delete bodySink; // Removes the temp file of a body left unfinished
+				bodySink = NULL;
+				bodyRemaining = 0;
+			}
 			void clear() {
 				state = IDLE;
+				isHeadChecked = false;
+				endBody();
 				std::string().swap(requestBuffer);
 				std::string().swap(responseBuffer);
 				if (!tempFile.empty()) {
@@ -80,6 +124,7 @@ class Server {
 		// Socket management
 		int _maxFd;
 		std::map<int, ClientState> _clients;
+		TimerQueue _timers;
 
 		void checkIdleConnections();
 		bool isConnectionIdle(time_t currentTime, const ClientState &client) const;
@@ -93,9 +138,36 @@ class Server {
 		void handleClientWrite(int clientFd);
 		void closeConnection(int clientFd);
 		void updateMaxFileDescriptor();
+		void setPeer(int clientFd, const struct sockaddr_in &remote, Request::Peer &peer) const;
 
 		// Request processing
 		void processCompleteRequests(int clientFd, ClientState &client);
+		void startResponse(ClientState &client, const Request &request);
+
+		// Request bodies streamed into CGI stdin as they arrive
+		bool beginStreamedRequest(int clientFd, ClientState &client, size_t headerEnd);
+		void readChunkedBody(int clientFd, ClientState &client);
+		void spillChunks(int clientFd, ClientState &client, const char *data, size_t length);
+		void dispatchStreamed(int clientFd, ClientState &client, const std::string &buffered, int sourceFd,
+							  size_t remaining);
+		void rejectBody(ClientState &client, int code);
+
+		// Uploads (multipart, PUT) written to disk as they arrive
+		void beginUpload(int clientFd, ClientState &client, BodySink *bodySink, const std::string &buffered);
+		void readUploadBody(int clientFd, ClientState &client);
+		void feedUpload(int clientFd, ClientState &client, const char *data, size_t length);
+		bool writeUpload(ClientState &client, const char *data, size_t length);
+		void finishUpload(int clientFd, ClientState &client);
+		void pumpBody(int clientFd, ClientState &client);
+		void endBodyStream(ClientState &client);
+
+		// CGI jobs running on behalf of a connection
+		void parkCGI(int clientFd, ClientState &client);
+		void armCGITimer(int clientFd, ClientState &client);
+		bool hasClientLeft(int clientFd) const;
+		void handleCGIEvent(int clientFd, fd_set &readSet, fd_set &writeSet);
+		void finishCGI(int clientFd, ClientState &client);
+		void expireTimers();
 		void sendBadRequestResponse(int clientFd);
 };
 
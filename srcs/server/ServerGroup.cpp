@@ -12,9 +12,18 @@
 
 #include "ServerGroup.hpp"
 #include "../config/ConfigParser.hpp"
+#include "../handlers/AIOPool.hpp"
+#include "../handlers/CGICache.hpp"
+#include "../handlers/CGIProcess.hpp"
+#include "../handlers/CGIResources.hpp"
+#include "../handlers/CGIScheduler.hpp"
+#include "../handlers/CGIWorkerPool.hpp"
+#include "../handlers/PathResolver.hpp"
+#include "../handlers/ResumableUploads.hpp"
 
 ServerGroup *ServerGroup::_instance = NULL;
 bool		 ServerGroup::_shutdownRequested = false;
+int			 ServerGroup::_childPipe[2] = {-1, -1};
 std::string	 ServerGroup::_configFile;
 
 ServerGroup::ServerGroup(const std::string &configFile) : _isRunning(false), _maxFd(0) {
@@ -27,17 +36,27 @@ ServerGroup::ServerGroup(const std::string &configFile) : _isRunning(false), _ma
 
 ServerGroup::~ServerGroup() {
 	stop();
+	for (int i = 0; i < 2; ++i) {
+		if (_childPipe[i] >= 0) {
+			close(_childPipe[i]);
+			_childPipe[i] = -1;
+		}
+	}
 }
 
 void ServerGroup::addServer(const ServerConfig &config) {
-	ServerConfig serverConfig = config;
-	serverConfig.precomputePaths();
-
-	Server *server = new Server(serverConfig);
+	Server *server = new Server(config); // Precomputes its own copy of the config
 	_servers.push_back(server);
 }
 
 void ServerGroup::handleEvents(fd_set &readSet, fd_set &writeSet) {
+	if (_childPipe[0] >= 0 && FD_ISSET(_childPipe[0], &readSet))
+		handleChildExits();
+	CGIWorkerPool::maintainAll();
+	CGICache::getInstance().maintain(); // Cache fills have no connection of their own
+	ResumableUploads::getInstance().expire();
+	AIOPool::getInstance().collect(); // Tasks whose connection already let go are freed here
+
 	for (std::vector<Server *>::iterator it = _servers.begin(); // Handle all server events first
 		 it != _servers.end(); ++it) {
 		Server *server = *it;
@@ -49,10 +68,13 @@ void ServerGroup::handleEvents(fd_set &readSet, fd_set &writeSet) {
 	for (std::vector<Server *>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
 		(*it)->handleExistingConnections(readSet, writeSet);
 	}
+	CGIResources::getInstance().refill(); // Pipes for the next launches, made between requests
 
 	// Rebuild fd sets
 	FD_ZERO(&_masterSet);
 	FD_ZERO(&_writeSet);
+	if (_childPipe[0] >= 0)
+		FD_SET(_childPipe[0], &_masterSet);
 
 	for (std::vector<Server *>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
 		Server *server = *it;
@@ -63,10 +85,31 @@ void ServerGroup::handleEvents(fd_set &readSet, fd_set &writeSet) {
 		// Add client sockets to write set if they have pending data
 		const std::map<int, Server::ClientState> &clients = server->getClients();
 		for (std::map<int, Server::ClientState>::const_iterator cit = clients.begin(); cit != clients.end(); ++cit) {
+			if (cit->second.state == Server::CGI_RUNNING) {
+				// Only the script's descriptors matter until it finishes
+				const CGIJob *job = cit->second.response.getCGIJob();
+				int			  readFd = job->getReadFd();
+				int			  writeFd = job->getWriteFd();
+				if (readFd >= 0 && readFd < FD_SETSIZE)
+					FD_SET(readFd, &_masterSet);
+				if (writeFd >= 0 && writeFd < FD_SETSIZE)
+					FD_SET(writeFd, &_writeSet);
+				// A body still uploading: read the client or wait for room in the script's stdin
+				int inputFd = job->getInputFd();
+				if (cit->second.bodyPump.wantsSource() && cit->first < FD_SETSIZE)
+					FD_SET(cit->first, &_masterSet);
+				if (cit->second.bodyPump.wantsSink() && inputFd >= 0 && inputFd < FD_SETSIZE)
+					FD_SET(inputFd, &_writeSet);
+				continue;
+			}
 			if (cit->first >= 0 && cit->first < FD_SETSIZE) {
 				FD_SET(cit->first, &_masterSet);
-				if (cit->second.state == Server::WRITING_RESPONSE)
+				if (cit->second.state == Server::WRITING_RESPONSE && cit->second.response.isReady())
 					FD_SET(cit->first, &_writeSet);
+				// A body waiting on its source (CGI stdout) resumes when that becomes readable
+				int waitFd = cit->second.state == Server::WRITING_RESPONSE ? cit->second.response.getWaitFd() : -1;
+				if (waitFd >= 0 && waitFd < FD_SETSIZE)
+					FD_SET(waitFd, &_masterSet);
 			}
 		}
 	}
@@ -96,6 +139,7 @@ void ServerGroup::start() {
 
 void ServerGroup::stop() {
 	_isRunning = false;
+	AIOPool::getInstance().stop(); // Tasks still read their server's config
 	for (std::vector<Server *>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
 		(*it)->stop();
 		delete *it;
@@ -111,13 +155,21 @@ void ServerGroup::updateMaxFd() {
 	for (std::vector<Server *>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
 		_maxFd = std::max(_maxFd, (*it)->getMaxFd());
 	}
+	_maxFd = std::max(_maxFd, _childPipe[0]);
 }
 
 bool ServerGroup::handleSelect() {
 	fd_set readSet = _masterSet;
 	fd_set writeSet = _writeSet;
 
-	timeval timeout = {SELECT_TIMEOUT_SEC, SELECT_TIMEOUT_USEC};
+	// Wake up in time for the earliest pending timer (CGI timeouts)
+	long waitMs = SELECT_TIMEOUT_SEC * 1000L + SELECT_TIMEOUT_USEC / 1000;
+	for (std::vector<Server *>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
+		long untilNext = (*it)->msUntilNextTimer();
+		if (untilNext >= 0 && untilNext < waitMs)
+			waitMs = untilNext;
+	}
+	timeval timeout = {waitMs / 1000, (waitMs % 1000) * 1000};
 	int		activity = select(_maxFd + 1, &readSet, &writeSet, NULL, &timeout);
 
 	if (activity < 0) {
@@ -125,15 +177,20 @@ bool ServerGroup::handleSelect() {
 			return false;
 		throw std::runtime_error("Select failed: " + std::string(strerror(errno)));
 	}
-	if (activity > 0)
-		handleEvents(readSet, writeSet);
+	handleEvents(readSet, writeSet); // Also runs on timeout so expired timers fire
 	return true;
 }
 
 void ServerGroup::initializeServers() {
 	FD_ZERO(&_masterSet);
 	FD_ZERO(&_writeSet);
+	if (_childPipe[0] >= 0)
+		FD_SET(_childPipe[0], &_masterSet);
 
+	CGIScheduler::getInstance().resetLimit(); // Lowered again by each server's cgi_max_processes
+	CGICache::getInstance().resetLimits();
+	CGIResources::getInstance().initialize();
+	PathResolver::getInstance().reset(); // Reopened by each server from its config
 	for (std::vector<Server *>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
 		try {
 			(*it)->initialize();
@@ -155,6 +212,40 @@ void ServerGroup::setupSignalHandlers() {
 		sigaction(SIGQUIT, &sa, NULL) == -1 || sigaction(SIGHUP, &sa, NULL) == -1) {
 		throw std::runtime_error("Failed to set up signal handlers");
 	}
+
+	// CGI children report their exit through a self-pipe so select() wakes up
+	if (_childPipe[0] < 0) {
+		if (pipe(_childPipe) < 0)
+			throw std::runtime_error("Failed to create SIGCHLD pipe");
+		for (int i = 0; i < 2; ++i) {
+			fcntl(_childPipe[i], F_SETFL, fcntl(_childPipe[i], F_GETFL, 0) | O_NONBLOCK);
+			fcntl(_childPipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+	struct sigaction childAction = {};
+	childAction.sa_handler = ServerGroup::childHandler;
+	sigemptyset(&childAction.sa_mask);
+	childAction.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	if (sigaction(SIGCHLD, &childAction, NULL) == -1)
+		throw std::runtime_error("Failed to set up SIGCHLD handler");
+}
+
+void ServerGroup::childHandler(int signum) {
+	(void)signum;
+	int savedErrno = errno;
+	if (_childPipe[1] >= 0) {
+		ssize_t written = write(_childPipe[1], "c", 1); // A full pipe already guarantees a wake-up
+		(void)written;
+	}
+	errno = savedErrno;
+}
+
+void ServerGroup::handleChildExits() {
+	char buffer[64];
+	while (read(_childPipe[0], buffer, sizeof(buffer)) > 0) {
+	}
+	CGIProcess::reapChildren();
+	CGIWorkerPool::reapWorkers();
 }
 
 void ServerGroup::signalHandler(int signum) {
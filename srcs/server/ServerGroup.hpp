@@ -30,6 +30,7 @@ class ServerGroup {
 		static const int SELECT_TIMEOUT_USEC = 0;
 
 		static bool _shutdownRequested;
+		static int _childPipe[2];	// SIGCHLD self-pipe, read end watched by select()
 		bool _isRunning;
 		int _maxFd;
 
@@ -41,6 +42,8 @@ class ServerGroup {
 		void reloadConfiguration(const std::string &configFile);
 
 		static void signalHandler(int signum);
+		static void childHandler(int signum);
+		void handleChildExits();
 		void cleanup();
 
 	public:
@@ -21,9 +21,10 @@ class Session {
 		std::map<std::string, std::string> _data;
 		time_t _createdAt;
 		time_t _lastAccessed;
-		static const time_t SESSION_TIMEOUT = 1800; // 30 minutes
 
 	public:
+		static const time_t SESSION_TIMEOUT = 1800; // 30 minutes
+
 		explicit Session(const std::string& id) :
 				_id(id),
 				_data(),
@@ -12,63 +12,224 @@
 
 #include "SessionManager.hpp"
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define SESSION_TABLE_MIN 1024 // Initial slots, kept at most half full
+
 SessionManager *SessionManager::_instance = NULL;
+Logger		   &SessionManager::_logger = Logger::getInstance();
+
+SessionManager::SessionManager() :
+		_shared(NULL),
+		_table(SESSION_TABLE_MIN, static_cast<Entry *>(NULL)),
+		_count(0),
+		_seed(0),
+		_randomUsed(sizeof(_random)),
+		_expired(0),
+		_evicted(0) {
+	unsigned char seed[sizeof(_seed)];
+	if (fillRandom(seed, sizeof(seed)))
+		std::memcpy(&_seed, seed, sizeof(_seed));
+}
+
+SessionManager::~SessionManager() {
+	for (std::list<Entry *>::iterator it = _lru.begin(); it != _lru.end(); ++it) delete *it;
+	delete _shared;
+	if (_instance == this)
+		_instance = NULL;
+}
+
+void SessionManager::configure(const ServerConfig &config) {
+	const std::string &path = config.session_store_path;
+	if (path.empty()) { // "session_store memory", possibly after a reload
+		if (_shared)
+			_logger.info("Sessions kept in-process again instead of in " + _shared->getPath());
+		delete _shared;
+		_shared = NULL;
+		return;
+	}
+	if (_shared && _shared->getPath() == path)
+		return;
+	SharedSessions *shared = SharedSessions::open(path);
+	if (!shared) {
+		_logger.error("Cannot map the session store " + path + ": " + std::string(strerror(errno)));
+		return;
+	}
+	delete _shared;
+	_shared = shared;
+	_logger.info("Sessions shared through " + path);
+}
+
+bool SessionManager::fillRandom(unsigned char *buffer, size_t length) {
+	size_t filled = 0;
+#ifdef SYS_getrandom
+	while (filled < length) {
+		long got = syscall(SYS_getrandom, buffer + filled, length - filled, 0);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		filled += got;
+	}
+	if (filled == length)
+		return true;
+#endif
+	int fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0)
+		return false;
+	while (filled < length) {
+		ssize_t got = read(fd, buffer + filled, length - filled);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		filled += got;
+	}
+	close(fd);
+	return filled == length;
+}
 
 std::string SessionManager::generateSessionId() {
 	static const char alphanum[] = "0123456789"
 								   "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 								   "abcdefghijklmnopqrstuvwxyz";
-	std::string		  sessionId;
+	static const unsigned limit = 256 - 256 % (sizeof(alphanum) - 1); // Bytes past it would favour some characters
+	std::string			  sessionId;
 	sessionId.reserve(32);
 
-	static time_t last_time = 0;
-	time_t		  current = time(NULL);
-	if (current != last_time) {
-		srand(current);
-		last_time = current;
+	while (sessionId.length() < 32) {
+		if (_randomUsed == sizeof(_random)) {
+			if (!fillRandom(_random, sizeof(_random)))
+				return "";
+			_randomUsed = 0;
+		}
+		unsigned char byte = _random[_randomUsed++];
+		if (byte < limit)
+			sessionId += alphanum[byte % (sizeof(alphanum) - 1)];
 	}
-	for (int i = 0; i < 32; ++i) sessionId += alphanum[rand() % (sizeof(alphanum) - 1)];
 	return sessionId;
 }
 
-Session *SessionManager::createSession(const std::string &sessionId) {
-	std::pair<std::map<std::string, Session>::iterator, bool> result =
-		_sessions.insert(std::make_pair(sessionId, Session(sessionId)));
-	return &(result.first->second);
+size_t SessionManager::hashOf(const std::string &sessionId) const {
+	size_t hash = _seed ^ static_cast<size_t>(2166136261UL); // FNV-1a
+	for (size_t i = 0; i < sessionId.length(); ++i) {
+		hash ^= static_cast<unsigned char>(sessionId[i]);
+		hash *= static_cast<size_t>(16777619UL);
+		hash ^= hash >> 15; // The multiplier alone leaves the low bits weak
+	}
+	return hash;
+}
+
+// The slot holding sessionId, _table.size() if none does
+size_t SessionManager::find(const std::string &sessionId, size_t hash) const {
+	size_t mask = _table.size() - 1;
+	for (size_t i = hash & mask; _table[i]; i = (i + 1) & mask)
+		if (_table[i]->hash == hash && _table[i]->session.getId() == sessionId)
+			return i;
+	return _table.size();
+}
+
+void SessionManager::insert(Entry *entry) {
+	if ((_count + 1) * 2 > _table.size())
+		grow();
+	size_t mask = _table.size() - 1;
+	size_t i = entry->hash & mask;
+	while (_table[i]) i = (i + 1) & mask;
+	_table[i] = entry;
+	_lru.push_front(entry);
+	entry->lru = _lru.begin();
+	++_count;
+}
+
+void SessionManager::remove(Entry *entry) {
+	size_t mask = _table.size() - 1;
+	size_t hole = find(entry->session.getId(), entry->hash);
+	_table[hole] = NULL;
+	// Pull back the entries after it that probed past it
+	for (size_t i = (hole + 1) & mask; _table[i]; i = (i + 1) & mask) {
+		size_t home = _table[i]->hash & mask;
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			_table[hole] = _table[i];
+			_table[i] = NULL;
+			hole = i;
+		}
+	}
+	_lru.erase(entry->lru);
+	delete entry;
+	--_count;
+}
+
+void SessionManager::grow() {
+	std::vector<Entry *> table(_table.size() * 2, static_cast<Entry *>(NULL));
+	size_t				 mask = table.size() - 1;
+	for (size_t i = 0; i < _table.size(); ++i) {
+		if (!_table[i])
+			continue;
+		size_t j = _table[i]->hash & mask;
+		while (table[j]) j = (j + 1) & mask;
+		table[j] = _table[i];
+	}
+	_table.swap(table);
+}
+
+std::string SessionManager::createSession() {
+	std::string sessionId = generateSessionId();
+	if (sessionId.empty())
+		return "";
+	if (_shared)
+		return _shared->create(sessionId) ? sessionId : "";
+	cleanupExpiredSessions();
+	if (_count >= SESSION_STORE_MAX) {
+		remove(_lru.back());
+		++_evicted;
+	}
+	insert(new Entry(sessionId, hashOf(sessionId)));
+	return sessionId;
 }
 
 Session *SessionManager::getSession(const std::string &sessionId) {
-	std::map<std::string, Session>::iterator it = _sessions.find(sessionId);
-	if (it != _sessions.end() && !it->second.isExpired()) {
-		it->second.updateLastAccessed();
-		return &it->second;
+	size_t hash = hashOf(sessionId);
+	size_t slot = find(sessionId, hash);
+	if (slot == _table.size())
+		return NULL;
+	Entry *entry = _table[slot];
+	if (entry->session.isExpired()) {
+		remove(entry);
+		++_expired;
+		return NULL;
 	}
-	return NULL;
+	entry->session.updateLastAccessed();
+	_lru.splice(_lru.begin(), _lru, entry->lru);
+	return &entry->session;
 }
 
 void SessionManager::cleanupExpiredSessions() {
-	std::vector<std::string> expiredIds;
-	for (std::map<std::string, Session>::iterator it = _sessions.begin(); it != _sessions.end(); ++it) {
-		if (it->second.isExpired())
-			expiredIds.push_back(it->first);
+	while (!_lru.empty() && _lru.back()->session.isExpired()) {
+		remove(_lru.back());
+		++_expired;
 	}
-	for (size_t i = 0; i < expiredIds.size(); ++i) _sessions.erase(expiredIds[i]);
 }
 
 bool SessionManager::isValidSession(const std::string &sessionId) {
-	std::map<std::string, Session>::iterator it = _sessions.find(sessionId);
-	if (it != _sessions.end() && it->second.isExpired()) {
-		_sessions.erase(it);
-		return false;
-	} else if (it != _sessions.end() && !it->second.isExpired()) {
-		it->second.updateLastAccessed();
-		return true;
-	}
-	return it != _sessions.end() && !it->second.isExpired();
+	if (_shared)
+		return _shared->touch(sessionId);
+	return getSession(sessionId) != NULL;
 }
 
 void SessionManager::updateSession(const std::string &sessionId) {
-	std::map<std::string, Session>::iterator it = _sessions.find(sessionId);
-	if (it != _sessions.end())
-		it->second.updateLastAccessed();
+	isValidSession(sessionId);
+}
+
+std::string SessionManager::report() const {
+	std::ostringstream out;
+	if (_shared) {
+		out << "sessions " << _shared->count() << "/" << _shared->capacity() << " shared\n";
+		return out.str();
+	}
+	out << "sessions " << _count << "/" << SESSION_STORE_MAX << "\n"
+		<< "sessions_expired " << _expired << "\n"
+		<< "sessions_evicted " << _evicted << "\n";
+	return out.str();
 }
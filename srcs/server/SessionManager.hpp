@@ -15,15 +15,54 @@
 
 #include "../WebServ.hpp"
 #include "Session.hpp"
+#include "SharedSessions.hpp"
+#include "../config/ServerConfig.hpp"
+#include "../utils/Logger.hpp"
 
+// Sessions by ID in an open-addressing hash table (linear probing, entries
+// shifted back on removal so no tombstones pile up). IDs are 32 characters
+// drawn from getrandom(), and hashed with a per-process random seed.
+//
+// Every session expires SESSION_TIMEOUT after its last use, so the list in
+// order of last use is also the order of expiry: expired sessions are
+// dropped from its tail, one step each, and past SESSION_STORE_MAX the
+// least recently used one is evicted from there too.
+//
+// With "session_store shared" sessions are kept in a SharedSessions file
+// instead, which other processes and later runs see as well.
 class SessionManager {
 	private:
-		std::map<std::string, Session> _sessions;
+		struct Entry {
+			Session session;
+			size_t hash;
+			std::list<Entry *>::iterator lru;
+
+			Entry(const std::string &id, size_t idHash) : session(id), hash(idHash) {}
+		};
+
 		static SessionManager* _instance;
+		static Logger &_logger;
+
+		SharedSessions *_shared;		// NULL for in-process sessions
+		std::vector<Entry *> _table;	// Power of two slots, NULL when free
+		std::list<Entry *> _lru;		// Most recently used first
+		size_t _count;
+		size_t _seed;
+		unsigned char _random[512];		// getrandom() bytes not used yet
+		size_t _randomUsed;
+		unsigned long _expired;
+		unsigned long _evicted;
 
-		static std::string generateSessionId() ;
+		SessionManager();
+		Session* getSession(const std::string& sessionId);
+		std::string generateSessionId();
+		bool fillRandom(unsigned char *buffer, size_t length);
+		size_t hashOf(const std::string &sessionId) const;
+		size_t find(const std::string &sessionId, size_t hash) const;
+		void insert(Entry *entry);
+		void remove(Entry *entry);
+		void grow();
 
-		SessionManager() : _sessions() {}
 		SessionManager(const SessionManager&);
 		SessionManager &operator=(const SessionManager&);
 
@@ -34,16 +73,20 @@ class SessionManager {
 			return *_instance;
 		}
 
-		Session* createSession(const std::string &sessionId = generateSessionId());
-		Session* getSession(const std::string& sessionId);
+		// Switches to the shared store the configuration names, or back to the
+		// in-process table; sessions are not carried over either way.
+		// ConfigParser makes every server block agree on it
+		void configure(const ServerConfig &config);
+		// The ID of a new session, "" if none could be made
+		std::string createSession();
+		// Marks a live session as used; false if unknown or expired
 		bool isValidSession(const std::string& sessionId);
 		void updateSession(const std::string& sessionId);
 		void cleanupExpiredSessions();
+		// Counters for the status page
+		std::string report() const;
 
-		~SessionManager() {
-			if (_instance == this)
-				_instance = NULL;
-		}
+		~SessionManager();
 };
 
-#endif
\ No newline at end of file
+#endif
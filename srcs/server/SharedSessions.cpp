@@ -0,0 +1,217 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   SharedSessions.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 21:05:47 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 21:05:47 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "SharedSessions.hpp"
+#include "Session.hpp"
+#include "../utils/TimerQueue.hpp"
+#include <cstddef>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+#define SHARED_SESSIONS_MAGIC "wsess01"
+#define SESSION_BUCKET_SLOTS 7 // A bucket is then 8 cache lines: the lock's and 7 slots
+#define LOCK_SPINS 1024		   // Tries before checking that the holder is alive
+#define LOCK_TIMEOUT_MS 100	   // Held this long, a lock is stale: an update takes microseconds
+
+// Every field has a fixed size, so processes built alike agree on the layout
+struct SharedSessions::Header {
+	char magic[8];
+	uint32_t slotSize;
+	uint32_t bucketCount; // Power of two
+	uint64_t seed;		  // Of the ID hash, the same for every process
+	char padding[40];
+};
+
+struct SharedSessions::Slot {
+	char id[32];			// Not NUL-terminated
+	int64_t createdAt;
+	int64_t lastAccessed;	// 0 when free
+	uint32_t checksum;		// Of the fields above, written last
+	char padding[12];
+};
+
+struct SharedSessions::Bucket {
+	volatile uint32_t owner; // pid holding the lock, 0 when free
+	char padding[60];
+	Slot slots[SESSION_BUCKET_SLOTS];
+};
+
+SharedSessions *SharedSessions::open(const std::string &path) {
+	size_t bucketCount = 1;
+	while (bucketCount * SESSION_BUCKET_SLOTS < SESSION_STORE_MAX) bucketCount *= 2;
+	size_t length = sizeof(Header) + bucketCount * sizeof(Bucket);
+
+	// The default path is in a world-writable directory: never follow a
+	// symlink, and never reset a file someone else owns
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+		close(fd);
+		errno = EPERM;
+		return NULL;
+	}
+	// Only one process at a time checks the header and lays the file out
+	flock(fd, LOCK_EX);
+	Header header;
+	bool   isOurs = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == length &&
+				  pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+				  std::memcmp(header.magic, SHARED_SESSIONS_MAGIC, sizeof(header.magic)) == 0 &&
+				  header.slotSize == sizeof(Slot) && header.bucketCount == bucketCount;
+	if (!isOurs) { // New, or left by another layout: start empty
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, SHARED_SESSIONS_MAGIC, sizeof(header.magic));
+		header.slotSize = sizeof(Slot);
+		header.bucketCount = bucketCount;
+		int random = ::open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+		if (random >= 0) {
+			if (read(random, &header.seed, sizeof(header.seed)) != sizeof(header.seed))
+				header.seed = 0;
+			close(random);
+		}
+		// Zeroed first, so that no one maps a file whose header is already valid
+		if (ftruncate(fd, 0) != 0 || ftruncate(fd, length) != 0 ||
+			pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+			flock(fd, LOCK_UN);
+			close(fd);
+			return NULL;
+		}
+	}
+	void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	flock(fd, LOCK_UN);
+	close(fd); // The mapping keeps the file
+	if (map == MAP_FAILED)
+		return NULL;
+	return new SharedSessions(path, map, length);
+}
+
+SharedSessions::SharedSessions(const std::string &path, void *map, size_t length) :
+		_path(path),
+		_map(map),
+		_length(length),
+		_header(static_cast<Header *>(map)),
+		_buckets(reinterpret_cast<Bucket *>(static_cast<char *>(map) + sizeof(Header))) {
+}
+
+SharedSessions::~SharedSessions() {
+	munmap(_map, _length);
+}
+
+bool SharedSessions::create(const std::string &sessionId) {
+	if (sessionId.length() != sizeof(Slot().id))
+		return false;
+	time_t	now = time(NULL);
+	Bucket &bucket = bucketOf(sessionId);
+	lock(bucket);
+	Slot *slot = &bucket.slots[0];
+	for (int i = 0; i < SESSION_BUCKET_SLOTS; ++i) {
+		if (!isLive(bucket.slots[i], now)) {
+			slot = &bucket.slots[i];
+			break;
+		}
+		if (bucket.slots[i].lastAccessed < slot->lastAccessed)
+			slot = &bucket.slots[i]; // Evicted if no slot is free
+	}
+	std::memcpy(slot->id, sessionId.data(), sizeof(slot->id));
+	slot->createdAt = now;
+	slot->lastAccessed = now;
+	seal(*slot);
+	unlock(bucket);
+	return true;
+}
+
+bool SharedSessions::touch(const std::string &sessionId) {
+	if (sessionId.length() != sizeof(Slot().id))
+		return false;
+	time_t	now = time(NULL);
+	Bucket &bucket = bucketOf(sessionId);
+	bool	isFound = false;
+	lock(bucket);
+	for (int i = 0; i < SESSION_BUCKET_SLOTS && !isFound; ++i) {
+		Slot &slot = bucket.slots[i];
+		if (isLive(slot, now) && std::memcmp(slot.id, sessionId.data(), sizeof(slot.id)) == 0) {
+			slot.lastAccessed = now;
+			seal(slot);
+			isFound = true;
+		}
+	}
+	unlock(bucket);
+	return isFound;
+}
+
+size_t SharedSessions::count() const {
+	time_t now = time(NULL);
+	size_t live = 0;
+	for (size_t b = 0; b < _header->bucketCount; ++b) {
+		lock(_buckets[b]);
+		for (int i = 0; i < SESSION_BUCKET_SLOTS; ++i) live += isLive(_buckets[b].slots[i], now);
+		unlock(_buckets[b]);
+	}
+	return live;
+}
+
+size_t SharedSessions::capacity() const {
+	return _header->bucketCount * SESSION_BUCKET_SLOTS;
+}
+
+SharedSessions::Bucket &SharedSessions::bucketOf(const std::string &sessionId) const {
+	uint64_t hash = _header->seed ^ 14695981039346656037ULL; // FNV-1a
+	for (size_t i = 0; i < sessionId.length(); ++i) {
+		hash ^= static_cast<unsigned char>(sessionId[i]);
+		hash *= 1099511628211ULL;
+	}
+	return _buckets[(hash ^ (hash >> 32)) & (_header->bucketCount - 1)];
+}
+
+void SharedSessions::lock(Bucket &bucket) {
+	uint32_t  self = getpid();
+	long long deadline = 0;
+	for (unsigned spins = 1; !__sync_bool_compare_and_swap(&bucket.owner, 0, self); ++spins) {
+		if (spins % LOCK_SPINS)
+			continue;
+		long long now = TimerQueue::now();
+		if (!deadline)
+			deadline = now + LOCK_TIMEOUT_MS;
+		// Held by a process that is gone, by an earlier one with our pid, or for so
+		// long that its owner must have died and its pid been reused since
+		uint32_t owner = bucket.owner;
+		bool	 isStale = owner == self || (kill(owner, 0) < 0 && errno == ESRCH) || now >= deadline;
+		if (owner && isStale && __sync_bool_compare_and_swap(&bucket.owner, owner, self))
+			return;
+		sched_yield();
+	}
+}
+
+void SharedSessions::unlock(Bucket &bucket) {
+	// Left alone if it was taken over meanwhile: the new owner still holds it
+	__sync_bool_compare_and_swap(&bucket.owner, static_cast<uint32_t>(getpid()), 0);
+}
+
+bool SharedSessions::isLive(const Slot &slot, time_t now) {
+	return slot.lastAccessed && now - slot.lastAccessed <= Session::SESSION_TIMEOUT && slot.checksum == checksumOf(slot);
+}
+
+void SharedSessions::seal(Slot &slot) {
+	slot.checksum = checksumOf(slot);
+}
+
+uint32_t SharedSessions::checksumOf(const Slot &slot) {
+	const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&slot);
+	uint32_t			 checksum = 2166136261U; // FNV-1a over id and both times
+	for (size_t i = 0; i < offsetof(Slot, checksum); ++i) {
+		checksum ^= bytes[i];
+		checksum *= 16777619U;
+	}
+	return checksum;
+}
@@ -0,0 +1,71 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   SharedSessions.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/21 21:05:47 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/21 21:05:47 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef SHARED_SESSIONS_HPP
+#define SHARED_SESSIONS_HPP
+
+#include "../WebServ.hpp"
+#include <stdint.h>
+
+// Sessions in a file mapped MAP_SHARED ("session_store shared", by default
+// under /dev/shm), so every process mapping it sees the same sessions and
+// they outlive a restart. The file is a header and a fixed array of
+// buckets; a session only ever lives in the bucket its ID hashes to, so a
+// lookup takes that bucket's spinlock and reads at most
+// SESSION_BUCKET_SLOTS slots, without any other lock or IPC.
+//
+// A full bucket reuses its expired or least recently used slot. A lock
+// word holds its owner's pid: one left by a process that died is taken
+// over, right away if that pid is gone and after LOCK_TIMEOUT_MS if it was
+// reused, and a slot the dead owner was halfway through writing fails its
+// checksum and counts as free. Only the ID and timestamps are shared, not
+// Session data.
+class SharedSessions {
+	public:
+		// Maps path, creating or resetting it when its layout is not ours;
+		// NULL on failure, or if path is a symlink or not our own regular file
+		static SharedSessions *open(const std::string &path);
+		~SharedSessions();
+
+		const std::string &getPath() const { return _path; }
+		// Stores sessionId as used now; false if it was not stored
+		bool create(const std::string &sessionId);
+		// Marks a live session as used; false if unknown or expired
+		bool touch(const std::string &sessionId);
+		// Live sessions in the whole file, for the status page
+		size_t count() const;
+		size_t capacity() const;
+
+	private:
+		struct Header;
+		struct Slot;
+		struct Bucket;
+
+		std::string _path;
+		void *_map;
+		size_t _length;
+		Header *_header;
+		Bucket *_buckets;
+
+		SharedSessions(const std::string &path, void *map, size_t length);
+		Bucket &bucketOf(const std::string &sessionId) const;
+		static void lock(Bucket &bucket);
+		static void unlock(Bucket &bucket);
+		static bool isLive(const Slot &slot, time_t now);
+		static void seal(Slot &slot);
+		static uint32_t checksumOf(const Slot &slot);
+
+		SharedSessions(const SharedSessions &);
+		SharedSessions &operator=(const SharedSessions &);
+};
+
+#endif
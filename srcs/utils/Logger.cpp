@@ -22,7 +22,7 @@ Logger &Logger::getInstance() {
 
 Logger::Logger()
 	: _enabled(true), _consoleOutput(true), _timestampEnabled(true), _minLevel(INFO), _isLocked(false),
-	  _maxFileSize(DEFAULT_MAX_FILE_SIZE), _maxBackupCount(DEFAULT_MAX_BACKUP_COUNT) {
+	  _maxFileSize(DEFAULT_MAX_FILE_SIZE), _maxBackupCount(DEFAULT_MAX_BACKUP_COUNT), _fileSize(0) {
 	_levelColors[DEBUG] = WHITE;	// White
 	_levelColors[INFO] = GREEN;		// Green
 	_levelColors[WARNING] = YELLOW; // Yellow
@@ -36,25 +36,26 @@ Logger::~Logger() {
 
 void Logger::configure(const std::string &logPath, LogLevel minLevel, bool consoleOutput, bool timestampEnabled,
 					   bool writeToFile) {
-	if (_logFile.is_open())
-		_logFile.close();
-
-	_logPath = logPath;
 	_minLevel = minLevel;
 	_consoleOutput = consoleOutput;
 	_timestampEnabled = timestampEnabled;
 	_writeToFile = writeToFile;
+	if (_logFile.is_open() && logPath == _logPath)
+		return; // Every server block configures the same sink; keep the open file
+
+	if (_logFile.is_open())
+		_logFile.close();
+	_logPath = logPath;
 
 	// Create directory if it doesn't exist
 	size_t lastSlash = _logPath.find_last_of('/');
-	if (lastSlash != std::string::npos) {
-		std::string dirPath = _logPath.substr(0, lastSlash);
-		std::string cmd = "mkdir -p " + dirPath;
-		system(cmd.c_str());
-	}
+	if (lastSlash != std::string::npos)
+		Utils::createDirectories(_logPath.substr(0, lastSlash));
 	_logFile.open(_logPath.c_str(), std::ios::app);
 	if (!_logFile.is_open())
 		throw std::runtime_error("Failed to open log file: " + _logPath);
+	struct stat st;
+	_fileSize = stat(_logPath.c_str(), &st) == 0 ? st.st_size : 0;
 
 	info("Logging initialized", "Logger");
 }
@@ -132,6 +133,7 @@ void Logger::writeToFile(const std::string &message) {
 	if (_logFile.is_open()) {
 		_logFile << message;
 		_logFile.flush();
+		_fileSize += message.length();
 	}
 }
 
@@ -145,13 +147,8 @@ bool Logger::shouldLog(LogLevel level) const {
 }
 
 void Logger::checkRotation() {
-	if (!_logFile.is_open())
-		return;
-
-	struct stat st;
-	if (stat(_logPath.c_str(), &st) == 0)
-		if (static_cast<size_t>(st.st_size) > _maxFileSize)
-			rotate();
+	if (_logFile.is_open() && _fileSize > _maxFileSize)
+		rotate();
 }
 
 void Logger::rotate() {
@@ -170,6 +167,7 @@ void Logger::rotate() {
 
 	// Open new log file
 	_logFile.open(_logPath.c_str(), std::ios::app);
+	_fileSize = 0;
 	info("Log file rotated", "Logger");
 }
 
@@ -50,6 +50,7 @@ class Logger {
 
 		size_t _maxFileSize;
 		size_t _maxBackupCount;
+		size_t _fileSize;		// Tracked as we write, so rotation needs no stat() per line
 
 		// Private constructor for singleton
 		Logger();
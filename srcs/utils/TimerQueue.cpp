@@ -0,0 +1,58 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerQueue.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/17 10:12:31 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/17 10:12:31 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "TimerQueue.hpp"
+
+TimerQueue::TimerQueue() : _nextId(1) {
+}
+
+TimerQueue::TimerId TimerQueue::schedule(long delayMs, int key) {
+	TimerId	 id = _nextId++;
+	Deadline deadline(now() + delayMs, id);
+	_queue.insert(deadline);
+	_timers[id] = deadline;
+	_keys[id] = key;
+	return id;
+}
+
+void TimerQueue::cancel(TimerId id) {
+	std::map<TimerId, Deadline>::iterator it = _timers.find(id);
+	if (it == _timers.end())
+		return;
+	_queue.erase(it->second);
+	_timers.erase(it);
+	_keys.erase(id);
+}
+
+bool TimerQueue::popExpired(long long now, int &key) {
+	if (_queue.empty() || _queue.begin()->first > now)
+		return false;
+	TimerId id = _queue.begin()->second;
+	key = _keys[id];
+	_queue.erase(_queue.begin());
+	_timers.erase(id);
+	_keys.erase(id);
+	return true;
+}
+
+long TimerQueue::timeUntilNext(long long now) const {
+	if (_queue.empty())
+		return -1;
+	long long delay = _queue.begin()->first - now;
+	return delay > 0 ? static_cast<long>(delay) : 0;
+}
+
+long long TimerQueue::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,46 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TimerQueue.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: sehosaf <sehosaf@student.42warsaw.pl>      +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/01/17 10:12:31 by sehosaf           #+#    #+#             */
+/*   Updated: 2025/01/17 10:12:31 by sehosaf          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TIMER_QUEUE_HPP
+#define TIMER_QUEUE_HPP
+
+#include "../WebServ.hpp"
+
+// One-shot timers on the monotonic clock, ordered by deadline.
+// The event loop sleeps until the next deadline and collects the keys of
+// expired timers; what a key means (usually a client fd) is up to the owner.
+class TimerQueue {
+	public:
+		typedef unsigned long TimerId;
+
+		TimerQueue();
+
+		TimerId schedule(long delayMs, int key);
+		void cancel(TimerId id);
+		// Pops one timer due at `now`, false when none is due
+		bool popExpired(long long now, int &key);
+		// Milliseconds until the next deadline, -1 when nothing is scheduled
+		long timeUntilNext(long long now) const;
+		bool empty() const { return _timers.empty(); }
+
+		static long long now();
+
+	private:
+		typedef std::pair<long long, TimerId> Deadline;
+
+		std::set<Deadline> _queue;
+		std::map<TimerId, Deadline> _timers;
+		std::map<TimerId, int> _keys;
+		TimerId _nextId;
+};
+
+#endif
@@ -14,6 +14,27 @@
 #include <algorithm>
 #include <cstring>
 #include <sstream>
+#include <sys/stat.h>
+#include <errno.h>
+
+const signed char Utils::_hexDigits[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
 
 std::string Utils::trim(const std::string &str) {
 	if (str.empty())
@@ -58,8 +79,30 @@ const std::string Utils::toUpper(const std::string string) {
 	return upperString.c_str();
 }
 
+std::string Utils::toLower(const std::string &string) {
+	std::string lowerString = string;
+	std::transform(lowerString.begin(), lowerString.end(), lowerString.begin(), ::tolower);
+	return lowerString;
+}
+
+bool Utils::createDirectories(const std::string &path) {
+	for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1))
+		if (mkdir(path.substr(0, slash).c_str(), 0755) < 0 && errno != EEXIST)
+			return false;
+	struct stat st;
+	if (mkdir(path.c_str(), 0755) < 0 && errno != EEXIST)
+		return false;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
 int Utils::stringToNum(std::basic_string<char> &basicString) {
 	int num;
 	std::istringstream(basicString) >> num;
 	return num;
 }
+
+std::string Utils::formatHttpDate(time_t time) {
+	char buffer[64];
+	strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&time));
+	return std::string(buffer);
+}
@@ -13,6 +13,7 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
+#include <ctime>
 #include <string>
 
 class Utils {
@@ -24,7 +25,20 @@ class Utils {
 		static std::string numToString(long value);
 		static std::string numToString(off_t value);
 		static const std::string toUpper(const std::string string);
+		static std::string toLower(const std::string &string);
 		static int stringToNum(std::basic_string<char> &basicString);
+		// Value of a hex digit, -1 if c is not one
+		static int hexDigit(char c) { return _hexDigits[static_cast<unsigned char>(c)]; }
+
+		// Filesystem helpers
+		// mkdir -p without a shell; true if path is a directory afterwards
+		static bool createDirectories(const std::string &path);
+
+		// HTTP helpers
+		static std::string formatHttpDate(time_t time);
+
+	private:
+		static const signed char _hexDigits[256];
 };
 
 #endif
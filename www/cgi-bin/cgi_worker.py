@@ -0,0 +1,113 @@
+#!/usr/bin/python3
+
+# Persistent CGI worker for the "cgi_worker" directive. The server keeps a
+# few of these alive and hands them requests over fd 3, each field prefixed
+# by a 4-byte big-endian length:
+#   in:  [environment "KEY=VALUE\0..."] [request body]
+#   out: [output chunk]... [empty chunk]
+# Scripts still see a plain CGI/1.1 environment on real fds 0 and 1, so
+# existing scripts run unchanged; only the interpreter start-up is saved.
+
+import os
+import struct
+import sys
+import tempfile
+import traceback
+
+WORKER_FD = 3
+CHUNK = 65536
+
+base_environ = dict(os.environ)
+compiled = {}
+
+def read_exact(length):
+    data = b''
+    while len(data) < length:
+        chunk = os.read(WORKER_FD, length - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+def read_frame():
+    header = read_exact(4)
+    if header is None:
+        return None
+    return read_exact(struct.unpack('>I', header)[0])
+
+def write_frame(data):
+    frame = struct.pack('>I', len(data)) + data
+    while frame:
+        frame = frame[os.write(WORKER_FD, frame):]
+
+def load(path):
+    mtime = os.stat(path).st_mtime
+    cached = compiled.get(path)
+    if cached is None or cached[0] != mtime:
+        with open(path, 'rb') as f:
+            cached = (mtime, compile(f.read(), path, 'exec'))
+        compiled[path] = cached
+    return cached[1]
+
+def run(environment, body):
+    os.environ.clear()
+    os.environ.update(base_environ)
+    for entry in environment.split(b'\0'):
+        if b'=' in entry:
+            key, value = entry.split(b'=', 1)
+            os.environ[key.decode()] = value.decode('utf-8', 'replace')
+    script = os.environ.get('SCRIPT_FILENAME', '')
+
+    # Drop the previous script's stdio objects first: one built with
+    # os.fdopen() closes its fd when collected, which must not hit the new one
+    sys.stdin = sys.stdout = None
+
+    stdin = tempfile.TemporaryFile()
+    stdin.write(body)
+    stdin.seek(0)
+    stdout = tempfile.TemporaryFile()
+    os.dup2(stdin.fileno(), 0)
+    os.dup2(stdout.fileno(), 1)
+    sys.stdin = open(0, 'r', closefd=False)
+    sys.stdout = open(1, 'w', closefd=False)
+    sys.argv = [script]
+
+    failed = False
+    try:
+        exec(load(script), {'__name__': '__main__', '__file__': script})
+    except SystemExit:
+        pass
+    except Exception:
+        traceback.print_exc(file=sys.stderr)
+        failed = True
+    try:
+        sys.stdout.flush()
+    except Exception:
+        pass
+    if failed:
+        os.ftruncate(stdout.fileno(), 0)
+        os.pwrite(stdout.fileno(), b"Status: 500 Internal Server Error\r\n"
+                  b"Content-Type: text/plain\r\n\r\nScript error\n", 0)
+
+    # Read through our own descriptor: the script may have closed fd 1
+    offset = 0
+    while True:
+        data = os.pread(stdout.fileno(), CHUNK, offset)
+        if not data:
+            break
+        write_frame(data)
+        offset += len(data)
+    write_frame(b'')
+    stdin.close()
+    stdout.close()
+
+def main():
+    while True:
+        environment = read_frame()
+        body = read_frame() if environment is not None else None
+        if body is None:
+            return
+        run(environment, body)
+
+if __name__ == "__main__":
+    main()